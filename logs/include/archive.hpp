@@ -0,0 +1,502 @@
+/*
+    滚动日志段的后台处理, 落地线程只做一次入队, 不会因为文件系统操作而卡顿
+    1. SegmentArchiver: 压缩写完的文件, 并按保留策略删除旧文件
+    2. SpareSegment: 提前创建并预分配下一个文件, 滚动时直接换上
+*/
+
+#pragma once
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "compress.hpp"
+
+namespace windlog {
+/*
+    已完成段的保留策略, 正在写的段不计入
+    1. max_files: 最多保留的段数, 0表示不限
+    2. max_bytes: 所有段的总大小上限(压缩后的大小), 0表示不限
+    3. compress: 把段压缩为同名的.lz4文件(LZ4帧格式, 可以直接用 lz4 -d 解压), 完成后删除原文件
+*/
+struct Retention
+{
+    explicit Retention(size_t max_files = 0, size_t max_bytes = 0, bool compress = false)
+        : _max_files(max_files), _max_bytes(max_bytes), _compress(compress)
+    {
+    }
+
+    bool enabled() const { return _max_files > 0 || _max_bytes > 0 || _compress; }
+
+    size_t _max_files;
+    size_t _max_bytes;
+    bool _compress;
+};
+
+/*
+    管理dir目录下名为 prefix + 数字开头 + .log(.lz4) 的段, 文件名的字典序即为时间顺序
+    每次提交只是记下当前正在写的段并唤醒后台线程, 后台线程每一轮:
+    1. 压缩比正在写的段更早的所有未压缩的段(包括上次运行遗留的)
+    2. 从最旧的段开始删除, 直到满足保留策略
+    连续的多次提交合并为一轮处理; 析构时处理完已经提交的工作再退出
+*/
+class SegmentArchiver
+{
+    static constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+    struct Segment
+    {
+        std::string _name;  // 不含.lz4后缀, 用于排序
+        std::string _path;
+        size_t _size;
+        bool _compressed;
+    };
+
+    static bool endsWith(const std::string& str, const std::string& suffix)
+    {
+        return str.size() >= suffix.size() &&
+               str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    static bool writeFull(int fd, const char* data, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t ret = ::write(fd, data, len);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += ret;
+            len -= ret;
+        }
+        return true;
+    }
+
+    static ssize_t readFull(int fd, char* data, size_t len)
+    {
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t ret = ::read(fd, data + done, len - done);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (ret == 0)
+                break;
+            done += ret;
+        }
+        return done;
+    }
+
+    // 只列出比正在写的段更早的段; 列目录时落地线程可能已经打开了更新的段, 它们同样不能动
+    std::vector<Segment> listSegments(const std::string& active)
+    {
+        std::vector<Segment> segments;
+        std::string active_name = active.substr(active.find_last_of('/') + 1);
+        DIR* dir = ::opendir(_dir.c_str());
+        if (dir == nullptr)
+        {
+            report("opendir", _dir, errno);
+            return segments;
+        }
+
+        while (struct dirent* entry = ::readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name.size() <= _prefix.size() || name.compare(0, _prefix.size(), _prefix) != 0 ||
+                !isdigit(static_cast<unsigned char>(name[_prefix.size()])))
+                continue;
+
+            Segment segment;
+            segment._path = _dir + "/" + name;
+            segment._compressed = endsWith(name, ".log.lz4");
+            if (!segment._compressed && !endsWith(name, ".log"))
+                continue;
+            segment._name = segment._compressed ? name.substr(0, name.size() - 4) : name;
+            if (segment._name >= active_name)
+                continue;
+
+            struct stat st;
+            if (::stat(segment._path.c_str(), &st) != 0)
+                continue;
+            segment._size = st.st_size;
+            segments.push_back(std::move(segment));
+        }
+        ::closedir(dir);
+
+        std::sort(segments.begin(), segments.end(),
+                  [](const Segment& a, const Segment& b) { return a._name < b._name; });
+        return segments;
+    }
+
+    // 先写到临时文件并同步, 再改名为.lz4并删除原文件, 任何时刻崩溃都不会丢失数据
+    bool compressFile(Segment& segment)
+    {
+        std::string dst = segment._path + ".lz4";
+        std::string tmp = dst + ".tmp";
+        int in = ::open(segment._path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+        {
+            report("open", segment._path, errno);
+            return false;
+        }
+        int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0)
+        {
+            report("open", tmp, errno);
+            ::close(in);
+            return false;
+        }
+
+        std::string frame;
+        Lz4Frame::header(frame, BLOCK_SIZE);
+        const char* op = nullptr;  // 失败的操作
+        const std::string* failed = &tmp;
+        while (true)
+        {
+            ssize_t n = readFull(in, _block.data(), BLOCK_SIZE);
+            if (n < 0)
+            {
+                op = "read";
+                failed = &segment._path;
+                break;
+            }
+            if (n > 0)
+                Lz4Frame::block(frame, _block.data(), n, _table.data(), _scratch);
+            if (static_cast<size_t>(n) < BLOCK_SIZE)
+                Lz4Frame::end(frame);
+            if (!writeFull(out, frame.data(), frame.size()))
+            {
+                op = "write";
+                break;
+            }
+            frame.clear();
+            if (static_cast<size_t>(n) < BLOCK_SIZE)
+                break;
+        }
+        if (op == nullptr && ::fdatasync(out) != 0)
+            op = "fdatasync";
+        int err = errno;
+        ::close(in);
+        ::close(out);
+
+        if (op == nullptr && ::rename(tmp.c_str(), dst.c_str()) != 0)
+        {
+            op = "rename";
+            err = errno;
+        }
+        if (op != nullptr)
+        {
+            report(op, *failed, err);
+            ::unlink(tmp.c_str());
+            return false;
+        }
+
+        ::unlink(segment._path.c_str());
+        struct stat st;
+        segment._size = ::stat(dst.c_str(), &st) == 0 ? st.st_size : 0;
+        segment._path = dst;
+        segment._compressed = true;
+        return true;
+    }
+
+    bool remove(const Segment& segment)
+    {
+        if (::unlink(segment._path.c_str()) != 0 && errno != ENOENT)
+        {
+            report("unlink", segment._path, errno);
+            return false;
+        }
+        return true;
+    }
+
+    void process(const std::string& active)
+    {
+        std::vector<Segment> segments = listSegments(active);
+
+        // 段数与压缩无关, 先按段数删除, 省得压缩注定要删除的段
+        size_t first = 0;
+        if (_retention._max_files > 0 && segments.size() > _retention._max_files)
+        {
+            for (; segments.size() - first > _retention._max_files; ++first)
+                remove(segments[first]);
+        }
+
+        size_t total = 0;
+        for (size_t i = first; i < segments.size(); ++i)
+        {
+            if (_retention._compress && !segments[i]._compressed)
+                compressFile(segments[i]);
+            total += segments[i]._size;
+        }
+
+        for (; first < segments.size() && _retention._max_bytes > 0 &&
+               total > _retention._max_bytes;
+             ++first)
+        {
+            if (remove(segments[first]))
+                total -= segments[first]._size;
+        }
+    }
+
+    void workerEntry()
+    {
+        while (true)
+        {
+            std::string active;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [&]() { return _stop || _pending; });
+                if (!_pending)
+                    break;
+                _pending = false;
+                active = _active;
+            }
+            process(active);
+        }
+    }
+
+    void report(const char* op, const std::string& filename, int code)
+    {
+        if (_on_error)
+            _on_error(op, filename, code);
+    }
+
+   public:
+    using ErrorHandler = std::function<void(const char*, const std::string&, int)>;
+
+    // on_error在后台线程上调用
+    SegmentArchiver(const std::string& dir, const std::string& prefix,
+                    const Retention& retention, ErrorHandler on_error = ErrorHandler())
+        : _dir(dir),
+          _prefix(prefix),
+          _retention(retention),
+          _on_error(std::move(on_error)),
+          _block(retention._compress ? BLOCK_SIZE : 0),
+          _table(retention._compress ? Lz4::TABLE_SIZE : 0),
+          _pending(false),
+          _stop(false),
+          _thread(&SegmentArchiver::workerEntry, this)
+    {
+    }
+
+    SegmentArchiver(const SegmentArchiver&) = delete;
+    SegmentArchiver& operator=(const SegmentArchiver&) = delete;
+
+    ~SegmentArchiver()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_one();
+        _thread.join();
+    }
+
+    // active为正在写的段, 它之外的段都视为已经完成
+    void submit(const std::string& active)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _active = active;
+            _pending = true;
+        }
+        _cond.notify_one();
+    }
+
+   private:
+    std::string _dir;
+    std::string _prefix;
+    Retention _retention;
+    ErrorHandler _on_error;
+
+    // 压缩使用的缓冲区, 只在后台线程上使用
+    std::vector<char> _block;
+    std::vector<uint32_t> _table;
+    std::string _scratch;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::string _active;
+    bool _pending;
+    bool _stop;
+    std::thread _thread;
+};
+
+/*
+    滚动文件的备用段
+    后台线程提前以path创建好下一个文件(追加方式打开), 并用fallocate预留prealloc字节,
+    预留不改变文件大小, 追加写入直接落在已经分配好的磁盘块上, 文件不会逐块增长
+    滚动时落地线程取走它的描述符即可, 改名为正式文件名与准备下一个备用文件都交给后台线程
+    写完的文件由trim截掉预留而未使用的部分
+*/
+class SpareSegment
+{
+    struct Job
+    {
+        bool _rename;  // 否则为截断
+        std::string _filename;
+    };
+
+    bool prepare()
+    {
+        int fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            report("open", _path, errno);
+            return false;
+        }
+        // 文件系统不支持预分配时只是提前创建文件
+        if (_prealloc > 0 && ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, _prealloc) != 0 &&
+            errno != EOPNOTSUPP)
+            report("fallocate", _path, errno);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _spare_fd = fd;
+        return true;
+    }
+
+    // 截断到当前大小, 释放文件末尾之后预留的磁盘块; 文件可能已经被压缩或者删除
+    void trimFile(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && ::ftruncate(fd, st.st_size) != 0)
+            report("ftruncate", filename, errno);
+        ::close(fd);
+    }
+
+    void workerEntry()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock,
+                           [&]() { return _stop || !_jobs.empty() || (_spare_fd < 0 && !_failed); });
+                if (_jobs.empty() && _stop)
+                    break;
+                if (_jobs.empty())
+                {
+                    // 准备失败后等到下一次取用再重试, 避免空转
+                    lock.unlock();
+                    bool ok = prepare();
+                    lock.lock();
+                    _failed = !ok;
+                    continue;
+                }
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+
+            if (!job._rename)
+                trimFile(job._filename);
+            else if (::rename(_path.c_str(), job._filename.c_str()) != 0)
+                report("rename", job._filename, errno);
+        }
+    }
+
+    void report(const char* op, const std::string& filename, int code)
+    {
+        if (_on_error)
+            _on_error(op, filename, code);
+    }
+
+   public:
+    using ErrorHandler = SegmentArchiver::ErrorHandler;
+
+    // on_error在后台线程上调用
+    SpareSegment(const std::string& path, size_t prealloc, ErrorHandler on_error = ErrorHandler())
+        : _path(path),
+          _prealloc(prealloc),
+          _on_error(std::move(on_error)),
+          _spare_fd(-1),
+          _failed(false),
+          _stop(false),
+          _thread(&SpareSegment::workerEntry, this)
+    {
+    }
+
+    SpareSegment(const SpareSegment&) = delete;
+    SpareSegment& operator=(const SpareSegment&) = delete;
+
+    // 完成已经提交的改名与截断, 删除没有用上的备用文件
+    ~SpareSegment()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_one();
+        _thread.join();
+        if (_spare_fd >= 0)
+        {
+            ::close(_spare_fd);
+            ::unlink(_path.c_str());
+        }
+    }
+
+    // 取走备用文件的描述符, 它随后会被改名为filename; 还没有准备好时返回-1
+    int take(const std::string& filename)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            fd = _spare_fd;
+            _failed = false;
+            if (fd >= 0)
+            {
+                _spare_fd = -1;
+                _jobs.push_back({true, filename});
+            }
+        }
+        _cond.notify_one();
+        return fd;
+    }
+
+    // 写完的文件, 截掉预留而未使用的部分
+    void trim(const std::string& filename)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs.push_back({false, filename});
+        }
+        _cond.notify_one();
+    }
+
+   private:
+    std::string _path;
+    size_t _prealloc;
+    ErrorHandler _on_error;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<Job> _jobs;
+    int _spare_fd;  // 准备好的备用文件, -1表示没有
+    bool _failed;   // 上一次准备失败
+    bool _stop;
+    std::thread _thread;
+};
+}  // namespace windlog
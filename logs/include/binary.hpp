@@ -0,0 +1,467 @@
+/*
+    二进制日志格式与解码器
+    延迟格式化的异步日志器在异步线程上拿到的是LogRecord记录, BinarySink不再把它们渲染成文本,
+    而是把(等级, 日志器, 文件, 行号, 格式化字符串)登记为一个编号, 之后每条日志只写编号,
+    时间戳与原样的参数区, 真正的文本化推迟到离线解码时完成
+
+    文件格式, 多字节整数均为varint:
+        "WLOGBIN1"                                  会话头, 每次打开文件都会写入一个
+        'D' id level line file_len file fmt_len fmt logger_len logger      编号定义
+        'B' len <len字节的数据块>                   一次批量落地
+    数据块内部:
+        'E' id zigzag(秒差) nsec tid args_len args  一条日志, 秒数相对块内上一条,
+                                                    参数区经packArgs重新打包
+        'T' len <len字节的文本>                     已经格式化好的文本, 原样输出
+    定义总是出现在使用它的数据块之前, 数据块之间相互独立, 可以并行解码
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "buffer.hpp"
+#include "format.hpp"
+#include "level.hpp"
+#include "message.hpp"
+#include "record.hpp"
+
+namespace windlog {
+// 数据在一个条目中间就结束了, 通常是写入过程中进程崩溃留下的
+class TruncatedLogError : public std::runtime_error
+{
+   public:
+    TruncatedLogError() : std::runtime_error("BinaryReader: truncated binary log") {}
+};
+
+/*
+    顺序读取二进制日志, 所有读取都做边界检查, 数据损坏时抛出异常
+*/
+class BinaryReader
+{
+   public:
+    BinaryReader(const char* data, size_t len) : _cur(data), _end(data + len) {}
+
+    bool eof() const { return _cur == _end; }
+    const char* pos() const { return _cur; }
+
+    char byte()
+    {
+        need(1);
+        return *_cur++;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = static_cast<uint8_t>(byte());
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return value;
+        }
+        throw std::runtime_error("BinaryReader: malformed varint");
+    }
+
+    std::string_view bytes(size_t len)
+    {
+        need(len);
+        std::string_view str(_cur, len);
+        _cur += len;
+        return str;
+    }
+
+    std::string_view string() { return bytes(varint()); }
+
+   private:
+    void need(size_t len)
+    {
+        if (static_cast<size_t>(_end - _cur) < len)
+            throw TruncatedLogError();
+    }
+
+    const char* _cur;
+    const char* _end;
+};
+
+class BinaryLog
+{
+   public:
+    static constexpr std::string_view MAGIC = "WLOGBIN1";
+
+    enum Entry : char
+    {
+        DEFINE = 'D',
+        BLOCK = 'B',
+        EVENT = 'E',
+        TEXT = 'T'
+    };
+
+    static void putVarint(std::string& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void putString(std::string& out, std::string_view str)
+    {
+        putVarint(out, str.size());
+        out.append(str.data(), str.size());
+    }
+
+    // 有符号数映射为无符号数, 使绝对值小的负数也能编码得很短
+    static uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+    static int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    /*
+        LogRecord的参数区为了让业务线程写得快, 每个参数都占满8字节, 字符串还带着'\0'
+        落盘前重新打包: 整数改为varint(有符号数先做zigzag), 字符串只保留长度与内容,
+        浮点数保持原样; 类型标签保留, 解包时不必再解析格式化字符串
+    */
+    static void packArgs(std::string& out, const char* args, size_t len)
+    {
+        using Type = LogRecord::ArgType;
+        const char* end = args + len;
+        while (args < end)
+        {
+            Type type = static_cast<Type>(*args++);
+            out.push_back(static_cast<char>(type));
+            switch (type)
+            {
+                case Type::INT:
+                    putVarint(out, zigzag(LogRecord::get<int64_t>(args)));
+                    break;
+                case Type::UINT:
+                case Type::POINTER:
+                    putVarint(out, LogRecord::get<uint64_t>(args));
+                    break;
+                case Type::DOUBLE:
+                    out.append(args, sizeof(double));
+                    args += sizeof(double);
+                    break;
+                case Type::LDOUBLE:
+                    out.append(args, sizeof(long double));
+                    args += sizeof(long double);
+                    break;
+                case Type::STRING:
+                {
+                    uint32_t n = LogRecord::get<uint32_t>(args);
+                    putString(out, std::string_view(args, n));
+                    args += n + 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    // packArgs的逆过程, 还原出LogRecord::render可以直接使用的参数区
+    static void unpackArgs(std::string& out, std::string_view packed)
+    {
+        using Type = LogRecord::ArgType;
+        BinaryReader reader(packed.data(), packed.size());
+        while (!reader.eof())
+        {
+            Type type = static_cast<Type>(reader.byte());
+            switch (type)
+            {
+                case Type::INT:
+                    LogRecord::put<int64_t>(out, type, unzigzag(reader.varint()));
+                    break;
+                case Type::UINT:
+                case Type::POINTER:
+                    LogRecord::put<uint64_t>(out, type, reader.varint());
+                    break;
+                case Type::DOUBLE:
+                case Type::LDOUBLE:
+                {
+                    size_t n = type == Type::DOUBLE ? sizeof(double) : sizeof(long double);
+                    out.push_back(static_cast<char>(type));
+                    out.append(reader.bytes(n).data(), n);
+                    break;
+                }
+                case Type::STRING:
+                {
+                    std::string_view str = reader.string();
+                    LogRecord::put<uint32_t>(out, type, str.size());
+                    out.append(str.data(), str.size());
+                    out.push_back('\0');
+                    break;
+                }
+                default:
+                    throw std::runtime_error("BinaryLog: unknown argument type");
+            }
+        }
+    }
+};
+
+/*
+    离线解码器
+    第一遍顺序扫描, 收集编号定义并为数据块建立索引(只跳过块内容, 开销很小)
+    第二遍多个线程各自认领数据块, 按给定模式串格式化, 最后按原顺序输出
+*/
+class BinaryDecoder
+{
+    struct Define
+    {
+        LogLevel::value _level;
+        uint32_t _line;
+        std::string _file;
+        std::string _fmt;  // std::string保证以'\0'结尾, 参数渲染时需要
+        std::string _logger;
+    };
+
+    struct Block
+    {
+        const char* _data;
+        size_t _len;
+        size_t _session;  // 所属会话, 不同会话的编号互不相干
+    };
+
+    // 每批并行解码的数据块个数, 限制解码结果占用的内存
+    static constexpr size_t BATCH_BLOCKS = 256;
+
+    // 建立索引, 返回末尾不完整的条目占用的字节数, 这部分不参与解码
+    size_t index(const char* data, size_t len)
+    {
+        BinaryReader reader(data, len);
+        while (!reader.eof())
+        {
+            const char* entry = reader.pos();
+            try
+            {
+                indexEntry(reader);
+            }
+            catch (const TruncatedLogError&)
+            {
+                return data + len - entry;
+            }
+        }
+        return 0;
+    }
+
+    void indexEntry(BinaryReader& reader)
+    {
+        char type = reader.byte();
+        if (type == BinaryLog::MAGIC[0])
+        {
+            if (reader.bytes(BinaryLog::MAGIC.size() - 1) != BinaryLog::MAGIC.substr(1))
+                throw std::runtime_error("BinaryDecoder: bad magic");
+            _defines.emplace_back();
+        }
+        else if (_defines.empty())
+        {
+            throw std::runtime_error("BinaryDecoder: not a binary log");
+        }
+        else if (type == BinaryLog::DEFINE)
+        {
+            uint64_t id = reader.varint();
+            Define def;
+            def._level = static_cast<LogLevel::value>(reader.varint());
+            def._line = reader.varint();
+            def._file = reader.string();
+            def._fmt = reader.string();
+            def._logger = reader.string();
+
+            auto& defines = _defines.back();
+            if (id >= defines.size())
+                defines.resize(id + 1);
+            defines[id] = std::move(def);
+        }
+        else if (type == BinaryLog::BLOCK)
+        {
+            size_t n = reader.varint();
+            const char* block = reader.bytes(n).data();
+            _blocks.push_back({block, n, _defines.size() - 1});
+        }
+        else
+        {
+            throw std::runtime_error("BinaryDecoder: unknown entry");
+        }
+    }
+
+    void decodeBlock(const Block& block, std::string& out)
+    {
+        const auto& defines = _defines[block._session];
+        BinaryReader reader(block._data, block._len);
+        Buffer text(4096);
+        std::string unpacked;
+        std::string payload;
+        int64_t sec = 0;
+
+        while (!reader.eof())
+        {
+            char type = reader.byte();
+            if (type == BinaryLog::TEXT)
+            {
+                std::string_view str = reader.string();
+                out.append(str.data(), str.size());
+                continue;
+            }
+            if (type != BinaryLog::EVENT)
+                throw std::runtime_error("BinaryDecoder: unknown block entry");
+
+            uint64_t id = reader.varint();
+            sec += BinaryLog::unzigzag(reader.varint());
+            uint32_t nsec = reader.varint();
+            std::thread::id tid = LogMsg::intToThread(reader.varint());
+            std::string_view args = reader.string();
+            if (id >= defines.size())
+                throw std::runtime_error("BinaryDecoder: undefined format id");
+            const Define& def = defines[id];
+
+            unpacked.clear();
+            BinaryLog::unpackArgs(unpacked, args);
+
+            LogRecord::View view{};
+            view._file = def._file.c_str();
+            view._fmt = def._fmt.c_str();
+            view._args = unpacked.data();
+            view._args_len = unpacked.size();
+            payload.clear();
+            LogRecord::render(payload, view);
+
+            LogMsg msg(sec, nsec, def._level, def._file, def._line, tid, def._logger, payload);
+            text.reset();
+            _formatter.format(text, msg);
+            out.append(text.readAbleBegin(), text.readAbleSize());
+        }
+    }
+
+   public:
+    explicit BinaryDecoder(
+        const std::string& pattern = "[%p]%T[%d{%H:%M:%S}][%c][%t]%T[%f:%l]%T%m%n")
+        : _formatter(pattern)
+    {
+    }
+
+    /*
+        解码内存中的一份二进制日志, threads个线程并行, 结果按原顺序写入out
+        末尾不完整的条目(写入时进程崩溃)被忽略, 之前完整的数据照常解码; 返回忽略的字节数
+    */
+    size_t decode(const char* data, size_t len, std::ostream& out, size_t threads = 1)
+    {
+        _defines.clear();
+        _blocks.clear();
+        size_t truncated = index(data, len);
+
+        threads = std::max<size_t>(1, threads);
+        std::vector<std::string> results;
+        for (size_t first = 0; first < _blocks.size(); first += BATCH_BLOCKS)
+        {
+            size_t count = std::min(BATCH_BLOCKS, _blocks.size() - first);
+            results.assign(count, std::string());
+
+            std::atomic<size_t> next(0);
+            auto worker = [&]() {
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    decodeBlock(_blocks[first + i], results[i]);
+                }
+            };
+
+            // 数据量小时不必启动线程
+            size_t nthreads = std::min(threads, count);
+            if (nthreads <= 1)
+            {
+                worker();
+            }
+            else
+            {
+                std::vector<std::thread> workers;
+                std::exception_ptr error;
+                std::mutex error_mutex;
+                for (size_t i = 0; i < nthreads; ++i)
+                {
+                    workers.emplace_back([&]() {
+                        try
+                        {
+                            worker();
+                        }
+                        catch (...)
+                        {
+                            std::unique_lock<std::mutex> lock(error_mutex);
+                            error = std::current_exception();
+                            next = count;
+                        }
+                    });
+                }
+                for (auto& thread : workers) thread.join();
+                if (error)
+                    std::rethrow_exception(error);
+            }
+
+            for (const auto& result : results) out.write(result.data(), result.size());
+        }
+        return truncated;
+    }
+
+    // 解码二进制日志文件, 以只读映射的方式访问, 不整体读入内存; 返回值同decode
+    size_t decodeFile(const std::string& pathname, std::ostream& out, size_t threads = 1)
+    {
+        int fd = open(pathname.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("BinaryDecoder: failed to open " + pathname);
+
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+        {
+            close(fd);
+            throw std::runtime_error("BinaryDecoder: failed to stat " + pathname);
+        }
+        if (st.st_size == 0)
+        {
+            close(fd);
+            return 0;
+        }
+
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("BinaryDecoder: failed to map " + pathname);
+
+        size_t truncated;
+        try
+        {
+            truncated = decode(static_cast<const char*>(addr), st.st_size, out, threads);
+        }
+        catch (...)
+        {
+            munmap(addr, st.st_size);
+            throw;
+        }
+        munmap(addr, st.st_size);
+        return truncated;
+    }
+
+   private:
+    Formatter _formatter;
+    std::vector<std::vector<Define>> _defines;  // 按会话划分的编号定义
+    std::vector<Block> _blocks;
+};
+}  // namespace windlog
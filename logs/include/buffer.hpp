@@ -13,10 +13,17 @@
 #define THRESHOULD_BUFFER_SIZE (8 * BUFFER_SIZE)
 #define INCREMENT_BUFFER_SIZE (BUFFER_SIZE)
 
+#include <sys/uio.h>
+
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+#include "page_alloc.hpp"
+
 namespace windlog {
 
 // 用户可通过定义 CONFIG_BUFFER_SIZE 来覆盖默认缓冲区大小
@@ -24,6 +31,13 @@ class Buffer
 {
    public:
     Buffer() : _base(BUFFER_SIZE), _reader_idx(0), _writer_idx(0) {}
+    // 指定初始大小, 用于线程本地暂存区这类小缓冲区
+    explicit Buffer(size_t size) : _base(size), _reader_idx(0), _writer_idx(0) {}
+    // 按指定的内存策略分配, 例如大页或者绑定NUMA节点; 扩容与交换时策略随内存一起走
+    Buffer(size_t size, const MemoryPolicy& memory)
+        : _base(size, PageAllocator<char>(memory)), _reader_idx(0), _writer_idx(0)
+    {
+    }
     ~Buffer() = default;
 
     // 从指定位置开始, 写入指定长度数据
@@ -64,6 +78,12 @@ class Buffer
         return _base.size() - _writer_idx;
     }
 
+    // 缓冲区的总容量
+    size_t capacity() const { return _base.size(); }
+
+    // 当前底层内存的分配策略
+    MemoryPolicy memory() const { return _base.get_allocator().policy(); }
+
     // 预留至少指定长度的可写位置
     void reserve(size_t len)
     {
@@ -122,8 +142,264 @@ class Buffer
     bool empty() { return _reader_idx == _writer_idx; }
 
    private:
-    std::vector<char> _base;  // 基础底层容器
+    std::vector<char, PageAllocator<char>> _base;  // 基础底层容器
     size_t _reader_idx;       // 指向下一个可读位置的指针
     size_t _writer_idx;       // 指向下一个可写位置的指针
 };
+
+/*
+    固定大小片段的回收池, 可以由多个BufferChain共用, 异步日志器默认共用进程内的global()
+    1. budget: 池持有的内存(使用中与缓存的片段)上限, 为0表示不限制; 超出时acquire拒绝分配
+    2. baseline: 常驻的内存, 用完的片段先缓存起来复用
+    3. 回收带有滞后: 使用量回落到baseline以内并持续shrink_delay之后,
+       才把缓存的片段释放到baseline以内, 避免突发流量来回时反复分配与释放;
+       归还片段时顺便检查, 之后不再有片段归还时, 由使用者(异步线程)空闲时调用trim
+    比片段大的数据单独分配, 同样计入预算, 用完即释放
+    片段按memory分配; 池不属于某个线程, CONSUMER_NODE等同于不指定节点,
+    使用大页时片段大小宜取2MB的整数倍, 否则每个片段都要占满整页
+*/
+class SegmentPool
+{
+    using Clock = std::chrono::steady_clock;
+
+    /*
+        已经平静了足够长的时间, 把超出baseline的缓存片段移到trimmed中, 调用者需持有_mutex
+        片段由调用者在释放锁之后析构, 归还大块内存(munmap)时不会拖住其它取还片段的线程
+        返回是否仍有超出baseline的缓存, 即之后还需要再次检查
+    */
+    bool takeTrimmed(Clock::time_point now, std::vector<std::unique_ptr<Buffer>>& trimmed)
+    {
+        if (_quiet_since != Clock::time_point() && now - _quiet_since >= _shrink_delay)
+        {
+            while (!_free.empty() && _in_use + _cached_bytes > _baseline)
+            {
+                trimmed.push_back(std::move(_free.back()));
+                _free.pop_back();
+                _cached_bytes -= _segment_size;
+            }
+        }
+        return !_free.empty() && _in_use + _cached_bytes > _baseline;
+    }
+
+   public:
+    using ptr = std::shared_ptr<SegmentPool>;
+
+    explicit SegmentPool(size_t segment_size = 1024 * 1024, size_t baseline = 16 * 1024 * 1024,
+                         size_t budget = 0,
+                         std::chrono::milliseconds shrink_delay = std::chrono::seconds(1),
+                         const MemoryPolicy& memory = MemoryPolicy())
+        : _segment_size(std::max<size_t>(segment_size, 1)),
+          _baseline(baseline),
+          _budget(budget),
+          _shrink_delay(shrink_delay),
+          _memory(memory._node == MemoryPolicy::CONSUMER_NODE ? MemoryPolicy(memory._pages)
+                                                               : memory),
+          _in_use(0),
+          _cached_bytes(0),
+          _peak(0),
+          _refused(0)
+    {
+    }
+
+    // 进程内共用的片段池, 默认不限制预算
+    static const ptr& global()
+    {
+        static ptr pool = std::make_shared<SegmentPool>();
+        return pool;
+    }
+
+    /*
+        取一个至少能放下len字节的空片段
+        force为false时, 需要新分配且会超出预算则返回空指针
+    */
+    std::unique_ptr<Buffer> acquire(size_t len, bool force = true)
+    {
+        size_t size = std::max(len, _segment_size);
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::unique_ptr<Buffer> segment;
+        if (size == _segment_size && !_free.empty())
+        {
+            segment = std::move(_free.back());
+            _free.pop_back();
+            _cached_bytes -= size;
+        }
+        else if (!force && _budget > 0 && _in_use + _cached_bytes + size > _budget)
+        {
+            ++_refused;
+            return nullptr;
+        }
+
+        _in_use += size;
+        _peak = std::max(_peak, _in_use + _cached_bytes);
+        if (_in_use > _baseline)
+            _quiet_since = Clock::time_point();
+        lock.unlock();
+
+        if (!segment)
+            segment = std::make_unique<Buffer>(size, _memory);
+        return segment;
+    }
+
+    void release(std::unique_ptr<Buffer> segment)
+    {
+        size_t size = segment->capacity();
+        segment->reset();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _in_use -= size;
+        auto now = Clock::now();
+        if (_in_use <= _baseline && _quiet_since == Clock::time_point())
+            _quiet_since = now;
+
+        if (size == _segment_size)
+        {
+            _free.push_back(std::move(segment));
+            _cached_bytes += size;
+        }
+
+        // 释放的片段在解锁之后随trimmed析构
+        std::vector<std::unique_ptr<Buffer>> trimmed;
+        takeTrimmed(now, trimmed);
+        lock.unlock();
+    }
+
+    // 检查是否可以收缩, 返回true表示仍有超出baseline的缓存, 之后需要再次调用
+    bool trim()
+    {
+        std::vector<std::unique_ptr<Buffer>> trimmed;
+        std::unique_lock<std::mutex> lock(_mutex);
+        bool pending = takeTrimmed(Clock::now(), trimmed);
+        lock.unlock();
+        return pending;
+    }
+
+    void setBudget(size_t budget)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _budget = budget;
+    }
+
+    size_t segmentSize() const { return _segment_size; }
+    const MemoryPolicy& memory() const { return _memory; }
+
+    size_t budget()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _budget;
+    }
+
+    // 池当前持有的内存, 包括使用中与缓存的片段
+    size_t usage()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _in_use + _cached_bytes;
+    }
+
+    // 使用中的片段占用的内存
+    size_t inUse()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _in_use;
+    }
+
+    // 持有内存的历史峰值
+    size_t peak()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _peak;
+    }
+
+    // 因超出预算而被拒绝的分配次数
+    size_t refused()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _refused;
+    }
+
+    // 池中空闲的片段数
+    size_t cached()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _free.size();
+    }
+
+   private:
+    const size_t _segment_size;
+    const size_t _baseline;
+    size_t _budget;
+    const std::chrono::milliseconds _shrink_delay;
+    const MemoryPolicy _memory;  // 片段的分配策略
+
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Buffer>> _free;
+    size_t _in_use;
+    size_t _cached_bytes;
+    size_t _peak;
+    size_t _refused;
+    Clock::time_point _quiet_since;  // 使用量回落到baseline以内的时刻, 未回落时为默认值
+};
+
+/*
+    由固定大小片段串成的缓冲区
+    当前片段放不下时从池中取下一个片段, 已有的数据从不搬移, 也没有扩容时的补零
+    单次写入的数据不会跨越片段, 比片段还大的数据独占一个刚好放得下的片段,
+    因此每个片段都由完整的消息(或记录)组成, 可以单独解析, 也可以作为iovec一次写出
+*/
+class BufferChain
+{
+   public:
+    explicit BufferChain(SegmentPool::ptr pool) : _pool(std::move(pool)), _size(0) {}
+    ~BufferChain() { reset(); }
+
+    BufferChain(const BufferChain&) = delete;
+    BufferChain& operator=(const BufferChain&) = delete;
+
+    // force为false时, 需要新片段而池超出预算则不写入, 返回false
+    bool push(const char* data, size_t len, bool force = true)
+    {
+        if (_segments.empty() || _segments.back()->writeAbleSize() < len)
+        {
+            std::unique_ptr<Buffer> segment = _pool->acquire(len, force);
+            if (!segment)
+                return false;
+            _segments.push_back(std::move(segment));
+        }
+        _segments.back()->push(data, len);
+        _size += len;
+        return true;
+    }
+
+    size_t readAbleSize() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    size_t segmentCount() const { return _segments.size(); }
+    Buffer& segment(size_t idx) { return *_segments[idx]; }
+
+    // 把各片段的可读数据依次追加到iov中
+    void appendIov(std::vector<struct iovec>& iov)
+    {
+        for (auto& segment : _segments)
+            iov.push_back({const_cast<char*>(segment->readAbleBegin()), segment->readAbleSize()});
+    }
+
+    // 片段全部还给池
+    void reset()
+    {
+        for (auto& segment : _segments) _pool->release(std::move(segment));
+        _segments.clear();
+        _size = 0;
+    }
+
+    void swap(BufferChain& chain)
+    {
+        _pool.swap(chain._pool);
+        _segments.swap(chain._segments);
+        std::swap(_size, chain._size);
+    }
+
+   private:
+    SegmentPool::ptr _pool;
+    std::vector<std::unique_ptr<Buffer>> _segments;
+    size_t _size;
+};
 }  // namespace windlog
\ No newline at end of file
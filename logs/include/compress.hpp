@@ -0,0 +1,414 @@
+/*
+    内置的LZ4压缩实现, 供压缩文件落地方向使用, 不依赖第三方库
+    1. Lz4: 块压缩与解压, 以及帧格式需要的xxHash32校验
+    2. Lz4Frame: 标准LZ4帧格式的读写, 每个块独立压缩(不引用之前块的数据),
+       因此任意块都可以单独解压, 写出的文件也可以直接用 lz4 -d 解压
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace windlog {
+class Lz4
+{
+    static constexpr int HASH_LOG = 14;
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t LAST_LITERALS = 5;  // 块末尾至少保留的字面量字节数
+    static constexpr size_t MF_LIMIT = 12;      // 最后一个匹配的起点距块末尾的最小距离
+    static constexpr size_t MAX_OFFSET = 65535;
+
+    static uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hash(uint32_t seq) { return (seq * 2654435761u) >> (32 - HASH_LOG); }
+
+    static uint32_t rotl(uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+    // 长度字段超过15时, 剩余部分以255为单位追加
+    static void putLength(uint8_t*& op, size_t len)
+    {
+        while (len >= 255)
+        {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = static_cast<uint8_t>(len);
+    }
+
+    static uint8_t* putSequence(uint8_t* op, const uint8_t* lit, size_t lit_len, size_t offset,
+                                size_t match_len)
+    {
+        uint8_t* token = op++;
+        *token = static_cast<uint8_t>((lit_len >= 15 ? 15 : lit_len) << 4);
+        if (lit_len >= 15)
+            putLength(op, lit_len - 15);
+        memcpy(op, lit, lit_len);
+        op += lit_len;
+
+        // 最后一个序列只有字面量
+        if (match_len == 0)
+            return op;
+
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        match_len -= MIN_MATCH;
+        *token |= static_cast<uint8_t>(match_len >= 15 ? 15 : match_len);
+        if (match_len >= 15)
+            putLength(op, match_len - 15);
+        return op;
+    }
+
+   public:
+    // 哈希表的元素个数, 由调用者提供以便复用
+    static constexpr size_t TABLE_SIZE = 1 << HASH_LOG;
+
+    // 压缩结果的最大长度
+    static size_t compressBound(size_t len) { return len + len / 255 + 16; }
+
+    /*
+        压缩一个块, dst至少要有compressBound(len)字节, 返回压缩后的长度
+        贪心匹配: 每个位置只查一次哈希表, 连续找不到匹配时逐渐加大步长跳过不可压缩的数据
+    */
+    static size_t compress(const char* src, size_t len, char* dst, uint32_t* table)
+    {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(src);
+        const uint8_t* end = base + len;
+        const uint8_t* anchor = base;
+        uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+
+        if (len > MF_LIMIT)
+        {
+            memset(table, 0, TABLE_SIZE * sizeof(uint32_t));
+            const uint8_t* limit = end - MF_LIMIT;
+            const uint8_t* match_limit = end - LAST_LITERALS;
+            const uint8_t* ip = base;
+            size_t misses = 0;
+
+            while (ip < limit)
+            {
+                uint32_t seq = read32(ip);
+                uint32_t h = hash(seq);
+                const uint8_t* ref = base + table[h];
+                table[h] = static_cast<uint32_t>(ip - base);
+
+                if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || read32(ref) != seq)
+                {
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+
+                // 向前扩展匹配
+                while (ip > anchor && ref > base && ip[-1] == ref[-1]) --ip, --ref;
+                const uint8_t* mp = ip + MIN_MATCH;
+                const uint8_t* rp = ref + MIN_MATCH;
+                while (mp < match_limit && *mp == *rp) ++mp, ++rp;
+
+                op = putSequence(op, anchor, ip - anchor, ip - ref, mp - ip);
+                ip = anchor = mp;
+                if (ip < limit)
+                    table[hash(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+            }
+        }
+
+        op = putSequence(op, anchor, end - anchor, 0, 0);
+        return op - reinterpret_cast<uint8_t*>(dst);
+    }
+
+    // 解压一个块, 所有读写都做边界检查, 数据损坏时抛出异常, 返回解压后的长度
+    static size_t decompress(const char* src, size_t len, char* dst, size_t cap)
+    {
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+        const uint8_t* iend = ip + len;
+        uint8_t* const begin = reinterpret_cast<uint8_t*>(dst);
+        uint8_t* op = begin;
+        uint8_t* const oend = op + cap;
+
+        auto getLength = [&](size_t value) {
+            if (value != 15)
+                return value;
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                    throw std::runtime_error("Lz4: truncated length");
+                b = *ip++;
+                value += b;
+            } while (b == 255);
+            return value;
+        };
+
+        while (ip < iend)
+        {
+            uint8_t token = *ip++;
+            size_t lit_len = getLength(token >> 4);
+            if (lit_len > static_cast<size_t>(iend - ip) ||
+                lit_len > static_cast<size_t>(oend - op))
+                throw std::runtime_error("Lz4: literal overflow");
+            memcpy(op, ip, lit_len);
+            ip += lit_len;
+            op += lit_len;
+            if (ip == iend)
+                break;
+
+            if (iend - ip < 2)
+                throw std::runtime_error("Lz4: truncated offset");
+            size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > static_cast<size_t>(op - begin))
+                throw std::runtime_error("Lz4: bad offset");
+
+            size_t match_len = getLength(token & 15) + MIN_MATCH;
+            if (match_len > static_cast<size_t>(oend - op))
+                throw std::runtime_error("Lz4: match overflow");
+            const uint8_t* ref = op - offset;
+            if (offset >= match_len)
+            {
+                memcpy(op, ref, match_len);
+                op += match_len;
+            }
+            else
+            {
+                // 重叠的匹配只能逐字节复制
+                for (size_t i = 0; i < match_len; ++i) *op++ = *ref++;
+            }
+        }
+        return op - begin;
+    }
+
+    static uint32_t xxh32(const void* input, size_t len, uint32_t seed = 0)
+    {
+        static constexpr uint32_t P1 = 2654435761u, P2 = 2246822519u, P3 = 3266489917u,
+                                  P4 = 668265263u, P5 = 374761393u;
+        const uint8_t* p = static_cast<const uint8_t*>(input);
+        const uint8_t* end = p + len;
+        uint32_t h;
+
+        if (len >= 16)
+        {
+            uint32_t v[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+            for (; end - p >= 16; p += 16)
+            {
+                for (int i = 0; i < 4; ++i) v[i] = rotl(v[i] + read32(p + i * 4) * P2, 13) * P1;
+            }
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        }
+        else
+        {
+            h = seed + P5;
+        }
+
+        h += static_cast<uint32_t>(len);
+        for (; end - p >= 4; p += 4) h = rotl(h + read32(p) * P3, 17) * P4;
+        for (; p < end; ++p) h = rotl(h + *p * P5, 11) * P1;
+
+        h ^= h >> 15;
+        h *= P2;
+        h ^= h >> 13;
+        h *= P3;
+        h ^= h >> 16;
+        return h;
+    }
+};
+
+/*
+    LZ4帧格式
+        magic(4) FLG(1) BD(1) HC(1)         帧头, FLG表示块之间相互独立且带块校验
+        size(4) data checksum(4)            数据块, size最高位为1表示未压缩
+        ...
+        0(4)                                结束标记
+    一个文件可以由多个帧首尾相接组成
+*/
+class Lz4Frame
+{
+    static void put32(std::string& out, uint32_t value)
+    {
+        char bytes[4];
+        for (int i = 0; i < 4; ++i) bytes[i] = static_cast<char>(value >> (i * 8));
+        out.append(bytes, 4);
+    }
+
+   public:
+    static constexpr uint32_t MAGIC = 0x184D2204;
+    static constexpr uint8_t FLG = 0x70;  // 版本01, 块独立, 带块校验
+    static constexpr size_t HEADER_SIZE = 7;  // 本实现写出的帧头长度, 也是帧头的最小长度
+    static constexpr uint32_t UNCOMPRESSED = 0x80000000u;
+
+    // FLG中的各个标志位
+    static constexpr uint8_t FLG_INDEPENDENT = 0x20;
+    static constexpr uint8_t FLG_BLOCK_CHECKSUM = 0x10;
+    static constexpr uint8_t FLG_CONTENT_SIZE = 0x08;
+    static constexpr uint8_t FLG_CONTENT_CHECKSUM = 0x04;
+    static constexpr uint8_t FLG_DICT_ID = 0x01;
+
+    // 从帧头中解析出的参数, 其它工具(如lz4命令行)写出的帧未必与本实现相同
+    struct Descriptor
+    {
+        uint8_t _flg;
+        size_t _header_size;
+        size_t _block_max;
+    };
+
+    // 帧头的完整长度, 由FLG决定是否带有内容长度与字典编号
+    static size_t headerSize(uint8_t flg)
+    {
+        return HEADER_SIZE + (flg & FLG_CONTENT_SIZE ? 8 : 0) + (flg & FLG_DICT_ID ? 4 : 0);
+    }
+
+    // 解析帧头, p处至少要有headerSize字节; 不是合法的帧头时抛出异常
+    static Descriptor descriptor(const char* p)
+    {
+        uint8_t flg = static_cast<uint8_t>(p[4]);
+        if (get32(p) != MAGIC || (flg >> 6) != 1)
+            throw std::runtime_error("Lz4Frame: unsupported frame");
+        size_t n = headerSize(flg);
+        if (static_cast<uint8_t>(p[n - 1]) != ((Lz4::xxh32(p + 4, n - 5) >> 8) & 0xff))
+            throw std::runtime_error("Lz4Frame: bad header checksum");
+        int bd = (static_cast<uint8_t>(p[5]) >> 4) & 0x7;
+        if (bd < 4)
+            throw std::runtime_error("Lz4Frame: bad block size");
+        return {flg, n, size_t(64 * 1024) << (2 * (bd - 4))};
+    }
+
+    // 块数据之后跟着的校验值长度
+    static size_t blockTrailer(const Descriptor& desc)
+    {
+        return desc._flg & FLG_BLOCK_CHECKSUM ? 4 : 0;
+    }
+
+    // 结束标记之后跟着的校验值长度
+    static size_t frameTrailer(const Descriptor& desc)
+    {
+        return desc._flg & FLG_CONTENT_CHECKSUM ? 4 : 0;
+    }
+
+    static uint32_t get32(const char* p)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+        return value;
+    }
+
+    // 帧头只能表示64KB, 256KB, 1MB, 4MB四种块大小, 取能容纳block_size的最小一档
+    static size_t blockMaxSize(size_t block_size)
+    {
+        size_t size = 64 * 1024;
+        while (size < block_size && size < 4 * 1024 * 1024) size <<= 2;
+        return size;
+    }
+
+    static void header(std::string& out, size_t block_size)
+    {
+        uint8_t bd = 4;
+        for (size_t size = 64 * 1024; size < blockMaxSize(block_size); size <<= 2) ++bd;
+
+        char desc[2] = {static_cast<char>(FLG), static_cast<char>(bd << 4)};
+        put32(out, MAGIC);
+        out.append(desc, 2);
+        out.push_back(static_cast<char>((Lz4::xxh32(desc, 2) >> 8) & 0xff));
+    }
+
+    /*
+        压缩一个块并追加到out, block_size不能超过帧头声明的大小
+        table与scratch由调用者提供, 以便在多个块之间复用
+        压缩后没有变小的数据原样存储
+    */
+    static void block(std::string& out, const char* data, size_t len, uint32_t* table,
+                      std::string& scratch)
+    {
+        scratch.resize(Lz4::compressBound(len));
+        size_t n = Lz4::compress(data, len, &scratch[0], table);
+
+        const char* stored = scratch.data();
+        uint32_t size = n;
+        if (n >= len)
+        {
+            stored = data;
+            n = len;
+            size = len | UNCOMPRESSED;
+        }
+        put32(out, size);
+        out.append(stored, n);
+        put32(out, Lz4::xxh32(stored, n));
+    }
+
+    static void end(std::string& out) { put32(out, 0); }
+
+    // 帧头声明了内容校验时, 结束标记之后还要跟上整帧内容的校验值, frame为不含结束标记的整帧
+    static void contentChecksum(std::string& out, const char* frame, size_t len)
+    {
+        std::string content;
+        decode(frame, len, content);
+        put32(out, Lz4::xxh32(content.data(), content.size()));
+    }
+
+    // 解压由若干帧组成的数据, 追加到out; 最后一帧可以没有结束标记
+    static void decode(const char* data, size_t len, std::string& out)
+    {
+        const char* p = data;
+        const char* end = data + len;
+        auto need = [&](size_t n) {
+            if (static_cast<size_t>(end - p) < n)
+                throw std::runtime_error("Lz4Frame: truncated frame");
+        };
+
+        while (p < end)
+        {
+            need(HEADER_SIZE);
+            need(headerSize(static_cast<uint8_t>(p[4])));
+            Descriptor desc = descriptor(p);
+            // 块之间相互引用或依赖外部字典的帧无法逐块解压
+            if (!(desc._flg & FLG_INDEPENDENT) || (desc._flg & FLG_DICT_ID))
+                throw std::runtime_error("Lz4Frame: unsupported frame");
+            size_t max_size = desc._block_max;
+            size_t start = out.size();
+            p += desc._header_size;
+
+            while (p < end)
+            {
+                need(4);
+                uint32_t size = get32(p);
+                p += 4;
+                if (size == 0)
+                {
+                    if (frameTrailer(desc) == 0)
+                        break;
+                    need(4);
+                    if (Lz4::xxh32(out.data() + start, out.size() - start) != get32(p))
+                        throw std::runtime_error("Lz4Frame: bad content checksum");
+                    p += 4;
+                    break;
+                }
+
+                size_t n = size & ~UNCOMPRESSED;
+                if (n > max_size)
+                    throw std::runtime_error("Lz4Frame: block too large");
+                need(n + blockTrailer(desc));
+                if (blockTrailer(desc) > 0 && Lz4::xxh32(p, n) != get32(p + n))
+                    throw std::runtime_error("Lz4Frame: bad block checksum");
+
+                if (size & UNCOMPRESSED)
+                {
+                    out.append(p, n);
+                }
+                else
+                {
+                    size_t old = out.size();
+                    out.resize(old + max_size);
+                    out.resize(old + Lz4::decompress(p, n, &out[old], max_size));
+                }
+                p += n + blockTrailer(desc);
+            }
+        }
+    }
+};
+}  // namespace windlog
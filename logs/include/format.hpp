@@ -1,19 +1,29 @@
 /*
     格式化类簇, 核心功能, 依据用户的格式化字符串构造出一条日志字符串
-    利用工厂模式让各个子项与对应的占位符建立映射关系
-    格式化子数组确定构造顺序
+    各个格式化子项与对应的占位符一一映射, 可单独使用
+    Formatter将模式串解析为扁平的指令数组, 或者在编译期直接展开编译期模式串
+    所有子项都直接向Buffer追加字节, 不经过iostream, 缓冲区复用后不再有堆分配
 */
 
 #pragma once
 
+#include <pthread.h>
+
+#include <array>
+#include <charconv>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "buffer.hpp"
 #include "level.hpp"
 #include "message.hpp"
+#include "typed_format.hpp"
 
 namespace windlog {
 
@@ -32,7 +42,7 @@ class FormatItem
    public:
     using ptr = std::shared_ptr<FormatItem>;
     virtual ~FormatItem() = 0;
-    virtual void format(std::ostream& out, const LogMsg& msg) = 0;
+    virtual void format(Buffer& out, const LogMsg& msg) = 0;
 };
 inline FormatItem::~FormatItem() = default;
 
@@ -40,16 +50,20 @@ class MsgFormatItem : public FormatItem
 {
    public:
     ~MsgFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << msg._payload; }
+    void format(Buffer& out, const LogMsg& msg) override
+    {
+        out.push(msg._payload.data(), msg._payload.size());
+    }
 };
 
 class LevelFormatItem : public FormatItem
 {
    public:
     ~LevelFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override
+    void format(Buffer& out, const LogMsg& msg) override
     {
-        out << LogLevel::toString(msg._level);
+        const char* level = LogLevel::toString(msg._level);
+        out.push(level, strlen(level));
     }
 };
 
@@ -65,6 +79,9 @@ class LevelFormatItem : public FormatItem
     可以依据时间结构和格式化字符串输出一个对应的日期字符串
     它支持各种占位符, 其中就包括我们默认的%H, %M, %S
     具体可以查找手册进行了解
+
+    strftime本身不支持秒以下的部分, 这里额外支持与date命令一致的
+    %3N(毫秒), %6N(微秒), %9N或%N(纳秒), 以及任意1~9位的%kN
 */
 class DateFormatItem : public FormatItem
 {
@@ -72,16 +89,157 @@ class DateFormatItem : public FormatItem
     ~DateFormatItem() override = default;
     DateFormatItem(const std::string& time_fmt = "%H:%M:%S") : _time_fmt(time_fmt) {}
 
-    void format(std::ostream& out, const LogMsg& msg) override
+    void format(Buffer& out, const LogMsg& msg) override
     {
-        struct tm t;
-        localtime_r(&msg._ctime, &t);
-        char buff[64] = {0};
-        strftime(buff, sizeof(buff) - 1, _time_fmt.c_str(), &t);  // 要为'\0'预留一个位置
-        out << buff;
+        formatTime(out, _time_fmt.c_str(), msg._ctime, msg._nsec);
+    }
+
+    /*
+        供格式化器的指令数组直接调用
+        同一秒内的日志共享同一个日期字符串, 每个线程按子格式缓存最近一次的结果,
+        只在秒数变化时才重新调用strftime, 秒以下的数字直接在缓存的结果上原地改写
+        过长的子格式不缓存
+    */
+    static void formatTime(Buffer& out, const char* time_fmt, time_t ctime, uint32_t nsec = 0)
+    {
+        thread_local DateSlot slots[DATE_SLOTS];
+        thread_local size_t next = 0;
+
+        size_t fmt_len = strlen(time_fmt);
+        if (fmt_len >= sizeof(DateSlot::_fmt))
+        {
+            DateSlot slot;
+            renderTime(slot, time_fmt, fmt_len, ctime);
+            writeTime(out, slot, nsec);
+            return;
+        }
+
+        DateSlot* hit = nullptr;
+        for (auto& slot : slots)
+        {
+            if (slot._fmt_len == fmt_len && memcmp(slot._fmt, time_fmt, fmt_len) == 0)
+            {
+                hit = &slot;
+                break;
+            }
+        }
+
+        // 未命中则轮换占用一个槽位
+        if (hit == nullptr)
+        {
+            hit = &slots[next];
+            next = (next + 1) % DATE_SLOTS;
+            memcpy(hit->_fmt, time_fmt, fmt_len);
+            hit->_fmt_len = fmt_len;
+            renderTime(*hit, time_fmt, fmt_len, ctime);
+        }
+        else if (hit->_sec != ctime)
+        {
+            renderTime(*hit, time_fmt, fmt_len, ctime);
+        }
+        writeTime(out, *hit, nsec);
     }
 
    private:
+    // 秒以下部分在渲染结果中的位置
+    struct SubSecond
+    {
+        uint16_t _pos;
+        uint16_t _digits;
+    };
+
+    // 线程本地的日期缓存项, _fmt_len为零表示空闲
+    struct DateSlot
+    {
+        char _fmt[32];
+        size_t _fmt_len = 0;
+        time_t _sec = 0;
+        char _text[128];
+        size_t _len = 0;
+        SubSecond _subs[4];
+        size_t _nsubs = 0;
+    };
+    static constexpr size_t DATE_SLOTS = 4;
+
+    /*
+        以%kN为界将子格式切分成若干段, 每段交给strftime,
+        %kN处先占位, 记录下位置与位数, 输出时再填入
+    */
+    static void renderTime(DateSlot& slot, const char* time_fmt, size_t fmt_len, time_t ctime)
+    {
+        struct tm t;
+        util::Date::localtime(ctime, t);
+
+        slot._sec = ctime;
+        slot._len = 0;
+        slot._nsubs = 0;
+
+        char seg[sizeof(DateSlot::_text)];
+        size_t seg_len = 0;
+        auto flush = [&]() {
+            if (seg_len == 0)
+                return;
+            seg[seg_len] = '\0';
+            // 要为'\0'预留一个位置
+            slot._len += strftime(slot._text + slot._len, sizeof(slot._text) - slot._len - 1,
+                                  seg, &t);
+            seg_len = 0;
+        };
+
+        for (size_t i = 0; i < fmt_len && seg_len + 2 < sizeof(seg); ++i)
+        {
+            if (time_fmt[i] == '%' && i + 1 < fmt_len)
+            {
+                size_t digits = 0, end = i + 1;
+                if (time_fmt[end] >= '1' && time_fmt[end] <= '9')
+                    digits = time_fmt[end++] - '0';
+                if (end < fmt_len && time_fmt[end] == 'N' && slot._nsubs < 4)
+                {
+                    flush();
+                    digits = digits == 0 ? 9 : digits;
+                    if (slot._len + digits < sizeof(slot._text))
+                    {
+                        slot._subs[slot._nsubs++] = {static_cast<uint16_t>(slot._len),
+                                                     static_cast<uint16_t>(digits)};
+                        memset(slot._text + slot._len, '0', digits);
+                        slot._len += digits;
+                    }
+                    i = end;
+                    continue;
+                }
+                // 其它转换符连同'%'原样交给strftime, "%%"也要整体保留
+                seg[seg_len++] = time_fmt[i++];
+            }
+            seg[seg_len++] = time_fmt[i];
+        }
+        flush();
+    }
+
+    static void writeTime(Buffer& out, const DateSlot& slot, uint32_t nsec)
+    {
+        if (slot._nsubs == 0)
+        {
+            out.push(slot._text, slot._len);
+            return;
+        }
+
+        char text[sizeof(DateSlot::_text)];
+        memcpy(text, slot._text, slot._len);
+        for (size_t i = 0; i < slot._nsubs; ++i)
+        {
+            // 纳秒数固定9位, 取前digits位
+            uint32_t value = nsec;
+            char* pos = text + slot._subs[i]._pos;
+            for (int d = 8; d >= 0; --d)
+            {
+                if (d < slot._subs[i]._digits)
+                    pos[d] = '0' + value % 10;
+                value /= 10;
+            }
+        }
+        out.push(text, slot._len);
+    }
+
     std::string _time_fmt;
 };
 
@@ -89,42 +247,84 @@ class FileFormatItem : public FormatItem
 {
    public:
     ~FileFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << msg._file; }
+    void format(Buffer& out, const LogMsg& msg) override
+    {
+        out.push(msg._file.data(), msg._file.size());
+    }
 };
 
 class LineFormatItem : public FormatItem
 {
    public:
     ~LineFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << msg._line; }
+    void format(Buffer& out, const LogMsg& msg) override { formatLine(out, msg._line); }
+
+    // 使用to_chars转换, 不依赖流的格式状态
+    static void formatLine(Buffer& out, size_t line)
+    {
+        char buff[24];
+        auto res = std::to_chars(buff, buff + sizeof(buff), line);
+        out.push(buff, res.ptr - buff);
+    }
 };
 
 class ThreadFormatItem : public FormatItem
 {
    public:
     ~ThreadFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << msg._tid; }
+    void format(Buffer& out, const LogMsg& msg) override { formatThread(out, msg._tid); }
+
+    /*
+        输出内容与 std::ostream << std::thread::id 保持一致
+        libstdc++中线程ID内部就是pthread_t, 流输出时按十进制整数打印,
+        这里直接转换, 省去构造字符串流; 其它标准库实现仍然借助字符串流
+    */
+    static void formatThread(Buffer& out, std::thread::id tid)
+    {
+#if defined(__GLIBCXX__)
+        if (tid == std::thread::id())
+        {
+            std::string_view str = "thread::id of a non-executing thread";
+            out.push(str.data(), str.size());
+            return;
+        }
+        static_assert(sizeof(tid) == sizeof(pthread_t), "unexpected std::thread::id layout");
+        pthread_t handle;
+        memcpy(&handle, &tid, sizeof(handle));
+        char buff[24];
+        auto res = std::to_chars(buff, buff + sizeof(buff), static_cast<unsigned long>(handle));
+        out.push(buff, res.ptr - buff);
+#else
+        std::ostringstream oss;
+        oss << tid;
+        std::string str = oss.str();
+        out.push(str.data(), str.size());
+#endif
+    }
 };
 
 class LoggerFormatItem : public FormatItem
 {
    public:
     ~LoggerFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << msg._logger; }
+    void format(Buffer& out, const LogMsg& msg) override
+    {
+        out.push(msg._logger.data(), msg._logger.size());
+    }
 };
 
 class TabFormatItem : public FormatItem
 {
    public:
     ~TabFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << '\t'; }
+    void format(Buffer& out, const LogMsg& /*msg*/) override { out.push("\t", 1); }
 };
 
 class NLineFormatItem : public FormatItem
 {
    public:
     ~NLineFormatItem() override = default;
-    void format(std::ostream& out, const LogMsg& msg) override { out << '\n'; }
+    void format(Buffer& out, const LogMsg& /*msg*/) override { out.push("\n", 1); }
 };
 
 /*
@@ -136,7 +336,7 @@ class OtherFormatItem : public FormatItem
     ~OtherFormatItem() override = default;
     OtherFormatItem(const std::string& str) : _str(str) {}
 
-    void format(std::ostream& out, const LogMsg& msg) override { out << _str; }
+    void format(Buffer& out, const LogMsg& /*msg*/) override { out.push(_str.data(), _str.size()); }
 
    private:
     std::string _str;
@@ -145,7 +345,7 @@ class OtherFormatItem : public FormatItem
 /*
     %p              日志等级
     %T              制表符缩进
-    %d{%H:%M:%S}    日期, 默认形式是时:分:秒
+    %d{%H:%M:%S}    日期, 默认形式是时:分:秒, 支持%3N, %6N, %9N输出毫秒, 微秒, 纳秒
     %c              日志器名称
     %t              线程ID
     %f              源代码文件名
@@ -154,40 +354,204 @@ class OtherFormatItem : public FormatItem
     %n              换行
 */
 
+/*
+    扁平化的格式化指令
+    运行期解析模式串后得到一个指令数组, 格式化时逐条switch分派,
+    不再有每项一次的虚函数调用与智能指针拷贝
+    指令码直接使用占位符字符, 原始字符串使用'%'
+*/
+enum class FormatOp : char
+{
+    LEVEL = 'p',
+    TAB = 'T',
+    DATE = 'd',
+    LOGGER = 'c',
+    THREAD = 't',
+    FILE = 'f',
+    LINE = 'l',
+    MSG = 'm',
+    NLINE = 'n',
+    TEXT = '%'
+};
+
+// 使用编译期字符串声明模式串, 例如 Formatter::compile(WINDLOG_PATTERN("%m%n"))
+#define WINDLOG_PATTERN(str) WINDLOG_FMT(str)
+
 class Formatter
 {
    private:
+    struct Op
+    {
+        FormatOp _code;
+        std::string _val;  // 日期子格式或原始字符串
+    };
+
+    // 编译期解析结果, 子格式或原始字符串以区间形式指向模式串
+    struct StaticOp
+    {
+        FormatOp _code;
+        size_t _pos;
+        size_t _len;
+    };
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /*
+        编译期解析模式串, 规则与parsePattern一致
+        out为空时只统计指令个数, 解析失败返回npos
+    */
+    static constexpr size_t parseStatic(std::string_view pattern, StaticOp* out)
+    {
+        constexpr std::string_view keys = "pTdctflmn";
+        size_t n = 0, start = 0, len = pattern.size();
+        while (start < len)
+        {
+            StaticOp op{FormatOp::TEXT, start, 0};
+            if (pattern[start] != '%')
+            {
+                size_t end = start;
+                while (end < len && pattern[end] != '%') ++end;
+                op._len = end - start;
+                start = end;
+            }
+            else if (start + 1 == len)
+            {
+                return npos;
+            }
+            else if (pattern[start + 1] == '%')
+            {
+                op._pos = start + 1;
+                op._len = 1;
+                start += 2;
+            }
+            else
+            {
+                if (keys.find(pattern[start + 1]) == std::string_view::npos)
+                    return npos;
+                op._code = static_cast<FormatOp>(pattern[start + 1]);
+                start += 2;
+                op._pos = start;
+                if (start < len && pattern[start] == '{')
+                {
+                    size_t end = ++start;
+                    while (end < len && pattern[end] != '}') ++end;
+                    if (end == len)
+                        return npos;
+                    op._pos = start;
+                    op._len = end - start;
+                    start = end + 1;
+                }
+            }
+            if (out != nullptr)
+                out[n] = op;
+            ++n;
+        }
+        return n;
+    }
+
+    template <typename P>
+    struct StaticPattern
+    {
+        static constexpr size_t count = parseStatic(P::value(), nullptr);
+        static_assert(count != npos, "invalid log pattern");
+
+        static constexpr std::array<StaticOp, count == npos ? 0 : count> parse()
+        {
+            std::array<StaticOp, count == npos ? 0 : count> ops{};
+            parseStatic(P::value(), ops.data());
+            return ops;
+        }
+        static constexpr auto ops = parse();
+    };
+
+    // strftime需要以'\0'结尾的子格式, 在编译期拷贝出来
+    template <typename P, size_t I>
+    struct StaticDateFmt
+    {
+        static constexpr StaticOp op = StaticPattern<P>::ops[I];
+
+        static constexpr std::array<char, op._len + 1> make()
+        {
+            std::array<char, op._len + 1> str{};
+            for (size_t i = 0; i < op._len; ++i) str[i] = P::value()[op._pos + i];
+            return str;
+        }
+        static constexpr auto value = make();
+    };
+
     /*
-        根据不同的占位符标志, 创建对应的格式化子类
+        执行一条指令, 运行期指令数组与编译期模式串共用
+        编译期路径中code是常量, 内联后switch会被直接折叠
     */
+    static void render(Buffer& out, FormatOp code, const char* val, size_t len,
+                       const LogMsg& msg)
+    {
+        switch (code)
+        {
+            case FormatOp::LEVEL:
+            {
+                const char* level = LogLevel::toString(msg._level);
+                out.push(level, strlen(level));
+                break;
+            }
+            case FormatOp::TAB:
+                out.push("\t", 1);
+                break;
+            case FormatOp::DATE:
+                DateFormatItem::formatTime(out, len == 0 ? "%H:%M:%S" : val, msg._ctime,
+                                           msg._nsec);
+                break;
+            case FormatOp::LOGGER:
+                out.push(msg._logger.data(), msg._logger.size());
+                break;
+            case FormatOp::THREAD:
+                ThreadFormatItem::formatThread(out, msg._tid);
+                break;
+            case FormatOp::FILE:
+                out.push(msg._file.data(), msg._file.size());
+                break;
+            case FormatOp::LINE:
+                LineFormatItem::formatLine(out, msg._line);
+                break;
+            case FormatOp::MSG:
+                out.push(msg._payload.data(), msg._payload.size());
+                break;
+            case FormatOp::NLINE:
+                out.push("\n", 1);
+                break;
+            case FormatOp::TEXT:
+                out.push(val, len);
+                break;
+        }
+    }
 
-    FormatItem::ptr createItem(const std::string& key, const std::string& val)
+    template <typename P, size_t I>
+    static void formatOne(Buffer& out, const LogMsg& msg)
     {
-        if (key == "p")
-            return std::make_shared<LevelFormatItem>();
-        if (key == "T")
-            return std::make_shared<TabFormatItem>();
-        if (key == "d")
-            return std::make_shared<DateFormatItem>(val);
-        if (key == "c")
-            return std::make_shared<LoggerFormatItem>();
-        if (key == "t")
-            return std::make_shared<ThreadFormatItem>();
-        if (key == "f")
-            return std::make_shared<FileFormatItem>();
-        if (key == "l")
-            return std::make_shared<LineFormatItem>();
-        if (key == "m")
-            return std::make_shared<MsgFormatItem>();
-        if (key == "n")
-            return std::make_shared<NLineFormatItem>();
-
-        return std::make_shared<OtherFormatItem>(val);
+        constexpr StaticOp op = StaticPattern<P>::ops[I];
+        if constexpr (op._code == FormatOp::DATE)
+            render(out, op._code, StaticDateFmt<P, I>::value.data(), op._len, msg);
+        else
+            render(out, op._code, P::value().data() + op._pos, op._len, msg);
+    }
+
+    // 流接口与字符串接口使用的线程本地缓冲区
+    static Buffer& scratch()
+    {
+        thread_local Buffer buff(256);
+        buff.reset();
+        return buff;
+    }
+
+    template <typename P, size_t... I>
+    static void formatAll(Buffer& out, const LogMsg& msg, std::index_sequence<I...>)
+    {
+        (formatOne<P, I>(out, msg), ...);
     }
 
     /*
         对格式化规则字符串进行解析
-        解析失败时返回false 并且_items为空
+        解析失败时返回false 并且_ops为空
     */
     bool parsePattern()
     {
@@ -244,16 +608,11 @@ class Formatter
             }
         }
 
-        _items.reserve(fmt_buff.size());
+        _ops.reserve(fmt_buff.size());
         for (const auto& [key, val] : fmt_buff)
         {
-            auto item = createItem(key, val);
-            if (!item)
-            {
-                _items.clear();
-                return false;
-            }
-            _items.emplace_back(std::move(item));
+            FormatOp code = key == "TEXT" ? FormatOp::TEXT : static_cast<FormatOp>(key[0]);
+            _ops.push_back({code, val});
         }
 
         return true;
@@ -262,22 +621,48 @@ class Formatter
    public:
     using ptr = std::shared_ptr<Formatter>;
     Formatter(const std::string& pattern = "[%p]%T[%d{%H:%M:%S}][%c][%t]%T[%f:%l]%T%m%n")
-        : _pattern(pattern), _formatKeys("pTdctflmn")
+        : _pattern(pattern), _formatKeys("pTdctflmn"), _static_fn(nullptr)
     {
         parsePattern();
     }
 
     /*
-        对msg进行格式化
+        由编译期模式串构造格式化器
+        指令序列在编译期展开成一个完全内联的函数, 每条日志只有一次间接调用
     */
-    void format(std::ostream& out, const LogMsg& msg)
+    template <typename P, enable_if_compile_string<P> = 0>
+    static ptr compile(P)
+    {
+        auto formatter = std::make_shared<Formatter>(std::string(P::value()));
+        formatter->_static_fn = &formatStatic<P>;
+        return formatter;
+    }
+
+    // 直接使用编译期模式串进行格式化
+    template <typename P>
+    static void formatStatic(Buffer& out, const LogMsg& msg)
     {
+        formatAll<P>(out, msg, std::make_index_sequence<StaticPattern<P>::ops.size()>());
+    }
+
+    /*
+        对msg进行格式化, 结果追加到out之后
+        out由调用者复用, 容量稳定之后整个过程不再分配内存
+    */
+    void format(Buffer& out, const LogMsg& msg)
+    {
+        if (_static_fn != nullptr)
+        {
+            _static_fn(out, msg);
+            return;
+        }
+
         // 格式化规则字符串解析失败则舍弃日志
-        if (!_items.empty())
+        if (!_ops.empty())
         {
-            for (auto item : _items)
+            for (const auto& op : _ops)
             {
-                item->format(out, msg);
+                render(out, op._code, op._val.c_str(), op._val.size(), msg);
             }
         }
         else
@@ -285,17 +670,26 @@ class Formatter
             throw std::runtime_error("Log formatting failed in parsePattern()");
         }
     }
+    void format(std::ostream& out, const LogMsg& msg)
+    {
+        Buffer& buff = scratch();
+        format(buff, msg);
+        out.write(buff.readAbleBegin(), buff.readAbleSize());
+    }
     std::string format(const LogMsg& msg)
     {
-        std::stringstream ss;
-        format(ss, msg);
-        return ss.str();
+        Buffer& buff = scratch();
+        format(buff, msg);
+        return std::string(buff.readAbleBegin(), buff.readAbleSize());
     }
 
    private:
     std::string _pattern;           // 用户输入的原始格式化字符串
     const std::string _formatKeys;  // 格式化检查辅助字符串
-    std::vector<FormatItem::ptr> _items;
+    std::vector<Op> _ops;           // 运行期解析得到的指令数组
+
+    // 编译期模式串生成的格式化函数, 为空时使用指令数组
+    void (*_static_fn)(Buffer&, const LogMsg&);
 };
 
 }  // namespace windlog
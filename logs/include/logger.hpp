@@ -11,39 +11,96 @@
 #define LEVEL_error (LogLevel::value::ERROR)
 #define LEVEL_fatal (LogLevel::value::FATAL)
 
-#define DEFINE_LOG_FUNC(level)                                                  \
-    void level(const std::string& file, size_t line, const char* fmat, ...)     \
-    {                                                                           \
-        /*检查debug是否在下界等级之上, 或者就是他*/             \
-        if (LEVEL_##level < _lower_level)                                       \
-            return;                                                             \
-                                                                                \
-        /*构造出来一个Message供formatter使用*/                         \
-        va_list ap;                                                             \
-        va_start(ap, fmat);                                                     \
-        char* buff = nullptr;                                                   \
-        int res = vasprintf(&buff, fmat, ap);                                   \
-        va_end(ap);                                                             \
-        if (res == -1)                                                          \
-            throw std::runtime_error("Logger " #level " failed to: vasprintf"); \
-                                                                                \
-        LogMsg msg(LEVEL_##level, file, line, _logger_name, buff);              \
-        free(buff);                                                             \
-                                                                                \
-        /*格式化*/                                                           \
-        std::stringstream oss;                                                  \
-        _formatter->format(oss, msg);                                           \
-                                                                                \
-        /*实际落地*/                                                        \
-        log(oss.str().c_str(), oss.str().size());                               \
+/*
+    printf风格的日志接口, 借助format属性让编译器检查格式化字符串与参数是否匹配
+    成员函数的第一个隐含参数是this, 所以格式化字符串是第4个参数
+    文件名为静态字符串(例如__FILE__)时走const char*重载, 基础名按调用点缓存,
+    传入std::string时每次现场截取, 两者都不拷贝
+*/
+#define DEFINE_LOG_FUNC(level)                                                      \
+    __attribute__((format(printf, 4, 5))) void level(const std::string& file,      \
+                                                     size_t line,                  \
+                                                     const char* fmat, ...)        \
+    {                                                                               \
+        /*检查debug是否在下界等级之上, 或者就是他*/                 \
+        if (LEVEL_##level < _lower_level)                                           \
+            return;                                                                 \
+                                                                                    \
+        va_list ap;                                                                 \
+        va_start(ap, fmat);                                                         \
+        bool ok = logFormat(LEVEL_##level, util::file::basenameView(file), line,    \
+                            fmat, ap);                                              \
+        va_end(ap);                                                                 \
+        if (!ok)                                                                    \
+            throw std::runtime_error("Logger " #level " failed to: vsnprintf");     \
+    }                                                                               \
+    __attribute__((format(printf, 4, 5))) void level(const char* file, size_t line, \
+                                                     const char* fmat, ...)        \
+    {                                                                               \
+        if (LEVEL_##level < _lower_level)                                           \
+            return;                                                                 \
+                                                                                    \
+        va_list ap;                                                                 \
+        va_start(ap, fmat);                                                         \
+        bool ok = logFormat(LEVEL_##level, util::file::basenameView(file), line,    \
+                            fmat, ap);                                              \
+        va_end(ap);                                                                 \
+        if (!ok)                                                                    \
+            throw std::runtime_error("Logger " #level " failed to: vsnprintf");     \
+    }                                                                               \
+    /*调用点静态元数据版本, 宏接口使用*/                                  \
+    __attribute__((format(printf, 3, 4))) void level(const LogSite* site,          \
+                                                     const char* fmat, ...)        \
+    {                                                                               \
+        if (LEVEL_##level < _lower_level)                                           \
+            return;                                                                 \
+                                                                                    \
+        va_list ap;                                                                 \
+        va_start(ap, fmat);                                                         \
+        bool ok = logFormat(LEVEL_##level, site->_file, site->_line, fmat, ap);     \
+        va_end(ap);                                                                 \
+        if (!ok)                                                                    \
+            throw std::runtime_error("Logger " #level " failed to: vsnprintf");     \
+    }
+
+/*
+    {}风格的日志接口, 格式化字符串需由WINDLOG_FMT包装
+    占位符个数与参数类型在编译期检查, 主体信息直接格式化到线程本地缓冲区中
+*/
+#define DEFINE_TYPED_LOG_FUNC(level)                                                      \
+    template <typename S, typename... Args, enable_if_compile_string<S> = 0>              \
+    void level(const std::string& file, size_t line, S fmat, const Args&... args)         \
+    {                                                                                     \
+        if (LEVEL_##level < _lower_level)                                                 \
+            return;                                                                       \
+        logTyped(LEVEL_##level, util::file::basenameView(file), line, fmat, args...);     \
+    }                                                                                     \
+    template <typename S, typename... Args, enable_if_compile_string<S> = 0>              \
+    void level(const char* file, size_t line, S fmat, const Args&... args)                \
+    {                                                                                     \
+        if (LEVEL_##level < _lower_level)                                                 \
+            return;                                                                       \
+        logTyped(LEVEL_##level, util::file::basenameView(file), line, fmat, args...);     \
+    }                                                                                     \
+    template <typename S, typename... Args, enable_if_compile_string<S> = 0>              \
+    void level(const LogSite* site, S fmat, const Args&... args)                          \
+    {                                                                                     \
+        if (LEVEL_##level < _lower_level)                                                 \
+            return;                                                                       \
+        logTyped(LEVEL_##level, site->_file, site->_line, fmat, args...);                 \
     }
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdarg>
+#include <cstdio>
 #include <cstdlib>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -52,16 +109,121 @@
 #include "level.hpp"
 #include "looper.hpp"
 #include "message.hpp"
+#include "record.hpp"
 #include "sink.hpp"
+#include "site.hpp"
+#include "typed_format.hpp"
 
 namespace windlog {
 class Logger
 {
    protected:
     /*
-        完成实际的落地
+        完成实际的落地, level用于决定是否需要尽快持久化
+    */
+    virtual void log(LogLevel::value level, const char* data, size_t len) = 0;
+
+    /*
+        printf风格接口的公共部分, file已经是基础名
+        延迟格式化时只序列化记录, 交给异步线程格式化
+        否则主体信息渲染到线程本地缓冲区, 稳定后不再分配内存
+    */
+    bool logFormat(LogLevel::value level, std::string_view file, size_t line, const char* fmat,
+                   va_list ap)
+    {
+        if (_deferred)
+        {
+            thread_local std::string record;
+            LogRecord::encode(record, level, file, line, fmat, ap);
+            log(level, record.data(), record.size());
+            return true;
+        }
+
+        thread_local std::string payload;
+        if (!renderPayload(payload, fmat, ap))
+            return false;
+        logPayload(level, file, line, payload.data(), payload.size());
+        return true;
+    }
+
+    // {}风格接口的公共部分
+    template <typename S, typename... Args>
+    void logTyped(LogLevel::value level, std::string_view file, size_t line, S,
+                  const Args&... args)
+    {
+        static_assert(TypedFormat::check<Args...>(S::value()),
+                      "format string must contain exactly one {} per argument");
+        static_assert((TypedFormat::formattable<Args>() && ...),
+                      "argument type is not supported by TypedFormat");
+
+        std::string& payload = typedPayload();
+        payload.clear();
+        TypedFormat::format(payload, S::value(), args...);
+        logPayload(level, file, line, payload.data(), payload.size());
+    }
+
+    // 所有{}风格调用共用的线程本地缓冲区
+    static std::string& typedPayload()
+    {
+        thread_local std::string payload;
+        return payload;
+    }
+
+    /*
+        主体信息已经渲染完成, 构造日志消息并格式化后落地
+        延迟格式化时则直接序列化为记录
+        消息只引用文件名, 日志器名称与主体信息, 不做拷贝
+    */
+    void logPayload(LogLevel::value level, std::string_view file, size_t line,
+                    const char* payload, size_t len)
+    {
+        if (_deferred)
+        {
+            thread_local std::string record;
+            LogRecord::encodePayload(record, level, file, line, payload, len);
+            log(level, record.data(), record.size());
+            return;
+        }
+
+        time_t sec;
+        uint32_t nsec;
+        util::Date::now(sec, nsec);
+        LogMsg msg(sec, nsec, level, file, line, std::this_thread::get_id(), _logger_name,
+                   std::string_view(payload, len));
+
+        // 格式化, 输出缓冲区是线程本地的, 反复使用已有容量
+        thread_local Buffer text(1024);
+        text.reset();
+        _formatter->format(text, msg);
+
+        // 实际落地
+        log(level, text.readAbleBegin(), text.readAbleSize());
+    }
+
+    /*
+        将printf风格的参数渲染到out中, 覆盖原有内容
+        先尝试直接写入out已有的容量, 放不下时按所需长度扩容后重新渲染一次
     */
-    virtual void log(const char* data, size_t len) = 0;
+    static bool renderPayload(std::string& out, const char* fmat, va_list ap)
+    {
+        va_list backup;
+        va_copy(backup, ap);
+
+        out.resize(out.capacity());
+        // std::string保证size()处还有一个'\0'的位置
+        int res = vsnprintf(&out[0], out.size() + 1, fmat, ap);
+        if (res >= 0 && static_cast<size_t>(res) > out.size())
+        {
+            out.resize(res);
+            res = vsnprintf(&out[0], out.size() + 1, fmat, backup);
+        }
+        va_end(backup);
+
+        if (res < 0)
+            return false;
+        out.resize(res);
+        return true;
+    }
 
    public:
     using ptr = std::shared_ptr<Logger>;
@@ -76,13 +238,26 @@ class Logger
     DEFINE_LOG_FUNC(error)
     DEFINE_LOG_FUNC(fatal)
 
+    DEFINE_TYPED_LOG_FUNC(debug)
+    DEFINE_TYPED_LOG_FUNC(info)
+    DEFINE_TYPED_LOG_FUNC(warn)
+    DEFINE_TYPED_LOG_FUNC(error)
+    DEFINE_TYPED_LOG_FUNC(fatal)
+
     Logger(const std::string& logger_name, LogLevel::value lower_level, Formatter::ptr formatter,
            const std::vector<LogSink::ptr> sinks)
-        : _logger_name(logger_name), _lower_level(lower_level), _formatter(formatter), _sinks(sinks)
+        : _logger_name(logger_name),
+          _lower_level(lower_level),
+          _formatter(formatter),
+          _sinks(sinks),
+          _deferred(false)
     {
     }
 
-    void flush()
+    // 编译期被消除的日志调用展开为此空函数, 参数不会被求值
+    void disabled() const {}
+
+    virtual void flush()
     {
         for (const auto& sink : _sinks)
         {
@@ -106,6 +281,9 @@ class Logger
 
     // 支持多落地方向
     std::vector<LogSink::ptr> _sinks;
+
+    // 是否延迟格式化, 仅异步日志器支持
+    bool _deferred;
 };
 inline Logger::~Logger() = default;
 
@@ -121,13 +299,18 @@ class SyncLogger : public Logger
 
    private:
     // 同步日志器, 是将日志直接通过落地模块进行日志落地
-    void log(const char* data, size_t len) override
+    void log(LogLevel::value level, const char* data, size_t len) override
     {
         std::unique_lock<std::mutex> lock(_mutex);
         for (const auto& sink : _sinks)
         {
             sink->log(data, len);
         }
+        // 同步日志器的每条日志自成一批
+        for (const auto& sink : _sinks)
+        {
+            sink->commit(level >= LogLevel::value::ERROR);
+        }
     }
 };
 
@@ -143,35 +326,251 @@ class SyncLogger : public Logger
 
 class AsyncLogger : public Logger
 {
-    // 异步线程的落地策略
-    void realLog(Buffer& buffer)
+    // 延迟格式化模式下, 在异步线程上将记录逐条解码并格式化后追加到_text中
+    // 相关的缓冲区只在异步线程上使用, 反复复用
+    void formatRecords(Buffer& buffer)
     {
+        LogRecord::View view;
+
+        const char* data = buffer.readAbleBegin();
+        size_t len = buffer.readAbleSize();
+        while (len > 0)
+        {
+            size_t n = LogRecord::decode(data, len, view);
+            _payload.clear();
+            LogRecord::render(_payload, view);
+
+            LogMsg msg(view._header._ctime, view._header._nsec, view._header._level,
+                       std::string_view(view._file, view._header._file_len), view._header._line,
+                       LogMsg::intToThread(view._header._tid), _logger_name, _payload);
+            _formatter->format(_text, msg);
+
+            data += n;
+            len -= n;
+        }
+    }
+
+    // 异步线程的落地策略, 写完一批之后按标记刷新或者提交
+    void realLog(Buffer& buffer, BufferChain& chain, unsigned flags)
+    {
+        // 丢弃只发生在生产缓冲区已满时, 交换之前丢弃的日志都晚于这批日志
+        bool dropped = collectDrops();
+        if (!chain.empty())
+            writeChain(buffer, chain);
+        else if (!buffer.empty())
+            writeBatch(buffer);
+        if (dropped)
+            reportDrops();
+
+        for (const auto& sink : _sinks)
+        {
+            if (flags & AsyncLooper::FLUSH)
+                sink->flush();
+            else if (flags & AsyncLooper::IDLE)
+                sink->idle();
+            else
+                sink->commit(flags & AsyncLooper::URGENT);
+        }
+    }
+
+    void writeBatch(Buffer& buffer)
+    {
+        if (_deferred)
+        {
+            // 能接收记录的落地方向直接拿到记录, 其余的才需要格式化
+            bool formatted = false;
+            for (size_t i = 0; i < _sinks.size(); ++i)
+            {
+                auto record_sink = dynamic_cast<RecordSink*>(_sinks[i].get());
+                if (record_sink != nullptr)
+                {
+                    record_sink->logRecords(_logger_name, buffer.readAbleBegin(),
+                                            buffer.readAbleSize());
+                    continue;
+                }
+                if (!formatted)
+                {
+                    _text.reset();
+                    formatRecords(buffer);
+                    formatted = true;
+                }
+                sinkText(i, _text);
+            }
+            return;
+        }
+
         // 这个也不需要加锁, 因为_looper天然自带线程安全保护, 本身就是串行的
+        for (size_t i = 0; i < _sinks.size(); ++i)
+        {
+            sinkText(i, buffer);
+        }
+    }
+
+    /*
+        缓冲区之后还接着片段链的一批数据, 各部分都不搬移
+        文本直接作为iovec列表一次交给落地方向; 记录不跨片段, 逐段交给能接收记录的落地方向,
+        其余的落地方向仍然拿到格式化后的文本
+    */
+    void writeChain(Buffer& buffer, BufferChain& chain)
+    {
+        if (_deferred)
+        {
+            bool formatted = false;
+            for (size_t i = 0; i < _sinks.size(); ++i)
+            {
+                auto record_sink = dynamic_cast<RecordSink*>(_sinks[i].get());
+                if (record_sink != nullptr)
+                {
+                    if (!buffer.empty())
+                        record_sink->logRecords(_logger_name, buffer.readAbleBegin(),
+                                                buffer.readAbleSize());
+                    for (size_t k = 0; k < chain.segmentCount(); ++k)
+                        record_sink->logRecords(_logger_name, chain.segment(k).readAbleBegin(),
+                                                chain.segment(k).readAbleSize());
+                    continue;
+                }
+                if (!formatted)
+                {
+                    _text.reset();
+                    formatRecords(buffer);
+                    for (size_t k = 0; k < chain.segmentCount(); ++k)
+                        formatRecords(chain.segment(k));
+                    formatted = true;
+                }
+                sinkText(i, _text);
+            }
+            return;
+        }
+
+        _iov.clear();
+        if (!buffer.empty())
+            _iov.push_back({const_cast<char*>(buffer.readAbleBegin()), buffer.readAbleSize()});
+        chain.appendIov(_iov);
         for (const auto& sink : _sinks)
         {
-            sink->log(buffer.readAbleBegin(), buffer.readAbleSize());
+            sink->logv(_iov.data(), static_cast<int>(_iov.size()));
+        }
+    }
+
+    /*
+        统计上次报告之后又被丢弃的日志, 有则把提示信息写入_notice_text
+        计数只在异步线程上读取, 与业务线程之间不需要更强的同步
+    */
+    bool collectDrops()
+    {
+        uint64_t total = 0;
+        std::string detail;
+        for (size_t i = 0; i < LEVELS; ++i)
+        {
+            uint64_t n = _dropped[i].load(std::memory_order_relaxed) - _reported[i];
+            if (n == 0)
+                continue;
+            _reported[i] += n;
+            total += n;
+            detail += detail.empty() ? "" : ", ";
+            detail += LogLevel::toString(static_cast<LogLevel::value>(i));
+            detail += ": " + std::to_string(n);
         }
+        if (total == 0)
+            return false;
+        _notice_text = std::to_string(total) + " messages dropped (" + detail + ")";
+        return true;
+    }
+
+    // 以WARN等级写出丢弃提示, 让输出中的缺口可见
+    void reportDrops()
+    {
+        std::string_view file = util::file::internBasename(__FILE__);
+        _notice.reset();
+        if (_deferred)
+        {
+            std::string record;
+            LogRecord::encodePayload(record, LogLevel::value::WARN, file, __LINE__,
+                                     _notice_text.data(), _notice_text.size());
+            _notice.push(record.data(), record.size());
+        }
+        else
+        {
+            time_t sec;
+            uint32_t nsec;
+            util::Date::now(sec, nsec);
+            LogMsg msg(sec, nsec, LogLevel::value::WARN, file, __LINE__,
+                       std::this_thread::get_id(), _logger_name, _notice_text);
+            _formatter->format(_notice, msg);
+        }
+        writeBatch(_notice);
+    }
+
+    // 之后不再有落地方向使用这块缓冲区时, 允许最后一个落地方向把它整块换走
+    void sinkText(size_t i, Buffer& text)
+    {
+        if (i + 1 == _sinks.size())
+            _sinks[i]->logBuffer(text);
+        else
+            _sinks[i]->log(text.readAbleBegin(), text.readAbleSize());
     }
 
    public:
     AsyncLogger(const std::string& logger_name, LogLevel::value lower_level,
                 Formatter::ptr formatter, const std::vector<LogSink::ptr> sinks,
-                AsyncLooper::mode mode)
+                AsyncLooper::mode mode, size_t staging_size = 0,
+                std::chrono::milliseconds staging_interval = std::chrono::milliseconds(100),
+                bool deferred = false, SharedBackend::ptr backend = nullptr,
+                LogLevel::value drop_below = LogLevel::value::OFF,
+                SegmentPool::ptr pool = nullptr, const MemoryPolicy& memory = MemoryPolicy())
         : Logger(logger_name, lower_level, formatter, sinks),
+          _text(4096),
+          _notice(256),
+          _drop_below(drop_below),
           _looper(std::make_shared<AsyncLooper>(
-              std::bind(&AsyncLogger::realLog, this, std::placeholders::_1), mode))
+              std::bind(&AsyncLogger::realLog, this, std::placeholders::_1,
+                        std::placeholders::_2, std::placeholders::_3),
+              mode, staging_size, staging_interval, std::move(backend), std::move(pool),
+              memory))
     {
+        _deferred = deferred;
     }
 
     ~AsyncLogger() = default;
 
-    void log(const char* data, size_t len) override
+    // 等待异步线程写完此前的日志, 并由它刷新落地方向
+    void flush() override { _looper->flush(); }
+
+    void log(LogLevel::value level, const char* data, size_t len) override
     {
         // 无需加锁, _looper::push中的锁足以保证线程安全
-        _looper->push(data, len);
+        // ON_BUFFER_FULL_DROP模式下, 低于drop_below的日志在缓冲区满时被丢弃
+        if (!_looper->push(data, len, level >= LogLevel::value::ERROR, level < _drop_below))
+            _dropped[static_cast<size_t>(level)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 因缓冲区满而丢弃的日志条数
+    uint64_t dropped(LogLevel::value level) const
+    {
+        return _dropped[static_cast<size_t>(level)].load(std::memory_order_relaxed);
+    }
+    uint64_t dropped() const
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < LEVELS; ++i) total += _dropped[i].load(std::memory_order_relaxed);
+        return total;
     }
 
    private:
+    static constexpr size_t LEVELS = static_cast<size_t>(LogLevel::value::OFF) + 1;
+
+    // 延迟格式化时异步线程使用的缓冲区
+    Buffer _text;
+    std::string _payload;
+    std::vector<struct iovec> _iov;
+
+    // 丢弃计数按等级分开, 由业务线程累加; 已经报告过的条数只由异步线程访问
+    Buffer _notice;
+    std::string _notice_text;
+    LogLevel::value _drop_below;
+    std::atomic<uint64_t> _dropped[LEVELS]{};
+    uint64_t _reported[LEVELS]{};
+
     AsyncLooper::ptr _looper;
 };
 
@@ -202,7 +601,11 @@ class LoggerBuilder
     LoggerBuilder()
         : _type(LoggerType::LOGGER_SYNC),
           _lower_level(LogLevel::value::DEBUG),
-          _mode(AsyncLooper::mode::ON_BUFFER_FULL_BLOCK)
+          _mode(AsyncLooper::mode::ON_BUFFER_FULL_BLOCK),
+          _staging_size(0),
+          _staging_interval(100),
+          _deferred(false),
+          _drop_below(LogLevel::value::OFF)
     {
     }
 
@@ -217,6 +620,13 @@ class LoggerBuilder
         _formatter = std::make_shared<Formatter>(pattern);
     }
 
+    // 使用编译期模式串, 例如 buildLoggerFormatter(WINDLOG_PATTERN("%m%n"))
+    template <typename P, enable_if_compile_string<P> = 0>
+    void buildLoggerFormatter(P pattern)
+    {
+        _formatter = Formatter::compile(pattern);
+    }
+
     template <typename SinkType, typename... Args>
     void buildLoggerSink(Args&&... args)
     {
@@ -224,8 +634,54 @@ class LoggerBuilder
         _sinks.emplace_back(std::move(sink));
     }
 
+    // 添加已经创建好的落地方向, 调用者可以保留它以便读取指标
+    void buildLoggerSink(const LogSink::ptr& sink) { _sinks.push_back(sink); }
+
+    // 添加异步落地方向, 由它自己的工作线程写入, 慢的落地方向不会拖住其它落地方向
+    template <typename SinkType, typename... Args>
+    void buildLoggerAsyncSink(const SinkQueue& queue, Args&&... args)
+    {
+        auto sink = SinkFactory::create<SinkType>(std::forward<Args>(args)...);
+        _sinks.emplace_back(std::make_shared<AsyncSink>(std::move(sink), queue));
+    }
+
+    // 添加基于文件描述符的落地方向, 并指定它的持久化策略
+    template <typename SinkType, typename... Args>
+    void buildLoggerDurableSink(const Durability& durability, Args&&... args)
+    {
+        static_assert(std::is_base_of<FdSink, SinkType>::value,
+                      "durability is only supported by FdSink based sinks");
+        auto sink = std::make_shared<SinkType>(std::forward<Args>(args)...);
+        sink->setDurability(durability);
+        _sinks.emplace_back(std::move(sink));
+    }
+
     void buildLoggerMode(AsyncLooper::mode mode) { _mode = mode; }
 
+    // 异步日志器开启线程本地暂存, 攒够size字节或者超过interval时间后整批发布
+    void buildLoggerStaging(size_t size,
+                            std::chrono::milliseconds interval = std::chrono::milliseconds(100))
+    {
+        _staging_size = size;
+        _staging_interval = interval;
+    }
+
+    // 异步日志器开启延迟格式化, 业务线程只序列化记录, 格式化在异步线程上完成
+    void buildLoggerDeferred(bool deferred) { _deferred = deferred; }
+
+    // 异步日志器使用共享后端, 不再创建自己的线程, 多个日志器可以共用同一个后端
+    void buildLoggerBackend(const SharedBackend::ptr& backend) { _backend = backend; }
+
+    // ON_BUFFER_FULL_DROP模式下只丢弃低于level的日志, 更高等级的日志仍然等待
+    void buildLoggerDropBelow(LogLevel::value level) { _drop_below = level; }
+
+    // 异步日志器的片段链使用指定的片段池, 默认使用进程内共用的SegmentPool::global()
+    void buildLoggerPool(const SegmentPool::ptr& pool) { _pool = pool; }
+
+    // 异步日志器缓冲区的分配策略, 例如 MemoryPolicy::transparentHuge(MemoryPolicy::CONSUMER_NODE)
+    // 片段链的片段按片段池自己的策略分配, 需要时用buildLoggerPool指定同样策略的池
+    void buildLoggerMemory(const MemoryPolicy& memory) { _memory = memory; }
+
     virtual Logger::ptr build() = 0;
 
    protected:
@@ -238,6 +694,19 @@ class LoggerBuilder
     std::vector<LogSink::ptr> _sinks;
 
     AsyncLooper::mode _mode;
+
+    size_t _staging_size;
+    std::chrono::milliseconds _staging_interval;
+
+    bool _deferred;
+
+    SharedBackend::ptr _backend;
+
+    LogLevel::value _drop_below;
+
+    SegmentPool::ptr _pool;
+
+    MemoryPolicy _memory;
 };
 inline LoggerBuilder::~LoggerBuilder() = default;
 
@@ -262,7 +731,9 @@ class LocalLoggerBuilder : public LoggerBuilder
             return std::make_shared<SyncLogger>(_logger_name, _lower_level, _formatter, _sinks);
         else if (_type == LoggerBuilder::LoggerType::LOGGER_ASYNC)
             return std::make_shared<AsyncLogger>(_logger_name, _lower_level, _formatter, _sinks,
-                                                 _mode);
+                                                 _mode, _staging_size, _staging_interval,
+                                                 _deferred, _backend, _drop_below, _pool,
+                                                 _memory);
         else
             throw std::runtime_error(
                 "Construct a logger that does not yet exist within LocalLoggerBuilder");
@@ -362,7 +833,9 @@ class GlobalLoggerBuilder : public LoggerBuilder
             logger = std::make_shared<SyncLogger>(_logger_name, _lower_level, _formatter, _sinks);
         else if (_type == LoggerBuilder::LoggerType::LOGGER_ASYNC)
             logger = std::make_shared<AsyncLogger>(_logger_name, _lower_level, _formatter, _sinks,
-                                                   _mode);
+                                                   _mode, _staging_size, _staging_interval,
+                                                   _deferred, _backend, _drop_below, _pool,
+                                                   _memory);
         else
             throw std::runtime_error(
                 "Construct a logger that does not yet exist within LocalLoggerBuilder");
@@ -4,77 +4,482 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "buffer.hpp"
+#include "ring.hpp"
 
 namespace windlog {
+
+/*
+    线程本地暂存区
+    每个业务线程在每个异步处理器上各有一个, 日志先攒在这里,
+    达到大小阈值, 时间阈值, 或者用户主动刷新时, 再一次性交给异步处理器
+    锁只在业务线程与异步线程(超时收取)之间竞争, 平时几乎无冲突
+*/
+class StagingBuffer
+{
+   public:
+    explicit StagingBuffer(size_t capacity) : _buff(capacity), _urgent(false) {}
+
+    std::mutex _mutex;
+    Buffer _buff;
+    std::chrono::steady_clock::time_point _first;  // 本批次第一条日志的暂存时间
+    bool _urgent;  // 发布被拒绝的数据中有紧急的日志, 下次发布时带上
+};
+
+class AsyncLooper;
+
+/*
+    多个异步处理器共享的后端
+    固定数量的异步线程服务任意多个处理器, 处理器不再各自创建线程, 缓冲区也按queue_size分配,
+    日志器很多时可以大幅减少线程与内存
+    1. 有数据(或者有刷新请求)的处理器排入就绪队列, 异步线程每次取出队首的处理器落地一批,
+       之后仍有数据则排到队尾, 多个日志器之间按批次轮转, 繁忙的日志器不会饿死其它日志器
+    2. 同一个处理器同一时刻只会由一个线程处理, 单个日志器内的顺序与落地方向的串行调用不变
+    3. 异步线程每隔tick检查一次各处理器的线程本地暂存区, 发布超时的暂存日志,
+       并把落地过数据之后已经空闲的处理器排入就绪队列, 发出IDLE, 同时推动片段池的收缩
+    处理器持有后端的引用, 后端在所有处理器销毁之后才会销毁
+*/
+class SharedBackend
+{
+    friend class AsyncLooper;
+
+   public:
+    using ptr = std::shared_ptr<SharedBackend>;
+
+    explicit SharedBackend(size_t threads = 1, size_t queue_size = 1024 * 1024,
+                           std::chrono::milliseconds tick = std::chrono::milliseconds(100))
+        : _queue_size(queue_size),
+          _tick(tick),
+          _last_tick(std::chrono::steady_clock::now()),
+          _stop(false)
+    {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+            _threads.emplace_back(&SharedBackend::workerEntry, this);
+    }
+
+    SharedBackend(const SharedBackend&) = delete;
+    SharedBackend& operator=(const SharedBackend&) = delete;
+
+    ~SharedBackend()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_all();
+        for (auto& thread : _threads) thread.join();
+    }
+
+    // 每个处理器的缓冲区大小
+    size_t queueSize() const { return _queue_size; }
+    size_t threadCount() const { return _threads.size(); }
+
+   private:
+    void attach(AsyncLooper* looper)
+    {
+        std::unique_lock<std::mutex> lock(_tick_mutex);
+        _loopers.push_back(looper);
+    }
+
+    // 调用者需保证处理器已经不在就绪队列中
+    void detach(AsyncLooper* looper)
+    {
+        std::unique_lock<std::mutex> lock(_tick_mutex);
+        _loopers.erase(std::remove(_loopers.begin(), _loopers.end(), looper), _loopers.end());
+    }
+
+    // 处理器排到就绪队列的队尾, 由处理器保证不会重复排队
+    void schedule(AsyncLooper* looper)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.push_back(looper);
+        }
+        _cond.notify_one();
+    }
+
+    void workerEntry();
+    void tickAll();
+
+    const size_t _queue_size;
+    const std::chrono::milliseconds _tick;
+    std::chrono::steady_clock::time_point _last_tick;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<AsyncLooper*> _ready;  // 就绪队列
+    bool _stop;
+
+    std::mutex _tick_mutex;  // 保护登记的处理器, 检查暂存区期间处理器不会被移除
+    std::vector<AsyncLooper*> _loopers;
+
+    std::vector<std::thread> _threads;
+};
+
 class AsyncLooper
 {
+    friend class SharedBackend;
+
+    // 为每个处理器分配唯一编号, 作为线程本地暂存区的索引
+    // 不使用this指针, 避免处理器销毁后地址被复用
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return ++id;
+    }
+
+    /*
+        生产与消费缓冲区的初始大小
+        环形缓冲区模式不使用生产缓冲区, 消费缓冲区只用来接收从环中取出的一批记录,
+        从较小的容量开始, 按实际的批次大小扩容
+    */
+    static size_t bufferSize(bool ring, const SharedBackend::ptr& backend, bool consumer)
+    {
+        if (ring)
+            return consumer ? 64 * 1024 : 0;
+        return backend ? backend->queueSize() : BUFFER_SIZE;
+    }
+
+    // 缓冲区先按不指定节点分配, CONSUMER_NODE由异步线程启动后重新分配
+    static MemoryPolicy initialMemory(const MemoryPolicy& memory)
+    {
+        if (memory._node == MemoryPolicy::CONSUMER_NODE)
+            return MemoryPolicy(memory._pages);
+        return memory;
+    }
+
+    // 异步线程启动后, 在自己所在的NUMA节点上重新分配两块缓冲区
+    // 业务线程此前已经写入的数据一并搬过去
+    void placeBuffers()
+    {
+        MemoryPolicy local(_memory._pages, MemoryPolicy::currentNode());
+        Buffer produc(_produc_buff.capacity(), local);
+        Buffer consum(_consum_buff.capacity(), local);
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_produc_buff.empty())
+            produc.push(_produc_buff.readAbleBegin(), _produc_buff.readAbleSize());
+        _produc_buff.swap(produc);
+        _consum_buff.swap(consum);
+    }
+
     // 异步线程入口函数
     void thredEntry()
     {
+        if (_memory._node == MemoryPolicy::CONSUMER_NODE)
+            placeBuffers();
+
         // 在回调函数之上增加线程安全逻辑
-        while (!_stop)
+        while (true)
         {
+            unsigned flags;
+            uint64_t req;
+
+            // 收取超时未发布的暂存区
+            if (_staging_size > 0)
+                drainStaging(false);
+
             {
                 std::unique_lock<std::mutex> lock(_mutex);
-                // 生产者无数据则进入休眠状态, 或者退出标记位被设置
-                _cond_con.wait(lock, [&]() { return _stop || (!_produc_buff.empty()); });
+                // 生产者无数据则进入休眠状态, 或者退出标记位被设置, 或者有刷新请求
+                // 开启暂存时需要定期醒来检查暂存区, 落地过数据后还要醒来检查是否已经空闲,
+                // 片段池尚未收缩完时也要醒来推动
+                auto ready = [&]() {
+                    return _stop || hasWork();
+                };
+                if (timedWait())
+                    _cond_con.wait_for(lock, waitTimeout(), ready);
+                else
+                    _cond_con.wait(lock, ready);
 
-                // 交换数据
+                // 退出前确保生产缓冲区中的数据已经落地
+                if (_stop && _produc_buff.empty() && _produc_chain.empty())
+                    break;
+
+                // 交换数据, 同时取走这批数据附带的标记
                 _consum_buff.swap(_produc_buff);
+                _consum_chain.swap(_produc_chain);
+                flags = takeFlags(req);
+                flags |= trackIdle(!_consum_buff.empty() || !_consum_chain.empty(), flags);
 
                 // 唤醒生产者(可能因为满了而阻塞, 没阻塞也没影响)
-                _cond_pro.notify_one();
+                // 等待条件不止一种, 只唤醒一个可能唤醒的是仍然无法继续的生产者
+                _cond_pro.notify_all();
             }
 
             // 日志数据落地
-            _call_back(_consum_buff);
+            consume(flags, req);
+        }
+        finishFlush(_flush_req.load());
+    }
+
+    // 落地交换来的一批数据, 之后复位等待下次交换, 片段还给池
+    void consume(unsigned flags, uint64_t req)
+    {
+        if (!_consum_buff.empty() || !_consum_chain.empty() || flags != 0)
+            _call_back(_consum_buff, _consum_chain, flags);
+        if (flags & FLUSH)
+            finishFlush(req);
+        _consum_buff.reset();
+        resetChain();
+    }
+
+    // 片段还给池, 之后推动池的收缩
+    void resetChain()
+    {
+        if (!_consum_chain.empty())
+        {
+            _consum_chain.reset();
+            _trim_pending = true;
+        }
+        trimPool();
+    }
+
+    // 池只在归还片段时顺便收缩, 片段都已归还之后由异步线程在之后的醒来中继续推动,
+    // 直到没有超出常驻内存的缓存
+    void trimPool()
+    {
+        if (_trim_pending)
+            _trim_pending = _pool->trim();
+    }
+
+    // 共享后端的线程调用, 落地一批数据; 之后仍有工作则重新排队, 否则标记为空闲
+    void runBatch()
+    {
+        unsigned flags;
+        uint64_t req;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _consum_buff.swap(_produc_buff);
+            _consum_chain.swap(_produc_chain);
+            flags = takeFlags(req);
+            flags |= trackIdle(!_consum_buff.empty() || !_consum_chain.empty(), flags);
+            _cond_pro.notify_all();
+        }
+
+        consume(flags, req);
 
-            // 复位等待交换
-            _consum_buff.reset();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (hasWork())
+        {
+            _backend->schedule(this);
+            return;
         }
+        _queued = false;
+        // 在锁内通知, 等待者在本线程释放锁之前无法销毁处理器
+        _cond_flush.notify_all();
     }
 
-   public:
-    // 缓冲区满时的处理策略
-    enum class mode
+    bool hasWork()
     {
-        ON_BUFFER_FULL_BLOCK,  // 当缓冲区满时阻塞, 直至其重新可写
-        ON_BUFFER_FULL_EXPAND  // 当缓冲区满时扩容, 有资源过量风险
-    };
+        return !_produc_buff.empty() || !_produc_chain.empty() || _urgent || flushPending();
+    }
 
-    using ptr = std::shared_ptr<AsyncLooper>;
-    using Functor = std::function<void(Buffer&)>;
+    /*
+        记录最近一次落地数据的时间, 之后空闲满IDLE_TIMEOUT时返回IDLE, 每次空闲只返回一次
+        delivered表示这一批有数据; 已经带有其它标记的批次不算空闲
+        只由正在落地的一方调用(共享后端模式下持有_mutex)
+    */
+    unsigned trackIdle(bool delivered, unsigned flags)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (delivered)
+        {
+            _dirty = true;
+            _last_batch = now;
+            return 0;
+        }
+        if (flags != 0 || !_dirty || now - _last_batch < IDLE_TIMEOUT)
+            return 0;
+        _dirty = false;
+        return IDLE;
+    }
 
-    // 默认使用 ON_BUFFER_FULL_BLOCK
-    AsyncLooper(const Functor& call_back, mode strategy)
-        : _stop(false),
-          _strategy(strategy),
-          _call_back(call_back),
-          _thread(&AsyncLooper::thredEntry, this)
+    // 异步线程是否需要定时醒来, 以及等待的超时时间
+    bool timedWait() const { return _staging_size > 0 || _dirty || _trim_pending; }
+    std::chrono::milliseconds waitTimeout() const
     {
+        if (_staging_size == 0)
+            return IDLE_TIMEOUT;
+        return _dirty || _trim_pending ? std::min(_staging_interval, IDLE_TIMEOUT)
+                                       : _staging_interval;
     }
-    ~AsyncLooper() { stop(); }
 
-    // 停止异步线程工作
-    void stop()
+    // 共享后端的tick调用, 空闲满IDLE_TIMEOUT的处理器排入就绪队列, 由runBatch发出IDLE
+    void scheduleIdle()
     {
-        // 标记位设置
-        _stop = true;
-        // 唤醒所有异步线程, 令其退出
-        _cond_con.notify_all();
-        // 与异步线程会和
-        _thread.join();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_dirty && !_queued && !_stop &&
+            std::chrono::steady_clock::now() - _last_batch >= IDLE_TIMEOUT)
+            wakeConsumer();
+    }
+
+    // 通知消费者有新的工作, 调用者需持有_mutex
+    void wakeConsumer()
+    {
+        if (!_backend)
+        {
+            _cond_con.notify_one();
+        }
+        else if (!_queued)
+        {
+            _queued = true;
+            _backend->schedule(this);
+        }
+    }
+
+    // 无锁环形缓冲区模式下的异步线程入口函数
+    void ringEntry()
+    {
+        if (_memory._node == MemoryPolicy::CONSUMER_NODE)
+            placeBuffers();
+
+        while (true)
+        {
+            if (_staging_size > 0)
+                drainStaging(false);
+
+            // 标记要在取数据之前读取, 保证设置标记之前提交的记录都在这一批中
+            uint64_t req;
+            unsigned flags = takeFlags(req);
+
+            // 先取走放不进环的记录, 再取环中的记录; 它之前提交的记录此时都已经在环中
+            uint64_t spilled = 0;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (!_produc_chain.empty())
+                {
+                    _consum_chain.swap(_produc_chain);
+                    spilled = _spill_seq;
+                }
+            }
+
+            // 取出所有已提交的记录, 批量落地
+            size_t popped = _ring->popTo(_consum_buff);
+            flags |= trackIdle(popped > 0 || spilled > 0, flags);
+            if (popped > 0 || flags != 0 || spilled > 0)
+            {
+                _call_back(_consum_buff, _consum_chain, flags);
+                _consum_buff.reset();
+                resetChain();
+                if (spilled > 0)
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _spill_done = spilled;
+                    _cond_pro.notify_all();
+                }
+                if (flags & FLUSH)
+                    finishFlush(req);
+                continue;
+            }
+
+            // 退出前已经把环中的数据取尽
+            if (_stop)
+                break;
+
+            trimPool();
+
+            // 无数据则休眠, 标记位与生产者的提交构成一对Dekker式同步,
+            // 双方都使用全序栅栏, 保证至少有一方能看到另一方的写入
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!_ring->readable() && _produc_chain.empty() && !_stop && !_urgent &&
+                !flushPending())
+            {
+                if (timedWait())
+                    _cond_con.wait_for(lock, waitTimeout());
+                else
+                    _cond_con.wait(lock);
+            }
+            _sleeping.store(false, std::memory_order_relaxed);
+        }
+        finishFlush(_flush_req.load());
+    }
+
+    bool flushPending() const { return _flush_req.load() > _flush_done.load(); }
+
+    // 取走当前的标记, req带回此时的刷新请求序号
+    unsigned takeFlags(uint64_t& req)
+    {
+        unsigned flags = _urgent.exchange(false) ? URGENT : 0;
+        req = _flush_req.load();
+        if (req > _flush_done.load())
+            flags |= FLUSH;
+        return flags;
+    }
+
+    // 序号不超过req的刷新请求都已完成
+    void finishFlush(uint64_t req)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (req > _flush_done.load())
+                _flush_done.store(req);
+        }
+        _cond_flush.notify_all();
+    }
+
+    // 环形缓冲区模式下的生产逻辑, 不加锁
+    void ringPush(const char* data, size_t len, bool urgent)
+    {
+        if (!_ring->fits(len))
+        {
+            ringSpill(data, len, urgent);
+            return;
+        }
+
+        // 环满时让出CPU, 等待消费者腾出空间
+        while (!_ring->tryPush(data, len))
+        {
+            std::this_thread::yield();
+        }
+        // 在记录提交之后设置, 消费者看到标记时一定也能取到这条记录
+        if (urgent)
+            _urgent.store(true);
+
+        // 仅在消费者休眠时才需要加锁唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_relaxed))
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond_con.notify_one();
+        }
     }
 
-    void push(const char* data, size_t len)
+    /*
+        比整个环还大的记录放进片段链, 由异步线程排在此前提交的记录之后落地
+        本线程等到它落地之后才返回, 之后提交的记录因此不会排到它前面
+    */
+    void ringSpill(const char* data, size_t len, bool urgent)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond_pro.wait(lock, [&]() { return _produc_chain.empty(); });
+        _produc_chain.push(data, len);
+        uint64_t seq = ++_spill_seq;
+        if (urgent)
+            _urgent.store(true);
+        _cond_con.notify_one();
+        _cond_pro.wait(lock, [&]() { return _spill_done >= seq; });
+    }
+
+    /*
+        真正写入处理器的逻辑, urgent表示数据中有需要尽快持久化的日志
+        ON_BUFFER_FULL_DROP模式下, droppable的数据在缓冲区放不下时直接丢弃并返回false,
+        不可丢弃的数据与ON_BUFFER_FULL_BLOCK一样等待
+    */
+    bool pushNow(const char* data, size_t len, bool urgent, bool droppable)
     {
         /*
             存在两种方式,
@@ -85,40 +490,457 @@ class AsyncLooper
             所以之前说, buff是由外部控制阻塞行为的
         */
 
+        if (_strategy == mode::LOCK_FREE_RING)
+        {
+            ringPush(data, len, urgent);
+            return true;
+        }
+
         // 1. 加锁, 确保异步线程不干扰输入过程
         //          也可以确保外界logger的线程安全
         std::unique_lock<std::mutex> lock(_mutex);
 
-        if (_strategy == mode::ON_BUFFER_FULL_BLOCK)
+        if (_strategy == mode::ON_BUFFER_FULL_DROP && droppable &&
+            (!_produc_chain.empty() || _produc_buff.writeAbleSize() < len))
+            return false;
+
+        if (_strategy == mode::ON_BUFFER_FULL_BLOCK || _strategy == mode::ON_BUFFER_FULL_DROP)
         {
+            if (len > _produc_buff.capacity())
+            {
+                spillLocked(lock, data, len, urgent);
+                return true;
+            }
             // 缓冲区满了进入阻塞队列, 在异步线程结束工作后将其唤醒
-            _cond_pro.wait(lock, [&]() { return _produc_buff.writeAbleSize() >= len; });
+            // 已有超大消息在等待交换时, 之后的数据也要等待, 以免排到它前面
+            _cond_pro.wait(lock, [&]() {
+                return _produc_chain.empty() && _produc_buff.writeAbleSize() >= len;
+            });
+        }
+
+        // 扩容模式下放不下的数据接到片段链上, 已有的数据不搬移; 之后的数据也接在链上以保持顺序
+        // 片段池超出预算时退化为阻塞, 等待异步线程取走已有的数据
+        bool chained = false;
+        if (_strategy == mode::ON_BUFFER_FULL_EXPAND)
+        {
+            while (!_produc_chain.empty() || _produc_buff.writeAbleSize() < len)
+            {
+                if (_produc_chain.push(data, len, false))
+                {
+                    chained = true;
+                    break;
+                }
+                if (len > _produc_buff.capacity())
+                {
+                    spillLocked(lock, data, len, urgent);
+                    return true;
+                }
+                _cond_pro.wait(lock);
+            }
         }
 
         // 缓冲区现在可以输入数据
-        _produc_buff.push(data, len);
+        if (!chained)
+            _produc_buff.push(data, len);
+        if (urgent)
+            _urgent.store(true);
 
         // 唤醒一个消费者进行数据处理
-        _cond_con.notify_one();
+        wakeConsumer();
+        return true;
+    }
+
+    /*
+        比整个生产缓冲区还大的消息永远等不到足够的空间, 单独放进片段链中一个刚好放得下的片段,
+        挂在生产缓冲区之后, 异步线程交换时一并取走, 落地完即释放
+        同一时刻只挂一条, 在它被取走之前, 其它数据都要等待, 因此顺序不变;
+        正常大小的消息只多检查一次片段链是否为空
+    */
+    void spillLocked(std::unique_lock<std::mutex>& lock, const char* data, size_t len,
+                     bool urgent)
+    {
+        _cond_pro.wait(lock, [&]() { return _produc_chain.empty(); });
+        _produc_chain.push(data, len);
+        if (urgent)
+            _urgent.store(true);
+        wakeConsumer();
+    }
+
+    /*
+        异步线程收取暂存区时使用的写入, 从不等待
+        此时缓冲区中的空间只有异步线程自己才能腾出, 放不下就返回false, 数据留在暂存区中下次再试
+    */
+    bool offer(const char* data, size_t len, bool urgent)
+    {
+        if (_strategy == mode::LOCK_FREE_RING)
+        {
+            if (_ring->fits(len))
+            {
+                if (!_ring->tryPush(data, len))
+                    return false;
+            }
+            else
+            {
+                // 异步线程下一轮就会取走, 不能像ringSpill那样等待它落地
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (!_produc_chain.empty())
+                    return false;
+                _produc_chain.push(data, len);
+                ++_spill_seq;
+            }
+            if (urgent)
+                _urgent.store(true);
+            return true;
+        }
+
+        // 与pushNow的顺序规则相同: 片段链不为空时, 只有扩容模式可以继续接在链上
+        std::unique_lock<std::mutex> lock(_mutex);
+        bool chain_free = _produc_chain.empty();
+        if (chain_free && _produc_buff.writeAbleSize() >= len)
+        {
+            _produc_buff.push(data, len);
+        }
+        else if (!(_strategy == mode::ON_BUFFER_FULL_EXPAND &&
+                   _produc_chain.push(data, len, false)))
+        {
+            // 超大消息在片段链空闲时直接挂上, 其余情况等异步线程腾出空间后再试
+            if (!chain_free || len <= _produc_buff.capacity())
+                return false;
+            _produc_chain.push(data, len);
+        }
+
+        if (urgent)
+            _urgent.store(true);
+        wakeConsumer();
+        return true;
+    }
+
+    // 获取当前线程在本处理器上的暂存区, 首次使用时创建并登记
+    StagingBuffer& localStaging()
+    {
+        thread_local std::unordered_map<uint64_t, std::shared_ptr<StagingBuffer>> stagings;
+
+        auto it = stagings.find(_id);
+        if (it != stagings.end())
+            return *it->second;
+
+        // 顺便清理已销毁处理器遗留的暂存区(处理器释放后只剩本线程持有)
+        for (auto iter = stagings.begin(); iter != stagings.end();)
+        {
+            if (iter->second.use_count() == 1)
+                iter = stagings.erase(iter);
+            else
+                ++iter;
+        }
+
+        auto staging = std::make_shared<StagingBuffer>(_staging_size * 2);
+        {
+            std::unique_lock<std::mutex> lock(_staging_mutex);
+            _stagings.push_back(staging);
+        }
+        stagings.emplace(_id, staging);
+        return *staging;
+    }
+
+    // 将暂存区整批交给处理器, 调用者需持有暂存区的锁
+    // 处理器放不下而被拒绝时, 数据留在暂存区中等待下次发布
+    // wait为false时不等待缓冲区腾出空间, 供异步线程调用
+    void publish(StagingBuffer& staging, bool urgent = false, bool droppable = false,
+                 bool wait = true)
+    {
+        if (staging._buff.empty())
+            return;
+        urgent = urgent || staging._urgent;
+        const char* data = staging._buff.readAbleBegin();
+        size_t len = staging._buff.readAbleSize();
+        if (wait ? pushNow(data, len, urgent, droppable) : offer(data, len, urgent))
+        {
+            staging._buff.reset();
+            staging._urgent = false;
+        }
+        else
+        {
+            staging._urgent = urgent;
+        }
+    }
+
+    // 紧急的日志不等待阈值, 连同之前暂存的日志立即发布
+    // ON_BUFFER_FULL_DROP模式下暂存区也积满时丢弃可丢弃的日志, 返回false
+    bool stage(const char* data, size_t len, bool urgent, bool droppable)
+    {
+        StagingBuffer& staging = localStaging();
+        std::unique_lock<std::mutex> lock(staging._mutex);
+
+        if (_strategy == mode::ON_BUFFER_FULL_DROP && droppable &&
+            staging._buff.readAbleSize() + len > staging._buff.capacity())
+        {
+            publish(staging, false, true);
+            if (staging._buff.readAbleSize() + len > staging._buff.capacity())
+                return false;
+        }
 
-        auto c = !_produc_buff.empty();
+        if (staging._buff.empty())
+            staging._first = std::chrono::steady_clock::now();
+        staging._buff.push(data, len);
+
+        // 达到大小阈值, 整批发布
+        if (urgent || staging._buff.readAbleSize() >= _staging_size)
+            publish(staging, urgent, droppable);
+        return true;
+    }
+
+    // 发布所有暂存区, force为false时只发布超过时间阈值的
+    // 异步线程调用时使用try_lock, 因为暂存区的持有者可能正阻塞等待异步线程腾出空间;
+    // 同样的原因, 发布时也不等待缓冲区腾出空间
+    void drainStaging(bool force)
+    {
+        std::vector<std::shared_ptr<StagingBuffer>> stagings;
+        {
+            std::unique_lock<std::mutex> lock(_staging_mutex);
+            stagings = _stagings;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& staging : stagings)
+        {
+            std::unique_lock<std::mutex> lock(staging->_mutex, std::defer_lock);
+            if (force)
+                lock.lock();
+            else if (!lock.try_lock())
+                continue;
+
+            // 引用只剩登记表与这里时, 说明所属线程已经退出, 不会再有新日志
+            bool orphan = staging.use_count() == 2;
+            if (force || orphan || now - staging->_first >= _staging_interval)
+                publish(*staging, false, !force, force);
+        }
+        stagings.clear();
+
+        // 移除已退出线程的暂存区
+        std::unique_lock<std::mutex> lock(_staging_mutex);
+        _stagings.erase(std::remove_if(_stagings.begin(), _stagings.end(),
+                                       [](const std::shared_ptr<StagingBuffer>& staging) {
+                                           return staging.use_count() == 1 &&
+                                                  staging->_buff.empty();
+                                       }),
+                        _stagings.end());
+    }
+
+   public:
+    // 缓冲区满时的处理策略
+    enum class mode
+    {
+        ON_BUFFER_FULL_BLOCK,   // 当缓冲区满时阻塞, 直至其重新可写
+        ON_BUFFER_FULL_EXPAND,  // 当缓冲区满时扩容, 有资源过量风险
+        LOCK_FREE_RING,         // 无锁环形缓冲区, 生产者不加锁, 满时让出CPU重试
+        ON_BUFFER_FULL_DROP     // 当缓冲区满时丢弃可丢弃的数据, 生产者从不等待
+    };
+
+    using ptr = std::shared_ptr<AsyncLooper>;
+    /*
+        回调函数收到一批数据与这批数据附带的标记
+        一批数据由缓冲区与紧随其后的片段链组成, 片段链中是扩容模式下放不下的数据,
+        以及超过缓冲区容量的单条消息, 通常为空
+        1. URGENT: 这批数据中有紧急的日志
+        2. FLUSH: 有线程在等待刷新, 回调返回即视为刷新完成
+        3. IDLE: 上次落地数据之后已经空闲了IDLE_TIMEOUT, 这一批没有数据;
+           按时间间隔持久化的落地方向据此同步剩余的数据
+        带有标记时即使没有数据也会调用回调
+    */
+    using Functor = std::function<void(Buffer&, BufferChain&, unsigned)>;
+    static constexpr unsigned URGENT = 1;
+    static constexpr unsigned FLUSH = 2;
+    static constexpr unsigned IDLE = 4;
+    static constexpr std::chrono::milliseconds IDLE_TIMEOUT = std::chrono::milliseconds(100);
+
+    /*
+        默认使用 ON_BUFFER_FULL_BLOCK
+        staging_size为零表示不使用线程本地暂存区
+        指定backend时由共享后端的线程落地, 不创建自己的线程;
+        LOCK_FREE_RING模式的生产者不加锁, 无法通知共享后端, 仍然使用自己的线程
+        片段链从pool中取片段, 未指定时使用进程内共用的SegmentPool::global()
+        memory决定两块缓冲区的分配方式(大页, NUMA节点); 共享后端的线程不固定,
+        CONSUMER_NODE在共享后端模式下等同于不指定节点
+    */
+    AsyncLooper(const Functor& call_back, mode strategy, size_t staging_size = 0,
+                std::chrono::milliseconds staging_interval = std::chrono::milliseconds(100),
+                SharedBackend::ptr backend = nullptr, SegmentPool::ptr pool = nullptr,
+                const MemoryPolicy& memory = MemoryPolicy())
+        : _stop(false),
+          _sleeping(false),
+          _urgent(false),
+          _flush_req(0),
+          _flush_done(0),
+          _strategy(strategy),
+          _call_back(call_back),
+          _backend(strategy == mode::LOCK_FREE_RING ? nullptr : std::move(backend)),
+          _queued(false),
+          _memory(memory),
+          _produc_buff(bufferSize(strategy == mode::LOCK_FREE_RING, _backend, false),
+                       initialMemory(memory)),
+          _consum_buff(bufferSize(strategy == mode::LOCK_FREE_RING, _backend, true),
+                       initialMemory(memory)),
+          _pool(pool ? std::move(pool) : SegmentPool::global()),
+          _produc_chain(_pool),
+          _consum_chain(_pool),
+          _spill_seq(0),
+          _spill_done(0),
+          _dirty(false),
+          _trim_pending(false),
+          _ring(strategy == mode::LOCK_FREE_RING ? std::make_unique<RingBuffer>() : nullptr),
+          _id(nextId()),
+          _staging_size(staging_size),
+          _staging_interval(staging_interval)
+    {
+        if (_backend)
+            _backend->attach(this);
+        else
+            _thread = std::thread(strategy == mode::LOCK_FREE_RING ? &AsyncLooper::ringEntry
+                                                                   : &AsyncLooper::thredEntry,
+                                  this);
+    }
+    ~AsyncLooper() { stop(); }
+
+    // 停止异步线程工作
+    void stop()
+    {
+        // 暂存区中的日志也要落地
+        if (_staging_size > 0)
+            drainStaging(true);
+
+        // 共享后端模式下等待剩余的数据落地, 且不再排在就绪队列中
+        if (_backend)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stop = true;
+                if (hasWork())
+                    wakeConsumer();
+                _cond_flush.wait(lock, [&]() { return !_queued; });
+            }
+            _backend->detach(this);
+            return;
+        }
+
+        // 标记位设置, 加锁是为了避免异步线程在检查标记位之后, 进入休眠之前错过唤醒
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        // 唤醒所有异步线程, 令其退出
+        _cond_con.notify_all();
+        // 与异步线程会和
+        _thread.join();
+    }
+
+    // 返回false表示数据在ON_BUFFER_FULL_DROP模式下被丢弃
+    bool push(const char* data, size_t len, bool urgent = false, bool droppable = true)
+    {
+        if (_staging_size > 0)
+            return stage(data, len, urgent, droppable);
+        return pushNow(data, len, urgent, droppable);
+    }
+
+    /*
+        立即发布所有线程的暂存区, 并等待异步线程处理完此前提交的全部数据
+        回调函数在异步线程上以FLUSH标记调用, 落地方向的刷新因此不会与写入并发
+    */
+    void flush()
+    {
+        if (_staging_size > 0)
+            drainStaging(true);
+
+        uint64_t seq = ++_flush_req;
+        std::unique_lock<std::mutex> lock(_mutex);
+        wakeConsumer();
+        _cond_flush.wait(lock, [&]() { return _stop || _flush_done.load() >= seq; });
     }
 
    private:
     // 判断异步线程是否继续的标记位
     // 临界资源, 使用原子化操作
     std::atomic<bool> _stop;
+    std::atomic<bool> _sleeping;  // 环形缓冲区模式下, 异步线程是否处于休眠
+    std::atomic<bool> _urgent;    // 尚未交给回调的数据中有紧急的日志
+    std::atomic<uint64_t> _flush_req;   // 最新的刷新请求序号
+    std::atomic<uint64_t> _flush_done;  // 已经完成的刷新请求序号
     mode _strategy;
 
     std::mutex _mutex;
     const Functor _call_back;
 
-    Buffer _produc_buff;  // 生产缓冲区
-    Buffer _consum_buff;  // 消费缓冲区
+    SharedBackend::ptr _backend;  // 为空时使用自己的线程
+    bool _queued;                 // 共享后端模式下, 是否在就绪队列中或者正被处理
+
+    const MemoryPolicy _memory;  // 生产与消费缓冲区的分配策略
+    Buffer _produc_buff;         // 生产缓冲区
+    Buffer _consum_buff;         // 消费缓冲区
+    SegmentPool::ptr _pool;
+    BufferChain _produc_chain;  // 接在生产缓冲区之后的片段链
+    BufferChain _consum_chain;  // 接在消费缓冲区之后的片段链
+    uint64_t _spill_seq;        // 环形缓冲区模式下, 放进片段链的记录序号
+    uint64_t _spill_done;       // 已经落地的最大序号
+    bool _dirty;                // 落地过数据, 之后还没有发出IDLE
+    bool _trim_pending;         // 片段池中还有超出常驻内存的缓存, 需要继续推动收缩
+    std::chrono::steady_clock::time_point _last_batch;  // 最近一次落地数据的时间
+
+    std::unique_ptr<RingBuffer> _ring;  // 仅在LOCK_FREE_RING模式下创建
+
+    const uint64_t _id;
+    const size_t _staging_size;                        // 暂存区发布的大小阈值
+    const std::chrono::milliseconds _staging_interval;  // 暂存区发布的时间阈值
+    std::mutex _staging_mutex;                          // 保护暂存区登记表
+    std::vector<std::shared_ptr<StagingBuffer>> _stagings;
 
     std::condition_variable _cond_pro;
     std::condition_variable _cond_con;
+    std::condition_variable _cond_flush;
 
     std::thread _thread;
 };
-}  // namespace windlog
\ No newline at end of file
+
+inline void SharedBackend::workerEntry()
+{
+    while (true)
+    {
+        AsyncLooper* looper = nullptr;
+        bool tick = false;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait_for(lock, _tick, [&]() { return _stop || !_ready.empty(); });
+            if (_stop && _ready.empty())
+                break;
+            if (!_ready.empty())
+            {
+                looper = _ready.front();
+                _ready.pop_front();
+            }
+            // 同一时刻只需要一个线程检查暂存区
+            auto now = std::chrono::steady_clock::now();
+            if (now - _last_tick >= _tick)
+            {
+                _last_tick = now;
+                tick = true;
+            }
+        }
+
+        if (looper != nullptr)
+            looper->runBatch();
+        if (tick)
+            tickAll();
+    }
+}
+
+// 在异步线程上运行, 收取暂存区时不等待缓冲区腾出空间, 否则会等待只有自己才能腾出的空间
+inline void SharedBackend::tickAll()
+{
+    std::unique_lock<std::mutex> lock(_tick_mutex);
+    for (auto looper : _loopers)
+    {
+        if (looper->_staging_size > 0)
+            looper->drainStaging(false);
+        looper->scheduleIdle();
+        looper->_pool->trim();
+    }
+}
+}  // namespace windlog
@@ -2,7 +2,10 @@
 
 #include <sys/types.h>
 
-#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 #include <thread>
 
 #include "level.hpp"
@@ -10,26 +13,70 @@
 #include "util/time_util.hpp"
 
 namespace windlog {
+/*
+    日志消息只持有各字符串的视图, 不做拷贝
+    文件名指向调用点的__FILE__或调用者传入的路径, 日志器名称与日志器同生命周期,
+    主体信息指向格式化缓冲区, 所以消息只在本次日志调用(或本批记录的处理)期间有效
+*/
 struct LogMsg
 {
     time_t _ctime;
+    uint32_t _nsec;  // 秒以下的纳秒部分, 精度取决于时钟源
     LogLevel::value _level;
-    std::string _file;
+    std::string_view _file;
     size_t _line;
     std::thread::id _tid;
-    std::string _logger;
-    std::string _payload;
+    std::string_view _logger;
+    std::string_view _payload;
 
-    LogMsg(LogLevel::value level, const std::string& file, size_t line, const std::string& logger,
-           const std::string& payload)
-        : _ctime(util::Date::now()),
-          _level(level),
-          _file(util::file::basename(file)),
+    LogMsg() : _ctime(0), _nsec(0), _level(LogLevel::value::DEBUG), _line(0) {}
+
+    LogMsg(LogLevel::value level, std::string_view file, size_t line, std::string_view logger,
+           std::string_view payload)
+        : _level(level),
+          _file(util::file::basenameView(file)),
           _line(line),
           _tid(std::this_thread::get_id()),
           _logger(logger),
           _payload(payload)
     {
+        util::Date::now(_ctime, _nsec);
+    }
+
+    // 还原一条已经记录好时间与线程的日志, 用于异步线程上的延迟格式化
+    LogMsg(time_t ctime, uint32_t nsec, LogLevel::value level, std::string_view file,
+           size_t line, std::thread::id tid, std::string_view logger, std::string_view payload)
+        : _ctime(ctime),
+          _nsec(nsec),
+          _level(level),
+          _file(file),
+          _line(line),
+          _tid(tid),
+          _logger(logger),
+          _payload(payload)
+    {
+    }
+
+    /*
+        线程ID与定长整数之间的转换, 供记录头部与二进制日志保存线程ID
+        libstdc++中线程ID内部就是pthread_t, 可以直接由整数构造;
+        其它标准库实现按同样大小的内存布局拷贝
+    */
+    static uint64_t threadToInt(std::thread::id tid)
+    {
+        uint64_t value = 0;
+        memcpy(&value, &tid, std::min(sizeof(tid), sizeof(value)));
+        return value;
+    }
+    static std::thread::id intToThread(uint64_t value)
+    {
+#if defined(__GLIBCXX__)
+        return std::thread::id(static_cast<std::thread::native_handle_type>(value));
+#else
+        std::thread::id tid;
+        memcpy(static_cast<void*>(&tid), &value, std::min(sizeof(tid), sizeof(value)));
+        return tid;
+#endif
     }
 };
-}  // namespace windlog
\ No newline at end of file
+}  // namespace windlog
@@ -0,0 +1,190 @@
+/*
+    缓冲区的内存分配策略
+    1. 大页: 透明大页(madvise)或者显式大页(MAP_HUGETLB), 减少大块拷贝时的TLB缺失
+    2. NUMA: 把内存优先放在指定节点上, 例如异步线程所在的节点
+    直接使用系统调用, 不依赖libnuma; 显式大页不可用时退回透明大页,
+    节点绑定失败(单节点机器, 容器中禁用了mbind等)时保持内核默认的首次访问策略
+*/
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace windlog {
+
+struct MemoryPolicy
+{
+    enum class pages
+    {
+        NORMAL,
+        TRANSPARENT_HUGE,
+        EXPLICIT_HUGE
+    };
+
+    static constexpr int ANY_NODE = -1;
+    // 放在异步线程所在的节点上, 由异步线程启动后重新分配自己的缓冲区
+    static constexpr int CONSUMER_NODE = -2;
+
+    static MemoryPolicy normal(int node = ANY_NODE) { return MemoryPolicy(pages::NORMAL, node); }
+    static MemoryPolicy transparentHuge(int node = ANY_NODE)
+    {
+        return MemoryPolicy(pages::TRANSPARENT_HUGE, node);
+    }
+    static MemoryPolicy explicitHuge(int node = ANY_NODE)
+    {
+        return MemoryPolicy(pages::EXPLICIT_HUGE, node);
+    }
+
+    explicit MemoryPolicy(pages kind = pages::NORMAL, int node = ANY_NODE)
+        : _pages(kind), _node(node)
+    {
+    }
+
+    // 默认策略直接使用operator new, 与std::allocator相同
+    bool isDefault() const { return _pages == pages::NORMAL && _node < 0; }
+
+    // 调用线程当前所在的NUMA节点, 无法获取时返回ANY_NODE
+    static int currentNode()
+    {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+            return ANY_NODE;
+        return static_cast<int>(node);
+    }
+
+    bool operator==(const MemoryPolicy& other) const
+    {
+        return _pages == other._pages && _node == other._node;
+    }
+    bool operator!=(const MemoryPolicy& other) const { return !(*this == other); }
+
+    pages _pages;
+    int _node;
+};
+
+/*
+    按MemoryPolicy分配内存的分配器, 供Buffer的底层容器使用
+    非默认策略使用mmap分配, 大页按2MB取整并对齐, 之后在首次访问之前绑定节点
+    分配器随容器交换与移动, 释放时按同样的策略与长度归还
+*/
+template <typename T>
+class PageAllocator
+{
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static constexpr unsigned long MPOL_PREFERRED_MODE = 1;
+    static constexpr size_t MAX_NODES = 1024;
+
+    size_t mappedLength(size_t n) const
+    {
+        size_t align = _policy._pages == MemoryPolicy::pages::NORMAL
+                           ? static_cast<size_t>(sysconf(_SC_PAGESIZE))
+                           : HUGE_PAGE_SIZE;
+        return (n * sizeof(T) + align - 1) / align * align;
+    }
+
+    static void* mapAnonymous(size_t len, int extra_flags)
+    {
+        void* addr =
+            mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags,
+                 -1, 0);
+        return addr == MAP_FAILED ? nullptr : addr;
+    }
+
+    // 多映射一个大页, 截掉首尾, 得到按大页对齐的区域, 透明大页才能整页使用
+    static void* mapAligned(size_t len)
+    {
+        char* raw = static_cast<char*>(mapAnonymous(len + HUGE_PAGE_SIZE, 0));
+        if (raw == nullptr)
+            return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        char* aligned = reinterpret_cast<char*>((start + HUGE_PAGE_SIZE - 1) &
+                                                ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+        size_t head = aligned - raw;
+        if (head > 0)
+            munmap(raw, head);
+        munmap(aligned + len, HUGE_PAGE_SIZE - head);
+        return aligned;
+    }
+
+    // 失败时保持默认策略, 不影响分配结果
+    void bindNode(void* addr, size_t len) const
+    {
+        if (_policy._node < 0 || static_cast<size_t>(_policy._node) >= MAX_NODES)
+            return;
+        unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))] = {};
+        mask[_policy._node / (8 * sizeof(unsigned long))] =
+            1UL << (_policy._node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, addr, len, MPOL_PREFERRED_MODE, mask, MAX_NODES + 1, 0);
+    }
+
+   public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    explicit PageAllocator(const MemoryPolicy& policy = MemoryPolicy()) : _policy(policy) {}
+    template <typename U>
+    PageAllocator(const PageAllocator<U>& other) : _policy(other.policy())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (_policy.isDefault())
+            return std::allocator<T>().allocate(n);
+
+        size_t len = mappedLength(n);
+        void* addr = nullptr;
+        if (_policy._pages == MemoryPolicy::pages::EXPLICIT_HUGE)
+            addr = mapAnonymous(len, MAP_HUGETLB);
+        if (addr == nullptr && _policy._pages != MemoryPolicy::pages::NORMAL)
+        {
+            addr = mapAligned(len);
+            if (addr != nullptr)
+                madvise(addr, len, MADV_HUGEPAGE);
+        }
+        if (addr == nullptr)
+            addr = mapAnonymous(len, 0);
+        if (addr == nullptr)
+            throw std::bad_alloc();
+
+        bindNode(addr, len);
+        return static_cast<T*>(addr);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        if (_policy.isDefault())
+            std::allocator<T>().deallocate(ptr, n);
+        else
+            munmap(ptr, mappedLength(n));
+    }
+
+    const MemoryPolicy& policy() const { return _policy; }
+
+    template <typename U>
+    bool operator==(const PageAllocator<U>& other) const
+    {
+        return _policy == other.policy();
+    }
+    template <typename U>
+    bool operator!=(const PageAllocator<U>& other) const
+    {
+        return !(*this == other);
+    }
+
+   private:
+    MemoryPolicy _policy;
+};
+
+}  // namespace windlog
@@ -0,0 +1,469 @@
+/*
+    延迟格式化的日志记录
+    1. 业务线程只把日志等级, 时间, 文件行号, 线程ID, 格式化字符串以及参数
+       序列化成一段紧凑的二进制记录, 交给异步处理器
+    2. 异步线程拿到记录后再进行解码, 参数渲染与格式化
+    3. 参数依据printf格式化字符串逐项提取, 遇到无法安全延迟的占位符(%n, %m, 宽字符等)时
+       退化为在业务线程上直接渲染出主体信息
+*/
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "level.hpp"
+#include "message.hpp"
+
+namespace windlog {
+
+class LogRecord
+{
+    friend class BinaryLog;  // 二进制日志需要按参数类型重新打包参数区
+
+   public:
+    // 记录头部, 之后依次是文件名, 格式化字符串(均以'\0'结尾)和参数区
+    struct Header
+    {
+        uint32_t _size;  // 整条记录的字节数, 包含头部
+        uint32_t _line;
+        time_t _ctime;
+        uint64_t _tid;  // 线程ID, 按LogMsg::threadToInt转换
+        LogLevel::value _level;
+        uint16_t _file_len;
+        uint32_t _fmt_len;
+        uint32_t _nsec;  // 时间戳的纳秒部分, 放在末尾正好填补对齐空隙
+    };
+
+    // 解码后的记录, 字符串均指向记录内部
+    struct View
+    {
+        Header _header;
+        const char* _file;
+        const char* _fmt;
+        const char* _args;
+        size_t _args_len;
+    };
+
+   private:
+    // 参数类型标签
+    enum class ArgType : uint8_t
+    {
+        INT,
+        UINT,
+        DOUBLE,
+        LDOUBLE,
+        STRING,
+        POINTER
+    };
+
+    // 一个printf占位符的解析结果
+    struct Spec
+    {
+        const char* _begin;  // 指向'%'
+        const char* _end;    // 指向转换字符之后
+        int _stars;          // '*'形式的宽度/精度个数
+        int _precision;      // 数字形式的精度, -1表示未指定
+        bool _prec_star;     // 精度是否为'*'形式
+        char _length[3];     // 长度修饰符
+        char _conv;          // 转换字符
+    };
+
+    static bool parseSpec(const char* p, Spec& spec)
+    {
+        spec._begin = p++;
+        spec._stars = 0;
+        spec._precision = -1;
+        spec._prec_star = false;
+        memset(spec._length, 0, sizeof(spec._length));
+
+        while (*p && strchr("-+ #0'I", *p)) ++p;
+        if (*p == '*')
+            ++spec._stars, ++p;
+        else
+            while (*p >= '0' && *p <= '9') ++p;
+        if (*p == '.')
+        {
+            ++p;
+            if (*p == '*')
+                ++spec._stars, ++p, spec._prec_star = true;
+            else
+            {
+                spec._precision = 0;
+                while (*p >= '0' && *p <= '9')
+                    spec._precision = spec._precision * 10 + (*p++ - '0');
+            }
+        }
+
+        size_t n = 0;
+        while (*p && strchr("hlLqjzZt", *p))
+        {
+            if (n == sizeof(spec._length) - 1)
+                return false;
+            spec._length[n++] = *p++;
+        }
+
+        if (*p == '\0')
+            return false;
+        spec._conv = *p++;
+        spec._end = p;
+        return true;
+    }
+
+    template <typename T>
+    static void put(std::string& out, ArgType type, T value)
+    {
+        out.push_back(static_cast<char>(type));
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static T get(const char*& p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+    static int64_t signedArg(const Spec& spec, va_list* ap)
+    {
+        const char* l = spec._length;
+        if (!strcmp(l, "hh"))
+            return static_cast<signed char>(va_arg(*ap, int));
+        if (!strcmp(l, "h"))
+            return static_cast<short>(va_arg(*ap, int));
+        if (!strcmp(l, "l"))
+            return va_arg(*ap, long);
+        if (!strcmp(l, "ll") || !strcmp(l, "q"))
+            return va_arg(*ap, long long);
+        if (!strcmp(l, "j"))
+            return va_arg(*ap, intmax_t);
+        if (!strcmp(l, "z") || !strcmp(l, "Z"))
+            return va_arg(*ap, ssize_t);
+        if (!strcmp(l, "t"))
+            return va_arg(*ap, ptrdiff_t);
+        return va_arg(*ap, int);
+    }
+
+    static uint64_t unsignedArg(const Spec& spec, va_list* ap)
+    {
+        const char* l = spec._length;
+        if (!strcmp(l, "hh"))
+            return static_cast<unsigned char>(va_arg(*ap, unsigned int));
+        if (!strcmp(l, "h"))
+            return static_cast<unsigned short>(va_arg(*ap, unsigned int));
+        if (!strcmp(l, "l"))
+            return va_arg(*ap, unsigned long);
+        if (!strcmp(l, "ll") || !strcmp(l, "q"))
+            return va_arg(*ap, unsigned long long);
+        if (!strcmp(l, "j"))
+            return va_arg(*ap, uintmax_t);
+        if (!strcmp(l, "z") || !strcmp(l, "Z"))
+            return va_arg(*ap, size_t);
+        if (!strcmp(l, "t"))
+            return static_cast<uint64_t>(va_arg(*ap, ptrdiff_t));
+        return va_arg(*ap, unsigned int);
+    }
+
+    // 依据格式化字符串提取参数, 遇到不支持延迟的占位符时返回false
+    static bool encodeArgs(std::string& out, const char* fmt, va_list* ap)
+    {
+        Spec spec;
+        for (const char* p = fmt; *p;)
+        {
+            if (*p != '%')
+            {
+                ++p;
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                p += 2;
+                continue;
+            }
+            if (!parseSpec(p, spec))
+                return false;
+            p = spec._end;
+
+            int precision = spec._precision;
+            for (int i = 0; i < spec._stars; ++i)
+            {
+                int star = va_arg(*ap, int);
+                if (spec._prec_star && i == spec._stars - 1)
+                    precision = star;  // 负数精度等同于未指定
+                put<int64_t>(out, ArgType::INT, star);
+            }
+
+            switch (spec._conv)
+            {
+                case 'd':
+                case 'i':
+                    put<int64_t>(out, ArgType::INT, signedArg(spec, ap));
+                    break;
+                case 'o':
+                case 'u':
+                case 'x':
+                case 'X':
+                    put<uint64_t>(out, ArgType::UINT, unsignedArg(spec, ap));
+                    break;
+                case 'c':
+                    if (spec._length[0] != '\0')
+                        return false;
+                    put<int64_t>(out, ArgType::INT, va_arg(*ap, int));
+                    break;
+                case 'e':
+                case 'E':
+                case 'f':
+                case 'F':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    if (!strcmp(spec._length, "L"))
+                        put<long double>(out, ArgType::LDOUBLE, va_arg(*ap, long double));
+                    else
+                        put<double>(out, ArgType::DOUBLE, va_arg(*ap, double));
+                    break;
+                case 's':
+                {
+                    if (spec._length[0] != '\0')
+                        return false;
+                    const char* str = va_arg(*ap, const char*);
+                    if (str == nullptr)
+                        str = "(null)";
+                    // 带精度时参数不必以'\0'结尾, 只能读取精度范围内的字节
+                    uint32_t len = precision >= 0 ? strnlen(str, precision) : strlen(str);
+                    put<uint32_t>(out, ArgType::STRING, len);
+                    out.append(str, len);
+                    out.push_back('\0');
+                    break;
+                }
+                case 'p':
+                    put<uint64_t>(out, ArgType::POINTER,
+                                  reinterpret_cast<uintptr_t>(va_arg(*ap, void*)));
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // 以单个占位符渲染一个参数, stars是'*'对应的宽度与精度
+    template <typename T>
+    static void renderOne(std::string& out, const char* spec, const int* stars, int nstars,
+                          T value)
+    {
+        char tmp[128];
+        int n = 0;
+        auto print = [&](char* buf, size_t size) {
+            if (nstars == 0)
+                return snprintf(buf, size, spec, value);
+            if (nstars == 1)
+                return snprintf(buf, size, spec, stars[0], value);
+            return snprintf(buf, size, spec, stars[0], stars[1], value);
+        };
+
+        n = print(tmp, sizeof(tmp));
+        if (n < 0)
+            return;
+        if (static_cast<size_t>(n) < sizeof(tmp))
+        {
+            out.append(tmp, n);
+            return;
+        }
+        size_t old = out.size();
+        out.resize(old + n + 1);
+        print(&out[old], n + 1);
+        out.resize(old + n);
+    }
+
+    // 写入头部, 文件名与格式化字符串, 覆盖out中原有内容
+    static void begin(std::string& out, LogLevel::value level, std::string_view file,
+                      size_t line, const char* fmt, size_t fmt_len)
+    {
+        std::string_view base = util::file::basenameView(file);
+
+        Header header{};
+        header._line = line;
+        util::Date::now(header._ctime, header._nsec);
+        header._tid = LogMsg::threadToInt(std::this_thread::get_id());
+        header._level = level;
+        header._file_len = base.size();
+        header._fmt_len = fmt_len;
+
+        out.clear();
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.append(base.data(), base.size());
+        out.push_back('\0');
+        out.append(fmt, fmt_len);
+        out.push_back('\0');
+    }
+
+    // 回填记录总长度
+    static void finish(std::string& out)
+    {
+        uint32_t size = out.size();
+        memcpy(&out[0], &size, sizeof(size));
+    }
+
+   public:
+    // 将一次日志调用序列化为一条记录, 覆盖写入out
+    static void encode(std::string& out, LogLevel::value level, std::string_view file,
+                       size_t line, const char* fmt, va_list ap)
+    {
+        begin(out, level, file, line, fmt, strlen(fmt));
+
+        // va_list以指针形式传递, 避免不同平台上按值传递导致读取位置不同步
+        va_list args, backup;
+        va_copy(args, ap);
+        va_copy(backup, ap);
+        bool ok = encodeArgs(out, fmt, &args);
+        va_end(args);
+
+        if (ok)
+        {
+            va_end(backup);
+            finish(out);
+            return;
+        }
+
+        // 退化: 在当前线程渲染出主体信息
+        char* buff = nullptr;
+        int res = vasprintf(&buff, fmt, backup);
+        va_end(backup);
+        if (res == -1)
+            throw std::runtime_error("LogRecord failed to: vasprintf");
+        encodePayload(out, level, file, line, buff, res);
+        free(buff);
+    }
+
+    // 主体信息已经渲染好时, 作为"%s"的唯一参数序列化为一条记录
+    static void encodePayload(std::string& out, LogLevel::value level, std::string_view file,
+                              size_t line, const char* payload, size_t len)
+    {
+        begin(out, level, file, line, "%s", 2);
+        put<uint32_t>(out, ArgType::STRING, len);
+        out.append(payload, len);
+        out.push_back('\0');
+        finish(out);
+    }
+
+    // 从data处解码一条记录, len为剩余可读长度, 返回该记录的字节数
+    static size_t decode(const char* data, size_t len, View& view)
+    {
+        if (len < sizeof(Header))
+            throw std::runtime_error("LogRecord: truncated record header");
+        memcpy(&view._header, data, sizeof(Header));
+        if (view._header._size > len)
+            throw std::runtime_error("LogRecord: truncated record body");
+
+        view._file = data + sizeof(Header);
+        view._fmt = view._file + view._header._file_len + 1;
+        view._args = view._fmt + view._header._fmt_len + 1;
+        view._args_len = data + view._header._size - view._args;
+        return view._header._size;
+    }
+
+    // 依据格式化字符串与参数区渲染出主体信息, 追加到out
+    static void render(std::string& out, const View& view)
+    {
+        const char* args = view._args;
+        const char* fmt = view._fmt;
+        const char* lit = fmt;
+        Spec spec;
+
+        for (const char* p = fmt; *p;)
+        {
+            if (*p != '%')
+            {
+                ++p;
+                continue;
+            }
+            out.append(lit, p - lit);
+            if (p[1] == '%')
+            {
+                out.push_back('%');
+                p += 2;
+                lit = p;
+                continue;
+            }
+            parseSpec(p, spec);
+            p = lit = spec._end;
+
+            int stars[2];
+            for (int i = 0; i < spec._stars; ++i)
+            {
+                ++args;
+                stars[i] = get<int64_t>(args);
+            }
+
+            // 长度修饰符已经在编码时处理过, 重新拼接占位符时统一替换
+            char one[32];
+            size_t n = spec._end - spec._begin - 1 - strlen(spec._length);
+            if (n + 4 > sizeof(one))
+                n = sizeof(one) - 4;
+            memcpy(one, spec._begin, n);
+
+            ArgType type = static_cast<ArgType>(*args++);
+            switch (type)
+            {
+                case ArgType::INT:
+                    if (spec._conv != 'c')
+                        one[n++] = 'l', one[n++] = 'l';
+                    one[n++] = spec._conv, one[n] = '\0';
+                    if (spec._conv == 'c')
+                        renderOne(out, one, stars, spec._stars,
+                                  static_cast<int>(get<int64_t>(args)));
+                    else
+                        renderOne(out, one, stars, spec._stars,
+                                  static_cast<long long>(get<int64_t>(args)));
+                    break;
+                case ArgType::UINT:
+                    one[n++] = 'l', one[n++] = 'l', one[n++] = spec._conv, one[n] = '\0';
+                    renderOne(out, one, stars, spec._stars,
+                              static_cast<unsigned long long>(get<uint64_t>(args)));
+                    break;
+                case ArgType::DOUBLE:
+                    one[n++] = spec._conv, one[n] = '\0';
+                    renderOne(out, one, stars, spec._stars, get<double>(args));
+                    break;
+                case ArgType::LDOUBLE:
+                    one[n++] = 'L', one[n++] = spec._conv, one[n] = '\0';
+                    renderOne(out, one, stars, spec._stars, get<long double>(args));
+                    break;
+                case ArgType::STRING:
+                {
+                    uint32_t len = get<uint32_t>(args);
+                    // 最常见的"%s", 直接追加
+                    if (spec._end - spec._begin == 2)
+                        out.append(args, len);
+                    else
+                    {
+                        one[n++] = 's', one[n] = '\0';
+                        renderOne(out, one, stars, spec._stars, args);
+                    }
+                    args += len + 1;
+                    break;
+                }
+                case ArgType::POINTER:
+                    one[n++] = 'p', one[n] = '\0';
+                    renderOne(out, one, stars, spec._stars,
+                              reinterpret_cast<void*>(get<uint64_t>(args)));
+                    break;
+            }
+        }
+        out.append(lit);
+    }
+};
+}  // namespace windlog
@@ -0,0 +1,148 @@
+/*
+    实现无锁多生产者单消费者(MPSC)环形缓冲区
+    1. 生产者通过一次原子预留(CAS)拿到一段独占空间, 随后只做一次内存拷贝
+    2. 每条记录带有一个8字节的头部, 拷贝完成后以release语义写入长度, 即为提交
+    3. 消费者按顺序读取已提交的记录, 遇到尚未提交的记录就停下, 保证顺序
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "buffer.hpp"
+
+namespace windlog {
+
+class RingBuffer
+{
+    static constexpr size_t HEADER_SIZE = sizeof(uint64_t);
+
+    // 记录按8字节对齐, 这样头部永远不会被环尾截断
+    static size_t align(size_t len) { return (len + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1); }
+
+    static size_t roundUpPow2(size_t size)
+    {
+        size_t cap = HEADER_SIZE;
+        while (cap < size) cap <<= 1;
+        return cap;
+    }
+
+    uint64_t* headerAt(uint64_t pos) { return reinterpret_cast<uint64_t*>(&_base[pos & _mask]); }
+
+    // 带回绕的拷贝, 从环中off处开始
+    void copyIn(uint64_t pos, const char* data, size_t len)
+    {
+        size_t off = pos & _mask;
+        size_t first = std::min(len, _base.size() - off);
+        memcpy(&_base[off], data, first);
+        memcpy(&_base[0], data + first, len - first);
+    }
+
+    void copyOut(uint64_t pos, Buffer& out, size_t len)
+    {
+        size_t off = pos & _mask;
+        size_t first = std::min(len, _base.size() - off);
+        out.push(&_base[off], first);
+        if (len > first)
+            out.push(&_base[0], len - first);
+    }
+
+    // 消费完的区域必须清零, 否则旧数据可能被误认为是后续记录的头部
+    void clear(uint64_t from, uint64_t to)
+    {
+        size_t off = from & _mask;
+        size_t len = to - from;
+        size_t first = std::min(len, _base.size() - off);
+        memset(&_base[off], 0, first);
+        memset(&_base[0], 0, len - first);
+    }
+
+   public:
+    // 容量向上取整为2的幂, 以便用掩码代替取模
+    explicit RingBuffer(size_t capacity = BUFFER_SIZE)
+        : _base(roundUpPow2(capacity)), _mask(_base.size() - 1), _head(0), _tail(0)
+    {
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    size_t capacity() const { return _base.size(); }
+
+    // 判断一条记录能否放进环中, 放不下的记录需要调用者另行处理
+    bool fits(size_t len) const { return HEADER_SIZE + align(len) <= _base.size(); }
+
+    // 生产者接口, 可多线程并发调用
+    // 空间不足时返回false, 由调用者决定等待策略
+    bool tryPush(const char* data, size_t len)
+    {
+        if (len == 0)
+            return true;
+
+        size_t need = HEADER_SIZE + align(len);
+        if (need > _base.size())
+            throw std::runtime_error("RingBuffer: message larger than ring capacity");
+
+        // 1. 原子预留
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        do
+        {
+            uint64_t head = _head.load(std::memory_order_acquire);
+            if (tail + need - head > _base.size())
+                return false;
+        } while (!_tail.compare_exchange_weak(tail, tail + need, std::memory_order_relaxed));
+
+        // 2. 拷贝数据
+        copyIn(tail + HEADER_SIZE, data, len);
+
+        // 3. 提交, 写入长度即对消费者可见
+        __atomic_store_n(headerAt(tail), static_cast<uint64_t>(len), __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // 消费者接口, 仅允许单线程调用
+    // 将所有已提交的连续记录追加到out中, 返回取出的数据字节数
+    size_t popTo(Buffer& out)
+    {
+        uint64_t start = _head.load(std::memory_order_relaxed);
+        uint64_t head = start;
+        size_t total = 0;
+
+        while (head - start < _base.size())
+        {
+            uint64_t len = __atomic_load_n(headerAt(head), __ATOMIC_ACQUIRE);
+            if (len == 0)
+                break;
+            copyOut(head + HEADER_SIZE, out, len);
+            total += len;
+            head += HEADER_SIZE + align(len);
+        }
+
+        if (head != start)
+        {
+            clear(start, head);
+            _head.store(head, std::memory_order_release);
+        }
+        return total;
+    }
+
+    // 判断队首是否有已提交的记录, 仅消费者调用
+    bool readable()
+    {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        return __atomic_load_n(headerAt(head), __ATOMIC_ACQUIRE) != 0;
+    }
+
+   private:
+    std::vector<char> _base;  // 底层存储, 容量为2的幂
+    size_t _mask;
+
+    // 读写位置是单调递增的虚拟下标, 分处不同缓存行避免伪共享
+    alignas(64) std::atomic<uint64_t> _head;  // 消费者读位置
+    alignas(64) std::atomic<uint64_t> _tail;  // 生产者预留位置
+};
+}  // namespace windlog
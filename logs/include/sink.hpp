@@ -7,15 +7,42 @@
 
 #pragma once
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "archive.hpp"
+#include "binary.hpp"
+#include "buffer.hpp"
+#include "compress.hpp"
+#include "record.hpp"
+#include "uring.hpp"
 #include "util/file_util.hpp"
 #include "util/time_util.hpp"
 
@@ -26,10 +53,73 @@ class LogSink
     using ptr = std::shared_ptr<LogSink>;
     virtual ~LogSink() = 0;
     virtual void log(const char* data, size_t len) = 0;
+    // 一次落地多段数据, 默认逐段调用log, 能够聚集写入的落地方向可以重写
+    virtual void logv(const struct iovec* iov, int iovcnt)
+    {
+        for (int i = 0; i < iovcnt; ++i)
+            log(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+    /*
+        异步线程交来整块缓冲区, 默认按log处理
+        需要在写入完成前持有数据的落地方向可以与之交换内容, 换回一块已经写完的缓冲区,
+        省去拷贝; 换回的缓冲区已经重置, 容量不小于原来的容量
+        调用者在调用之后不能再使用buffer中的数据
+    */
+    virtual void logBuffer(Buffer& buffer)
+    {
+        log(buffer.readAbleBegin(), buffer.readAbleSize());
+    }
+    /*
+        一批日志落地完成, urgent表示这批日志中有ERROR及以上等级的日志
+        同步日志器每条日志之后调用一次, 异步日志器每次交换后调用一次,
+        需要持久化的落地方向在这里决定是否把数据同步到磁盘
+    */
+    virtual void commit(bool /*urgent*/) {}
+    /*
+        异步日志器落地过日志之后空闲了一段时间, 期间没有新的日志, 调用一次
+        按时间间隔持久化的落地方向在这里同步剩余的数据, 否则它们要等到下一批日志或者flush
+    */
+    virtual void idle() {}
     virtual void flush() = 0;
 };
 inline LogSink::~LogSink() = default;
 
+/*
+    落地失败的错误信息, 带有失败的操作, 文件名与errno
+*/
+class SinkError : public std::runtime_error
+{
+   public:
+    SinkError(const std::string& op, const std::string& filename, int code)
+        : std::runtime_error(op + " " + filename + ": " + strerror(code)),
+          _op(op),
+          _filename(filename),
+          _code(code)
+    {
+    }
+
+    const std::string& op() const { return _op; }
+    const std::string& filename() const { return _filename; }
+    int code() const { return _code; }
+
+   private:
+    std::string _op;
+    std::string _filename;
+    int _code;
+};
+
+/*
+    可以直接接收二进制记录的落地方向
+    延迟格式化的异步日志器会把LogRecord记录原样交给它, 省去异步线程上的格式化;
+    其它日志器仍然通过log交给它格式化好的文本
+*/
+class RecordSink : public LogSink
+{
+   public:
+    ~RecordSink() override = default;
+    virtual void logRecords(const std::string& logger, const char* data, size_t len) = 0;
+};
+
 /*
     落地方向: 标准输出
 */
@@ -80,6 +170,127 @@ class FileSink : public LogSink
     std::string _filename;
 };
 
+/*
+    落地方向: 二进制文件
+    格式见binary.hpp, 需要使用解码工具还原为文本
+    每次落地的一批数据写成一个独立的数据块, 块中用到的新编号定义写在块之前
+*/
+class BinarySink : public RecordSink
+{
+    // 编号表的键, 各字段以'\0'分隔拼接
+    void makeKey(LogLevel::value level, const std::string& logger, const LogRecord::View& view)
+    {
+        _key.clear();
+        _key.push_back(static_cast<char>(level));
+        _key.append(reinterpret_cast<const char*>(&view._header._line),
+                    sizeof(view._header._line));
+        _key.append(logger);
+        _key.push_back('\0');
+        _key.append(view._file, view._header._file_len);
+        _key.push_back('\0');
+        _key.append(view._fmt, view._header._fmt_len);
+    }
+
+    uint32_t defineId(const std::string& logger, const LogRecord::View& view)
+    {
+        makeKey(view._header._level, logger, view);
+        auto it = _ids.find(_key);
+        if (it != _ids.end())
+            return it->second;
+
+        uint32_t id = _ids.size();
+        _ids.emplace(_key, id);
+
+        _defines.push_back(BinaryLog::DEFINE);
+        BinaryLog::putVarint(_defines, id);
+        BinaryLog::putVarint(_defines, static_cast<uint64_t>(view._header._level));
+        BinaryLog::putVarint(_defines, view._header._line);
+        BinaryLog::putString(_defines, std::string_view(view._file, view._header._file_len));
+        BinaryLog::putString(_defines, std::string_view(view._fmt, view._header._fmt_len));
+        BinaryLog::putString(_defines, logger);
+        return id;
+    }
+
+    // 写出新的定义与数据块
+    void writeBlock()
+    {
+        _head.clear();
+        _head.push_back(BinaryLog::BLOCK);
+        BinaryLog::putVarint(_head, _block.size());
+
+        _ofs.write(_defines.data(), _defines.size());
+        _ofs.write(_head.data(), _head.size());
+        _ofs.write(_block.data(), _block.size());
+        _defines.clear();
+        _block.clear();
+        if (!_ofs)
+        {
+            std::cerr << "BinarySink write failed to: " << _filename << std::endl;
+            throw std::runtime_error("Failed to write to log file: " + _filename);
+        }
+    }
+
+   public:
+    BinarySink(const std::string& pathname) : _filename(pathname)
+    {
+        util::file::createDirectory(util::file::path(_filename));
+        _ofs.open(_filename, std::ios::binary | std::ios::app);
+        if (!_ofs.is_open())
+        {
+            throw std::runtime_error("Failed to open file: " + _filename);
+        }
+        // 每次打开都开始一个新的会话, 编号从零重新分配
+        _ofs.write(BinaryLog::MAGIC.data(), BinaryLog::MAGIC.size());
+    }
+    ~BinarySink() override = default;
+
+    // 已经格式化好的文本, 整体作为一个文本条目
+    void log(const char* data, size_t len) override
+    {
+        _block.push_back(BinaryLog::TEXT);
+        BinaryLog::putString(_block, std::string_view(data, len));
+        writeBlock();
+    }
+
+    void logRecords(const std::string& logger, const char* data, size_t len) override
+    {
+        LogRecord::View view;
+        int64_t sec = 0;
+        while (len > 0)
+        {
+            size_t n = LogRecord::decode(data, len, view);
+            uint32_t id = defineId(logger, view);
+
+            _block.push_back(BinaryLog::EVENT);
+            BinaryLog::putVarint(_block, id);
+            BinaryLog::putVarint(_block, BinaryLog::zigzag(view._header._ctime - sec));
+            BinaryLog::putVarint(_block, view._header._nsec);
+            BinaryLog::putVarint(_block, view._header._tid);
+            _args.clear();
+            BinaryLog::packArgs(_args, view._args, view._args_len);
+            BinaryLog::putString(_block, _args);
+            sec = view._header._ctime;
+
+            data += n;
+            len -= n;
+        }
+        writeBlock();
+    }
+
+    void flush() override { _ofs.flush(); }
+
+   private:
+    std::ofstream _ofs;
+    std::string _filename;
+
+    std::unordered_map<std::string, uint32_t> _ids;  // 定义 -> 编号
+    std::string _key;
+    std::string _defines;  // 本批新增的定义
+    std::string _head;
+    std::string _args;
+    std::string _block;
+};
+
 /*
     落地方向: 滚动文件(以大小进行滚动)
     同样是为了效率, 文件构造函数就打开
@@ -90,21 +301,7 @@ class FileSink : public LogSink
 class RollBySizeSink : public LogSink
 {
    private:
-    // 生成一个日志文件名
-    // 基础名 + 日期 + 编号
-    std::string generateLogFilename()
-    {
-        // 获取当前时间
-        time_t ct = util::Date::now();
-        struct tm t;
-        memset(&t, 0, sizeof(t));
-        localtime_r(&ct, &t);
-        std::stringstream filename;
-        filename << _basename << '-' << t.tm_year + 1900 << t.tm_mon + 1 << t.tm_mday << '-'
-                 << t.tm_hour <<':'<< t.tm_min <<':'<< t.tm_sec <<'-'<< _file_idx << ".log";
-
-        return filename.str();
-    }
+    std::string generateLogFilename() { return makeFilename(_basename, _file_idx); }
 
     void openfile(const std::string& filename)
     {
@@ -118,6 +315,22 @@ class RollBySizeSink : public LogSink
     }
 
    public:
+    // 生成一个日志文件名
+    // 基础名 + 日期 + 编号
+    static std::string makeFilename(const std::string& basename, size_t file_idx)
+    {
+        // 获取当前时间
+        time_t ct = util::Date::now();
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        localtime_r(&ct, &t);
+        std::stringstream filename;
+        filename << basename << '-' << t.tm_year + 1900 << t.tm_mon + 1 << t.tm_mday << '-'
+                 << t.tm_hour <<':'<< t.tm_min <<':'<< t.tm_sec <<'-'<< file_idx << ".log";
+
+        return filename.str();
+    }
+
     RollBySizeSink(size_t max_fsize, const std::string& basename)
         : _max_fsize(max_fsize),
           _cur_fsize(0),
@@ -127,8 +340,11 @@ class RollBySizeSink : public LogSink
     {
         // 创建文件所在路径
         util::file::createDirectory(util::file::path(_cur_fname));
-        // 打开文件
+        // 打开文件, 同名文件已经存在时接着它的大小计数
         openfile(_cur_fname);
+        struct stat st;
+        if (stat(_cur_fname.c_str(), &st) == 0)
+            _cur_fsize = st.st_size;
     }
     ~RollBySizeSink() override = default;
     void log(const char* data, size_t len) override
@@ -161,6 +377,1529 @@ class RollBySizeSink : public LogSink
     std::ofstream _ofs;
 };
 
+/*
+    持久化策略, 决定何时用fdatasync把已经交给内核的数据真正写到磁盘
+    1. NONE: 从不主动同步, 数据只保证进入页缓存
+    2. INTERVAL: 距上次同步超过interval后同步
+    3. BYTES: 未同步的数据超过bytes字节后同步
+    4. ON_ERROR: 一批日志中有ERROR及以上等级的日志时同步
+    策略只在一批日志落地之后检查, 一批日志最多同步一次(组提交), 因此INTERVAL是下限而非定时;
+    异步日志器空闲之后, INTERVAL还会把剩余的数据同步一次, 最后一批日志不会一直停留在页缓存中;
+    flush时只要有未同步的数据就会同步
+*/
+struct Durability
+{
+    enum class mode
+    {
+        NONE,
+        INTERVAL,
+        BYTES,
+        ON_ERROR
+    };
+
+    static Durability none() { return Durability(mode::NONE); }
+    static Durability interval(std::chrono::milliseconds interval)
+    {
+        Durability durability(mode::INTERVAL);
+        durability._interval = interval;
+        return durability;
+    }
+    static Durability bytes(size_t bytes)
+    {
+        Durability durability(mode::BYTES);
+        durability._bytes = bytes;
+        return durability;
+    }
+    static Durability onError() { return Durability(mode::ON_ERROR); }
+
+    explicit Durability(mode policy = mode::NONE)
+        : _mode(policy), _interval(std::chrono::milliseconds(0)), _bytes(0)
+    {
+    }
+
+    mode _mode;
+    std::chrono::milliseconds _interval;
+    size_t _bytes;
+};
+
+/*
+    同步耗时的统计, 由落地线程记录, 其它线程可以随时读取
+    耗时按微秒取以2为底的对数分桶, 第i桶为[2^(i-1), 2^i)微秒, 第0桶为不足1微秒,
+    最后一桶收纳所有更慢的同步
+*/
+class SyncStats
+{
+   public:
+    static constexpr size_t BUCKETS = 24;
+
+    SyncStats() : _count(0), _total_ns(0), _max_ns(0), _last_ns(0)
+    {
+        for (auto& bucket : _buckets) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns)
+    {
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _total_ns.fetch_add(ns, std::memory_order_relaxed);
+        _last_ns.store(ns, std::memory_order_relaxed);
+        if (ns > _max_ns.load(std::memory_order_relaxed))
+            _max_ns.store(ns, std::memory_order_relaxed);
+
+        size_t idx = 0;
+        for (uint64_t us = ns / 1000; us > 0 && idx + 1 < BUCKETS; us >>= 1) ++idx;
+        _buckets[idx].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t totalNs() const { return _total_ns.load(std::memory_order_relaxed); }
+    uint64_t maxNs() const { return _max_ns.load(std::memory_order_relaxed); }
+    uint64_t lastNs() const { return _last_ns.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t idx) const { return _buckets[idx].load(std::memory_order_relaxed); }
+
+    // 第p百分位耗时的上界(微秒), 取分位点所在桶的上沿
+    uint64_t percentileUs(double p) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(total * p / 100.0);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += bucket(i);
+            if (seen > rank)
+                return uint64_t(1) << i;
+        }
+        return uint64_t(1) << (BUCKETS - 1);
+    }
+
+   private:
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _total_ns;
+    std::atomic<uint64_t> _max_ns;
+    std::atomic<uint64_t> _last_ns;
+    std::atomic<uint64_t> _buckets[BUCKETS];
+};
+
+/*
+    基于文件描述符的落地方向
+    不经过std::ofstream, 异步线程交来的缓冲区直接用write/writev交给内核, 省去一次拷贝
+    数据在log返回时已经进入内核, 是否以及何时同步到磁盘由持久化策略决定
+    出错时构造SinkError交给错误处理函数; 未设置时直接抛出, 设置后由它决定是否继续,
+    处理函数返回则丢弃这次写入
+*/
+class FdSink : public LogSink
+{
+    // 每次writev最多提交的段数, 远小于IOV_MAX, 可以放在栈上
+    static constexpr int IOV_BATCH = 64;
+
+   public:
+    using ErrorHandler = std::function<void(const SinkError&)>;
+
+    ~FdSink() override
+    {
+        try
+        {
+            closeFile();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    void log(const char* data, size_t len) override
+    {
+        struct iovec iov = {const_cast<char*>(data), len};
+        logv(&iov, 1);
+    }
+
+    void commit(bool urgent) override
+    {
+        if (_fd < 0 || _unsynced == 0)
+            return;
+
+        bool due = false;
+        switch (_durability._mode)
+        {
+            case Durability::mode::NONE:
+                break;
+            case Durability::mode::INTERVAL:
+                due = std::chrono::steady_clock::now() - _last_sync >= _durability._interval;
+                break;
+            case Durability::mode::BYTES:
+                due = _unsynced >= _durability._bytes;
+                break;
+            case Durability::mode::ON_ERROR:
+                due = urgent;
+                break;
+        }
+        if (due)
+            sync();
+    }
+
+    void idle() override
+    {
+        if (_fd >= 0 && _unsynced > 0 && _durability._mode == Durability::mode::INTERVAL)
+            sync();
+    }
+
+    // 使用持久化策略时, 把所有未同步的数据写到磁盘
+    void flush() override
+    {
+        if (_fd >= 0 && _unsynced > 0 && _durability._mode != Durability::mode::NONE)
+            sync();
+    }
+
+    // 在开始写日志之前设置
+    void setDurability(const Durability& durability)
+    {
+        _durability = durability;
+        _last_sync = std::chrono::steady_clock::now();
+    }
+    const Durability& durability() const { return _durability; }
+    const SyncStats& syncStats() const { return _sync_stats; }
+
+    void setErrorHandler(ErrorHandler handler) { _on_error = std::move(handler); }
+    const std::string& filename() const { return _filename; }
+
+   protected:
+    FdSink() : _fd(-1), _unsynced(0), _last_sync(std::chrono::steady_clock::now()) {}
+
+    // 同步之前, 确保已经交出去的数据都已经写入文件
+    virtual void prepareSync() {}
+
+    void sync()
+    {
+        int err = syncData();
+        if (err != 0)
+            fail("fdatasync", err);
+    }
+
+    // 同步并记录耗时, 返回errno
+    int syncData()
+    {
+        prepareSync();
+        auto start = std::chrono::steady_clock::now();
+        int err = ::fdatasync(_fd) < 0 ? errno : 0;
+        _last_sync = std::chrono::steady_clock::now();
+        _sync_stats.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(_last_sync - start).count());
+        _unsynced = 0;
+        return err;
+    }
+
+    // flags为访问方式与附加标志, 总会带上O_CREAT与O_CLOEXEC
+    bool openFile(const std::string& filename, int flags = O_WRONLY | O_APPEND)
+    {
+        closeFile();
+        _filename = filename;
+        _fd = ::open(filename.c_str(), O_CREAT | O_CLOEXEC | flags, 0644);
+        if (_fd < 0)
+        {
+            fail("open", errno);
+            return false;
+        }
+        return true;
+    }
+
+    // 换上一个已经打开的文件
+    void adoptFile(int fd, const std::string& filename)
+    {
+        closeFile();
+        _filename = filename;
+        _fd = fd;
+    }
+
+    // 文件当前的大小, 用于接着已有的文件继续写
+    size_t fileSize() const
+    {
+        struct stat st;
+        return _fd >= 0 && ::fstat(_fd, &st) == 0 ? st.st_size : 0;
+    }
+
+    // 使用持久化策略时, 关闭前先同步剩余的数据(包括滚动时的旧文件)
+    void closeFile()
+    {
+        if (_fd < 0)
+            return;
+        int err = 0;
+        if (_unsynced > 0 && _durability._mode != Durability::mode::NONE)
+            err = syncData();
+        ::close(_fd);
+        _fd = -1;
+        _unsynced = 0;
+        if (err != 0)
+            fail("fdatasync", err);
+    }
+
+    // 写出全部数据, 处理信号中断与部分写入
+    void writeAll(const struct iovec* iov, int iovcnt)
+    {
+        if (_fd < 0)
+        {
+            fail("write", EBADF);
+            return;
+        }
+
+        struct iovec batch[IOV_BATCH];
+        while (iovcnt > 0)
+        {
+            int n = std::min(iovcnt, IOV_BATCH);
+            memcpy(batch, iov, n * sizeof(struct iovec));
+            iov += n;
+            iovcnt -= n;
+
+            struct iovec* cur = batch;
+            while (n > 0)
+            {
+                ssize_t ret = ::writev(_fd, cur, n);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    fail("write", errno);
+                    return;
+                }
+                // 跳过已经写完的段, 剩余部分继续写
+                size_t done = ret;
+                _unsynced += done;
+                while (n > 0 && done >= cur->iov_len)
+                {
+                    done -= cur->iov_len;
+                    ++cur;
+                    --n;
+                }
+                if (n > 0)
+                {
+                    cur->iov_base = static_cast<char*>(cur->iov_base) + done;
+                    cur->iov_len -= done;
+                }
+            }
+        }
+    }
+
+    void fail(const char* op, int code)
+    {
+        SinkError error(op, _filename, code);
+        if (!_on_error)
+            throw error;
+        _on_error(error);
+    }
+
+    int _fd;
+    std::string _filename;
+    ErrorHandler _on_error;
+
+    Durability _durability;
+    size_t _unsynced;  // 上次同步之后写入的字节数
+    std::chrono::steady_clock::time_point _last_sync;
+    SyncStats _sync_stats;
+};
+
+/*
+    落地方向: 指定文件, 基于文件描述符
+*/
+class FdFileSink : public FdSink
+{
+   public:
+    FdFileSink(const std::string& pathname)
+    {
+        util::file::createDirectory(util::file::path(pathname));
+        openFile(pathname);
+    }
+
+    void logv(const struct iovec* iov, int iovcnt) override { writeAll(iov, iovcnt); }
+};
+
+/*
+    落地方向: 滚动文件(以大小进行滚动), 基于文件描述符
+    文件名规则与RollBySizeSink相同, 一次logv的多段数据总是写入同一个文件
+*/
+class FdRollBySizeSink : public FdSink
+{
+   public:
+    FdRollBySizeSink(size_t max_fsize, const std::string& basename)
+        : _max_fsize(max_fsize), _cur_fsize(0), _file_idx(0), _basename(basename)
+    {
+        std::string filename = RollBySizeSink::makeFilename(_basename, _file_idx);
+        util::file::createDirectory(util::file::path(filename));
+        if (openFile(filename))
+            _cur_fsize = fileSize();
+    }
+
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+
+        if (_cur_fsize + len > _max_fsize)
+        {
+            _file_idx++;
+            openFile(RollBySizeSink::makeFilename(_basename, _file_idx));
+            _cur_fsize = 0;
+        }
+
+        _cur_fsize += len;
+        writeAll(iov, iovcnt);
+    }
+
+   private:
+    size_t _max_fsize;
+    size_t _cur_fsize;
+    size_t _file_idx;
+    std::string _basename;
+};
+
+/*
+    落地方向: 按时间, 按大小或者两者同时滚动的文件, 基于文件描述符
+    1. interval不为零时, 按本地时间对齐到interval的整数倍滚动, 例如每小时在整点滚动
+    2. max_fsize不为零时, 写入会使文件超过上限时先滚动; 单次写入本身超过上限时独占一个文件
+    3. 文件名为 基础名-年月日-时分秒.毫秒-编号.log, 各字段定长补零, 字典序即为时间顺序
+    spare为true时由SpareSegment在后台提前创建下一个文件(基础名.spare)并预分配max_fsize字节,
+    滚动时只是换上它的描述符; 备用文件还没有准备好时才在落地线程上打开新文件
+    写完的文件按保留策略交给SegmentArchiver, 压缩与清理都在它的后台线程上完成;
+    构造时也会处理上次运行遗留的文件
+    后台线程上的错误同样交给错误处理函数(未设置时输出到标准错误), 因此处理函数需要线程安全
+*/
+class RollingFileSink : public FdSink
+{
+    std::string makeFilename()
+    {
+        auto now = std::chrono::system_clock::now();
+        time_t sec = std::chrono::system_clock::to_time_t(now);
+        int msec = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       now.time_since_epoch())
+                       .count() %
+                   1000;
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        localtime_r(&sec, &t);
+
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), "-%04d%02d%02d-%02d%02d%02d.%03d-%06zu.log",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, msec,
+                 _file_idx);
+        return _basename + suffix;
+    }
+
+    // 下一个interval整数倍的时刻, 按本地时间对齐
+    void scheduleRoll(time_t now)
+    {
+        time_t gap = _interval.count();
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        localtime_r(&now, &t);
+        time_t local = now + t.tm_gmtoff;
+        _next_roll = (local / gap + 1) * gap - t.tm_gmtoff;
+    }
+
+    bool needRoll(size_t len)
+    {
+        if (_max_fsize > 0 && _cur_fsize > 0 && _cur_fsize + len > _max_fsize)
+            return true;
+        return _interval.count() > 0 && util::Date::now() >= _next_roll;
+    }
+
+    void openSegment()
+    {
+        if (_interval.count() > 0)
+            scheduleRoll(util::Date::now());
+
+        std::string finished = _fd >= 0 ? _filename : std::string();
+        std::string filename = makeFilename();
+        ++_file_idx;
+        int fd = _spare ? _spare->take(filename) : -1;
+        if (fd >= 0)
+        {
+            adoptFile(fd, filename);
+            _cur_fsize = 0;
+        }
+        else
+        {
+            // 同名文件已经存在时接着它的大小计数
+            openFile(filename);
+            _cur_fsize = fileSize();
+        }
+
+        if (_spare && !finished.empty())
+            _spare->trim(finished);
+        if (_archiver)
+            _archiver->submit(_filename);
+    }
+
+    void report(const char* op, const std::string& filename, int code)
+    {
+        SinkError error(op, filename, code);
+        if (_on_error)
+            _on_error(error);
+        else
+            std::cerr << "RollingFileSink: " << error.what() << std::endl;
+    }
+
+   public:
+    RollingFileSink(const std::string& basename, std::chrono::seconds interval, size_t max_fsize,
+                    const Retention& retention = Retention(), bool spare = true)
+        : _interval(interval),
+          _max_fsize(max_fsize),
+          _cur_fsize(0),
+          _file_idx(0),
+          _next_roll(0),
+          _basename(basename)
+    {
+        std::string dir = util::file::path(basename);
+        util::file::createDirectory(dir);
+        if (retention.enabled())
+        {
+            _archiver = std::make_unique<SegmentArchiver>(
+                dir, util::file::basename(basename) + "-", retention,
+                [this](const char* op, const std::string& filename, int code) {
+                    report(op, filename, code);
+                });
+        }
+        if (spare)
+        {
+            _spare = std::make_unique<SpareSegment>(
+                basename + ".spare", max_fsize,
+                [this](const char* op, const std::string& filename, int code) {
+                    report(op, filename, code);
+                });
+        }
+        openSegment();
+    }
+
+    // 先等待后台线程处理完已经提交的工作, 当前文件留给下次运行压缩
+    // 改名晚于上一轮整理的文件, 需要在改名全部完成后再整理一轮
+    ~RollingFileSink() override
+    {
+        if (_spare && _fd >= 0)
+            _spare->trim(_filename);
+        _spare.reset();
+        if (_archiver)
+            _archiver->submit(_filename);
+        _archiver.reset();
+    }
+
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+
+        if (needRoll(len))
+            openSegment();
+
+        _cur_fsize += len;
+        writeAll(iov, iovcnt);
+    }
+
+   private:
+    std::chrono::seconds _interval;  // 按时间滚动的间隔, 0表示不按时间滚动
+    size_t _max_fsize;               // 单个文件的大小上限, 0表示不按大小滚动
+    size_t _cur_fsize;
+    size_t _file_idx;
+    time_t _next_roll;  // 下一次按时间滚动的时刻
+    std::string _basename;
+    std::unique_ptr<SegmentArchiver> _archiver;
+    std::unique_ptr<SpareSegment> _spare;
+};
+
+/*
+    落地方向: 指定文件, 基于io_uring的异步写入
+    异步线程交来的缓冲区直接换入本落地方向, 提交写请求后立即返回, 最多同时有inflight块在写;
+    写完的缓冲区才会在之后的交换中还给异步处理器, 磁盘偶尔卡顿时异步线程不必跟着阻塞
+    每块数据在提交时就分配好文件偏移, 写请求可以乱序完成, 因此文件不以追加方式打开
+    内核不支持io_uring(或use_uring为false)时, 退化为由一个后台线程依次pwrite
+*/
+class UringFileSink : public FdSink
+{
+    struct Slot
+    {
+        explicit Slot(size_t idx)
+            : _idx(idx), _buff(4096), _offset(0), _done(0), _retries(0), _busy(false)
+        {
+        }
+
+        size_t _idx;
+        Buffer _buff;
+        uint64_t _offset;  // 本块数据在文件中的起始偏移
+        size_t _done;      // 已经写出的字节数
+        int _retries;      // 连续遇到可重试错误的次数
+        bool _busy;
+    };
+
+    static constexpr int MAX_RETRIES = 8;
+
+    // 取一个空闲的块, 全部在写时等待完成事件
+    Slot& acquire()
+    {
+        reapAll();
+        while (true)
+        {
+            for (auto& slot : _slots)
+            {
+                if (!slot->_busy)
+                    return *slot;
+            }
+            waitOne();
+        }
+    }
+
+    void start(Slot& slot)
+    {
+        slot._offset = _offset;
+        slot._done = 0;
+        slot._retries = 0;
+        slot._busy = true;
+        _offset += slot._buff.readAbleSize();
+        _unsynced += slot._buff.readAbleSize();
+        submit(slot._idx);
+    }
+
+    // 提交块中尚未写出的部分, 提交本身失败时在有限次数内重试
+    void submit(size_t idx)
+    {
+        Slot& slot = *_slots[idx];
+        const char* data = slot._buff.readAbleBegin() + slot._done;
+        size_t len = slot._buff.readAbleSize() - slot._done;
+
+        if (_uring.valid())
+        {
+            // 单次请求的长度受限于unsigned, 剩余部分在完成后继续提交
+            unsigned n = std::min<size_t>(len, 1u << 30);
+            int ret;
+            // 失败的请求已经撤回, 重试不会让同一块数据在队列中出现两次
+            while ((ret = _uring.write(_fd, data, n, slot._offset + slot._done, idx)) < 0)
+            {
+                if ((ret != -EINTR && ret != -EAGAIN) || ++slot._retries > MAX_RETRIES)
+                {
+                    slot._busy = false;
+                    fail("io_uring_enter", -ret);
+                    return;
+                }
+            }
+            ++_inflight;
+            return;
+        }
+
+        ++_inflight;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _requests.push_back(idx);
+        }
+        _cond_req.notify_one();
+    }
+
+    // 处理一个完成事件, 部分写入与可重试的错误会重新提交, 连续重试超过上限时按写失败处理
+    void complete(size_t idx, int res)
+    {
+        Slot& slot = *_slots[idx];
+        --_inflight;
+        if ((res == -EINTR || res == -EAGAIN) && ++slot._retries <= MAX_RETRIES)
+            return submit(idx);
+        if (res <= 0)
+        {
+            slot._busy = false;
+            fail("write", res == 0 ? EIO : -res);
+            return;
+        }
+
+        slot._done += res;
+        slot._retries = 0;
+        if (slot._done < slot._buff.readAbleSize())
+            return submit(idx);
+        slot._busy = false;
+    }
+
+    // 处理已经到达的完成事件, 不阻塞
+    void reapAll()
+    {
+        if (_uring.valid())
+        {
+            uint64_t idx;
+            int res;
+            while (_uring.reap(idx, res, false)) complete(idx, res);
+            return;
+        }
+
+        std::vector<std::pair<size_t, int>> done;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            done.swap(_completions);
+        }
+        for (const auto& event : done) complete(event.first, event.second);
+    }
+
+    // 至少等到一个完成事件并处理
+    void waitOne()
+    {
+        if (_uring.valid())
+        {
+            uint64_t idx;
+            int res;
+            if (!_uring.reap(idx, res, true))
+            {
+                fail("io_uring_enter", errno);
+                return;
+            }
+            complete(idx, res);
+            return;
+        }
+
+        std::vector<std::pair<size_t, int>> done;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond_done.wait(lock, [&]() { return !_completions.empty(); });
+            done.swap(_completions);
+        }
+        for (const auto& event : done) complete(event.first, event.second);
+    }
+
+    // 退化模式下的后台写线程
+    void writerEntry()
+    {
+        while (true)
+        {
+            size_t idx;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond_req.wait(lock, [&]() { return _stop || !_requests.empty(); });
+                if (_requests.empty())
+                    break;
+                idx = _requests.front();
+                _requests.pop_front();
+            }
+
+            Slot& slot = *_slots[idx];
+            ssize_t ret = ::pwrite(_fd, slot._buff.readAbleBegin() + slot._done,
+                                   slot._buff.readAbleSize() - slot._done,
+                                   slot._offset + slot._done);
+            int res = ret < 0 ? -errno : static_cast<int>(std::min<ssize_t>(ret, INT32_MAX));
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _completions.emplace_back(idx, res);
+            }
+            _cond_done.notify_one();
+        }
+    }
+
+   public:
+    UringFileSink(const std::string& pathname, size_t inflight = 4, bool use_uring = true)
+        : _uring(use_uring ? std::max<size_t>(inflight, 1) : 0),
+          _offset(0),
+          _inflight(0),
+          _stop(false)
+    {
+        for (size_t i = 0; i < std::max<size_t>(inflight, 1); ++i)
+            _slots.emplace_back(std::make_unique<Slot>(i));
+
+        util::file::createDirectory(util::file::path(pathname));
+        if (openFile(pathname, O_WRONLY))
+        {
+            off_t end = ::lseek(_fd, 0, SEEK_END);
+            _offset = end < 0 ? 0 : end;
+        }
+
+        if (!_uring.valid())
+            _writer = std::thread(&UringFileSink::writerEntry, this);
+    }
+
+    ~UringFileSink() override
+    {
+        try
+        {
+            flush();
+        }
+        catch (const std::exception&)
+        {
+        }
+        if (_writer.joinable())
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _cond_req.notify_one();
+            _writer.join();
+        }
+    }
+
+    // 是否真正使用了io_uring
+    bool usingUring() const { return _uring.valid(); }
+
+    void log(const char* data, size_t len) override
+    {
+        if (len == 0)
+            return;
+        Slot& slot = acquire();
+        slot._buff.reset();
+        slot._buff.push(data, len);
+        start(slot);
+    }
+
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        Slot& slot = acquire();
+        slot._buff.reset();
+        for (int i = 0; i < iovcnt; ++i)
+            slot._buff.push(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        if (slot._buff.readAbleSize() > 0)
+            start(slot);
+    }
+
+    void logBuffer(Buffer& buffer) override
+    {
+        if (buffer.readAbleSize() == 0)
+            return;
+        Slot& slot = acquire();
+        slot._buff.reset();
+        // 换回的缓冲区容量不能变小, 否则阻塞模式下的生产者可能再也放不下一条日志
+        if (slot._buff.capacity() < buffer.capacity())
+            Buffer(buffer.capacity(), buffer.memory()).swap(slot._buff);
+        slot._buff.swap(buffer);
+        start(slot);
+    }
+
+    // 等待所有在写的块完成, 再按持久化策略同步
+    void flush() override
+    {
+        prepareSync();
+        FdSink::flush();
+    }
+
+   protected:
+    void prepareSync() override
+    {
+        while (_inflight > 0) waitOne();
+    }
+
+   private:
+    IoUring _uring;
+    std::vector<std::unique_ptr<Slot>> _slots;
+    uint64_t _offset;  // 下一块数据的文件偏移
+    size_t _inflight;  // 已提交未完成的请求数
+
+    // 退化模式使用
+    std::mutex _mutex;
+    std::condition_variable _cond_req;
+    std::condition_variable _cond_done;
+    std::deque<size_t> _requests;
+    std::vector<std::pair<size_t, int>> _completions;
+    bool _stop;
+    std::thread _writer;
+};
+
+/*
+    落地方向: 指定文件, 基于内存映射
+    文件按chunk_size为单位用fallocate预先分配, 并映射当前所在的一段窗口,
+    写日志只是一次memcpy, 除了跨越窗口与定期回写之外没有系统调用
+    1. 预先分配保证磁盘空间不足时在分配处报错, 而不是写映射时收到SIGBUS
+    2. 每写出sync_bytes字节就用sync_file_range启动这部分脏页的回写, 避免脏页堆积后集中刷盘;
+       换窗口时解除旧窗口的映射, 常驻内存不超过一个窗口
+    3. 关闭时截掉预分配而未使用的尾部; 进程崩溃时尾部会留下填充的零字节,
+       再次打开时从文件末尾向前跳过这些零字节, 接着真正的数据继续写
+*/
+class MmapFileSink : public FdSink
+{
+    static size_t pageSize()
+    {
+        static const size_t size = sysconf(_SC_PAGESIZE);
+        return size;
+    }
+
+    // 找到文件中最后一个非零字节之后的位置
+    size_t dataEnd(size_t size)
+    {
+        char block[64 * 1024];
+        while (size > 0)
+        {
+            size_t n = std::min(size, sizeof(block));
+            ssize_t ret = ::pread(_fd, block, n, size - n);
+            if (ret != static_cast<ssize_t>(n))
+                break;
+            for (size_t i = n; i > 0; --i)
+            {
+                if (block[i - 1] != '\0')
+                    return size - n + i;
+            }
+            size -= n;
+        }
+        return size;
+    }
+
+    // 映射包含_size的窗口, 必要时先扩展文件
+    bool mapWindow()
+    {
+        unmapWindow();
+        _win_off = _size / _chunk_size * _chunk_size;
+        size_t end = _win_off + _chunk_size;
+        if (end > _alloc_size)
+        {
+            int err = ::fallocate(_fd, 0, _alloc_size, end - _alloc_size);
+            // 文件系统不支持预分配时退化为扩展文件大小
+            if (err != 0 && errno == EOPNOTSUPP)
+                err = ::ftruncate(_fd, end);
+            if (err != 0)
+            {
+                fail("fallocate", errno);
+                return false;
+            }
+            _alloc_size = end;
+        }
+
+        void* addr =
+            ::mmap(nullptr, _chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _win_off);
+        if (addr == MAP_FAILED)
+        {
+            fail("mmap", errno);
+            return false;
+        }
+        _window = static_cast<char*>(addr);
+        return true;
+    }
+
+    void unmapWindow()
+    {
+        if (_window != nullptr)
+            ::munmap(_window, _chunk_size);
+        _window = nullptr;
+    }
+
+    // 启动[_synced, _size)之间脏页的回写, 不等待完成
+    void writeback()
+    {
+        if (_size > _synced)
+            ::sync_file_range(_fd, _synced, _size - _synced, SYNC_FILE_RANGE_WRITE);
+        _synced = _size;
+    }
+
+   protected:
+    MmapFileSink(size_t chunk_size, size_t sync_bytes)
+        : _chunk_size(
+              std::max(pageSize(), (chunk_size + pageSize() - 1) / pageSize() * pageSize())),
+          _sync_bytes(sync_bytes),
+          _window(nullptr),
+          _win_off(0),
+          _size(0),
+          _alloc_size(0),
+          _synced(0)
+    {
+    }
+
+    bool openMapped(const std::string& filename)
+    {
+        closeMapped();
+        util::file::createDirectory(util::file::path(filename));
+        if (!openFile(filename, O_RDWR))
+            return false;
+
+        off_t size = ::lseek(_fd, 0, SEEK_END);
+        _alloc_size = size < 0 ? 0 : size;
+        _size = _synced = dataEnd(_alloc_size);
+        return mapWindow();
+    }
+
+    // 解除映射, 截掉未使用的预分配部分并关闭文件
+    void closeMapped()
+    {
+        if (_fd < 0)
+            return;
+        unmapWindow();
+        writeback();
+        if (_alloc_size > _size && ::ftruncate(_fd, _size) != 0)
+        {
+            int err = errno;
+            closeFile();
+            fail("ftruncate", err);
+            return;
+        }
+        closeFile();
+    }
+
+    void append(const char* data, size_t len)
+    {
+        while (len > 0)
+        {
+            if (_window == nullptr || _size == _win_off + _chunk_size)
+            {
+                if (!mapWindow())
+                    return;
+            }
+
+            size_t n = std::min(len, _win_off + _chunk_size - _size);
+            memcpy(_window + (_size - _win_off), data, n);
+            _size += n;
+            _unsynced += n;
+            data += n;
+            len -= n;
+        }
+        if (_size - _synced >= _sync_bytes)
+            writeback();
+    }
+
+   public:
+    MmapFileSink(const std::string& pathname, size_t chunk_size = 64 * 1024 * 1024,
+                 size_t sync_bytes = 8 * 1024 * 1024)
+        : MmapFileSink(chunk_size, sync_bytes)
+    {
+        openMapped(pathname);
+    }
+
+    ~MmapFileSink() override
+    {
+        try
+        {
+            closeMapped();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    void log(const char* data, size_t len) override { append(data, len); }
+
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        for (int i = 0; i < iovcnt; ++i)
+            append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+
+    // 数据已经在页缓存中, 这里只是启动回写; 使用持久化策略时再等待同步完成
+    // fdatasync同样会写出共享映射中的脏页, 无需另外msync
+    void flush() override
+    {
+        writeback();
+        FdSink::flush();
+    }
+
+   protected:
+    size_t _chunk_size;  // 预分配与映射窗口的大小, 页对齐
+    size_t _sync_bytes;
+    char* _window;       // 当前映射的窗口
+    size_t _win_off;     // 窗口在文件中的偏移
+    size_t _size;        // 文件中有效数据的长度
+    size_t _alloc_size;  // 文件当前的实际大小, 包括预分配部分
+    size_t _synced;      // 已经启动回写的位置
+};
+
+/*
+    落地方向: 滚动文件(以大小进行滚动), 基于内存映射
+    滚动规则与文件名同RollBySizeSink, 窗口不超过单个文件的大小上限
+*/
+class MmapRollBySizeSink : public MmapFileSink
+{
+    // 按文件中的有效数据计算, 接着写入已有的文件时也不会超出上限
+    void rollIfNeeded(size_t len)
+    {
+        if (_size + len > _max_fsize)
+        {
+            _file_idx++;
+            openMapped(RollBySizeSink::makeFilename(_basename, _file_idx));
+        }
+    }
+
+   public:
+    MmapRollBySizeSink(size_t max_fsize, const std::string& basename,
+                       size_t chunk_size = 64 * 1024 * 1024, size_t sync_bytes = 8 * 1024 * 1024)
+        : MmapFileSink(std::min(chunk_size, max_fsize), sync_bytes),
+          _max_fsize(max_fsize),
+          _file_idx(0),
+          _basename(basename)
+    {
+        openMapped(RollBySizeSink::makeFilename(_basename, _file_idx));
+    }
+
+    void log(const char* data, size_t len) override
+    {
+        rollIfNeeded(len);
+        append(data, len);
+    }
+
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+        rollIfNeeded(len);
+        MmapFileSink::logv(iov, iovcnt);
+    }
+
+   private:
+    size_t _max_fsize;
+    size_t _file_idx;
+    std::string _basename;
+};
+
+/*
+    落地方向: LZ4压缩文件
+    异步线程交来的数据先攒成固定大小的块, 每块独立压缩后写出, 格式见compress.hpp
+    进程崩溃最多丢失尚未写出的一个块; 块之间互不依赖, 可以从任意块开始解压
+    再次打开已有文件时追加新的帧, 上次崩溃遗留的不完整块会被截掉
+*/
+class CompressedFileSink : public LogSink
+{
+    /*
+        扫描已有文件, 截掉末尾不完整的块或帧头
+        最后一帧缺少结束标记时, 把补齐它所需的数据写入tail
+        文件也可能是其它工具写出的, 帧头里的标志决定块与帧之后是否跟着校验值
+    */
+    void recover(std::string& tail)
+    {
+        std::ifstream ifs(_filename, std::ios::binary | std::ios::ate);
+        if (!ifs.is_open())
+            return;
+        size_t size = ifs.tellg();
+        ifs.seekg(0);
+
+        size_t pos = 0, valid = 0, frame = 0;
+        bool in_frame = false;
+        Lz4Frame::Descriptor desc{};
+        char buf[Lz4Frame::HEADER_SIZE + 12];
+        while (pos < size)
+        {
+            if (!in_frame)
+            {
+                if (size - pos < Lz4Frame::HEADER_SIZE || !ifs.read(buf, 5) ||
+                    Lz4Frame::get32(buf) != Lz4Frame::MAGIC)
+                    break;
+                size_t n = Lz4Frame::headerSize(static_cast<uint8_t>(buf[4]));
+                if (size - pos < n || !ifs.read(buf + 5, n - 5))
+                    break;
+                try
+                {
+                    desc = Lz4Frame::descriptor(buf);
+                }
+                catch (const std::runtime_error&)
+                {
+                    break;
+                }
+                frame = pos;
+                pos += n;
+                valid = pos;
+                in_frame = true;
+                continue;
+            }
+
+            if (size - pos < 4 || !ifs.read(buf, 4))
+                break;
+            uint32_t block = Lz4Frame::get32(buf);
+            size_t n = Lz4Frame::frameTrailer(desc);
+            if (block != 0)
+                n = (block & ~Lz4Frame::UNCOMPRESSED) + Lz4Frame::blockTrailer(desc);
+            // 块长度与其后的校验值都完整才算一个完整的块, 结束标记也一样
+            if (size - pos - 4 < n || !ifs.seekg(n, std::ios::cur))
+                break;
+            pos += 4 + n;
+            valid = pos;
+            in_frame = block != 0;
+        }
+        ifs.close();
+
+        if (valid == 0 && size > 0)
+            throw std::runtime_error("Not a compressed log file: " + _filename);
+        if (valid < size && truncate(_filename.c_str(), valid) != 0)
+            throw std::runtime_error("Failed to truncate file: " + _filename);
+        if (!in_frame)
+            return;
+
+        Lz4Frame::end(tail);
+        // 帧头声明了内容校验时才需要读回整帧
+        if (Lz4Frame::frameTrailer(desc) > 0)
+        {
+            std::string data(valid - frame, '\0');
+            std::ifstream in(_filename, std::ios::binary);
+            if (!in.seekg(frame) || !in.read(&data[0], data.size()))
+                throw std::runtime_error("Failed to read file: " + _filename);
+            Lz4Frame::contentChecksum(tail, data.data(), data.size());
+        }
+    }
+
+    void writeBlock(const char* data, size_t len)
+    {
+        _out.clear();
+        Lz4Frame::block(_out, data, len, _table.data(), _scratch);
+        write();
+    }
+
+    void write()
+    {
+        _ofs.write(_out.data(), _out.size());
+        if (!_ofs)
+        {
+            std::cerr << "CompressedFileSink write failed to: " << _filename << std::endl;
+            throw std::runtime_error("Failed to write to log file: " + _filename);
+        }
+    }
+
+   public:
+    CompressedFileSink(const std::string& pathname, size_t block_size = 256 * 1024)
+        : _filename(pathname),
+          _block_size(std::min<size_t>(std::max<size_t>(block_size, 1), 4 * 1024 * 1024)),
+          _table(Lz4::TABLE_SIZE)
+    {
+        util::file::createDirectory(util::file::path(_filename));
+        _out.clear();
+        recover(_out);
+        _ofs.open(_filename, std::ios::binary | std::ios::app);
+        if (!_ofs.is_open())
+        {
+            throw std::runtime_error("Failed to open file: " + _filename);
+        }
+
+        Lz4Frame::header(_out, _block_size);
+        write();
+        _pending.reserve(_block_size);
+    }
+
+    // 写出剩余数据并结束当前帧, 析构时不再抛出异常
+    ~CompressedFileSink() override
+    {
+        try
+        {
+            flush();
+            _out.clear();
+            Lz4Frame::end(_out);
+            write();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    void log(const char* data, size_t len) override
+    {
+        while (len > 0)
+        {
+            // 暂存区为空时, 整块的数据直接压缩, 省去一次拷贝
+            if (_pending.empty() && len >= _block_size)
+            {
+                writeBlock(data, _block_size);
+                data += _block_size;
+                len -= _block_size;
+                continue;
+            }
+
+            size_t n = std::min(len, _block_size - _pending.size());
+            _pending.append(data, n);
+            data += n;
+            len -= n;
+            if (_pending.size() == _block_size)
+            {
+                writeBlock(_pending.data(), _pending.size());
+                _pending.clear();
+            }
+        }
+    }
+
+    // 不足一块的数据也作为一个较小的块写出
+    void flush() override
+    {
+        if (!_pending.empty())
+        {
+            writeBlock(_pending.data(), _pending.size());
+            _pending.clear();
+        }
+        _ofs.flush();
+    }
+
+   private:
+    std::ofstream _ofs;
+    std::string _filename;
+    size_t _block_size;
+    std::vector<uint32_t> _table;  // 压缩用的哈希表, 在块之间复用
+    std::string _pending;          // 尚未攒满一块的数据
+    std::string _scratch;
+    std::string _out;
+};
+
+/*
+    落地方向的队列策略, 队列中待写的数据超过capacity字节时:
+    1. BLOCK: 交数据的线程等待, 直到工作线程取走队列中的数据
+    2. DROP: 直接丢弃这批数据并计数, 交数据的线程不受这个落地方向影响
+    队列为空时一批数据无论多大都会被接收
+*/
+struct SinkQueue
+{
+    enum class mode
+    {
+        BLOCK,
+        DROP
+    };
+
+    static SinkQueue block(size_t capacity = 4 * 1024 * 1024)
+    {
+        return SinkQueue(mode::BLOCK, capacity);
+    }
+    static SinkQueue drop(size_t capacity = 4 * 1024 * 1024)
+    {
+        return SinkQueue(mode::DROP, capacity);
+    }
+
+    explicit SinkQueue(mode policy = mode::BLOCK, size_t capacity = 4 * 1024 * 1024)
+        : _mode(policy), _capacity(std::max<size_t>(capacity, 1))
+    {
+    }
+
+    mode _mode;
+    size_t _capacity;
+};
+
+/*
+    异步落地方向: 包装另一个落地方向, 由自己的工作线程把数据交给它
+    异步日志器按顺序把一批日志交给每个落地方向, 慢的落地方向(网络文件系统, 管道)
+    会拖住其它落地方向; 包装之后log只把数据拷进队列, 写入, 提交与刷新都在工作线程上完成
+    队列采用双缓冲区, 工作线程写一块的同时另一块接收新的数据, 满了以后按SinkQueue处理
+    flush等待此前交来的数据全部写完并刷新被包装的落地方向
+    被包装的落地方向在工作线程上抛出的异常交给错误处理函数, 未设置时输出到标准错误,
+    这批数据随之丢弃, 工作线程继续运行
+*/
+class AsyncSink : public LogSink
+{
+    using Clock = std::chrono::steady_clock;
+
+    void threadEntry()
+    {
+        while (true)
+        {
+            bool commit, urgent, idle;
+            uint64_t req;
+            Clock::time_point since;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond_work.wait(lock, [&]() { return _stop || hasWork(); });
+                if (_stop && !hasWork())
+                    break;
+
+                _pending.swap(_writing);
+                commit = _commit;
+                urgent = _urgent;
+                idle = _idle;
+                req = _flush_req;
+                since = _oldest;
+                _commit = _urgent = _idle = false;
+                _queued_bytes.store(0, std::memory_order_relaxed);
+                _writing_since = since;
+                _cond_space.notify_all();
+            }
+
+            size_t len = _writing.readAbleSize();
+            try
+            {
+                if (len > 0)
+                    _sink->logBuffer(_writing);
+                if (req > _flush_done)
+                    _sink->flush();
+                else if (commit)
+                    _sink->commit(urgent);
+                if (idle)
+                    _sink->idle();
+            }
+            catch (const std::exception& e)
+            {
+                report(e);
+            }
+            _writing.reset();
+
+            if (len > 0)
+            {
+                _written_bytes.fetch_add(len, std::memory_order_relaxed);
+                _lag.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                                 since)
+                                .count());
+            }
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _writing_since = Clock::time_point();
+            _flush_done = req;
+            _cond_flush.notify_all();
+        }
+    }
+
+    bool hasWork() { return !_pending.empty() || _commit || _idle || _flush_req > _flush_done; }
+
+    void report(const std::exception& e)
+    {
+        if (_on_error)
+            _on_error(e);
+        else
+            std::cerr << "AsyncSink: " << e.what() << std::endl;
+    }
+
+    // 为一批len字节的数据在队列中留出空间, 丢弃模式下放不下时整批丢弃并返回false
+    bool reserve(std::unique_lock<std::mutex>& lock, size_t len)
+    {
+        auto full = [&]() {
+            return !_pending.empty() && _pending.readAbleSize() + len > _queue._capacity;
+        };
+        if (full())
+        {
+            if (_queue._mode == SinkQueue::mode::DROP)
+            {
+                _dropped_bytes.fetch_add(len, std::memory_order_relaxed);
+                _dropped_batches.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            auto start = Clock::now();
+            _cond_space.wait(lock, [&]() { return _stop || !full(); });
+            _blocked_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start)
+                    .count(),
+                std::memory_order_relaxed);
+        }
+
+        if (_pending.empty())
+            _oldest = Clock::now();
+        return true;
+    }
+
+    void queued()
+    {
+        _queued_bytes.store(_pending.readAbleSize(), std::memory_order_relaxed);
+        _cond_work.notify_one();
+    }
+
+   public:
+    using ErrorHandler = std::function<void(const std::exception&)>;
+
+    AsyncSink(LogSink::ptr sink, const SinkQueue& queue = SinkQueue())
+        : _sink(std::move(sink)),
+          _queue(queue),
+          _pending(std::min<size_t>(queue._capacity, BUFFER_SIZE)),
+          _writing(std::min<size_t>(queue._capacity, BUFFER_SIZE)),
+          _stop(false),
+          _commit(false),
+          _urgent(false),
+          _idle(false),
+          _flush_req(0),
+          _flush_done(0),
+          _queued_bytes(0),
+          _written_bytes(0),
+          _dropped_bytes(0),
+          _dropped_batches(0),
+          _blocked_ns(0),
+          _thread(&AsyncSink::threadEntry, this)
+    {
+    }
+
+    // 写完队列中剩余的数据后再退出工作线程
+    ~AsyncSink() override
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stop = true;
+            _cond_work.notify_all();
+            _cond_space.notify_all();
+        }
+        _thread.join();
+    }
+
+    void log(const char* data, size_t len) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!reserve(lock, len))
+            return;
+        _pending.push(data, len);
+        queued();
+    }
+
+    // 分段交来的一批数据作为整体入队或丢弃, 不会只留下其中一部分
+    void logv(const struct iovec* iov, int iovcnt) override
+    {
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+        if (len == 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!reserve(lock, len))
+            return;
+        for (int i = 0; i < iovcnt; ++i)
+            _pending.push(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        queued();
+    }
+
+    // 提交推迟到这批数据写完之后, 在工作线程上进行
+    void commit(bool urgent) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _commit = true;
+        _urgent = _urgent || urgent;
+        _cond_work.notify_one();
+    }
+
+    // 同样推迟到已经交来的数据写完之后
+    void idle() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle = true;
+        _cond_work.notify_one();
+    }
+
+    void flush() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        uint64_t seq = ++_flush_req;
+        _cond_work.notify_one();
+        _cond_flush.wait(lock, [&]() { return _stop || _flush_done >= seq; });
+    }
+
+    // 需要在开始写日志之前设置
+    void setErrorHandler(ErrorHandler handler) { _on_error = std::move(handler); }
+
+    const LogSink::ptr& sink() const { return _sink; }
+
+    // 以下指标可以在任意线程读取
+    // 队列中尚未交给工作线程的字节数
+    size_t queuedBytes() const { return _queued_bytes.load(std::memory_order_relaxed); }
+    uint64_t writtenBytes() const { return _written_bytes.load(std::memory_order_relaxed); }
+    uint64_t droppedBytes() const { return _dropped_bytes.load(std::memory_order_relaxed); }
+    uint64_t droppedBatches() const { return _dropped_batches.load(std::memory_order_relaxed); }
+    // 交数据的线程因为队列已满累计等待的时间
+    uint64_t blockedNs() const { return _blocked_ns.load(std::memory_order_relaxed); }
+    // 每批数据从进入队列到写完的延迟分布
+    const SyncStats& lagStats() const { return _lag; }
+
+    // 当前滞后: 最早一批尚未写完的数据已经等待的时间, 没有积压时为0
+    std::chrono::microseconds lag()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        Clock::time_point since = _writing_since;
+        if (since == Clock::time_point() && !_pending.empty())
+            since = _oldest;
+        if (since == Clock::time_point())
+            return std::chrono::microseconds(0);
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since);
+    }
+
+   private:
+    LogSink::ptr _sink;
+    SinkQueue _queue;
+    ErrorHandler _on_error;
+
+    std::mutex _mutex;
+    std::condition_variable _cond_work;   // 唤醒工作线程
+    std::condition_variable _cond_space;  // 唤醒等待队列空间的线程
+    std::condition_variable _cond_flush;  // 唤醒等待刷新完成的线程
+    Buffer _pending;                      // 接收新数据
+    Buffer _writing;                      // 工作线程正在写的数据
+    Clock::time_point _oldest;            // _pending中最早数据的入队时间
+    Clock::time_point _writing_since;     // _writing的入队时间, 空闲时为默认值
+    bool _stop;
+    bool _commit;
+    bool _urgent;
+    bool _idle;  // 写完已有数据后调用被包装落地方向的idle
+    uint64_t _flush_req;
+    uint64_t _flush_done;
+
+    std::atomic<size_t> _queued_bytes;
+    std::atomic<uint64_t> _written_bytes;
+    std::atomic<uint64_t> _dropped_bytes;
+    std::atomic<uint64_t> _dropped_batches;
+    std::atomic<uint64_t> _blocked_ns;
+    SyncStats _lag;
+
+    // 最后初始化, 确保线程启动时其它成员已经就绪
+    std::thread _thread;
+};
+
 class SinkFactory
 {
    public:
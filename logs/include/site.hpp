@@ -0,0 +1,35 @@
+/*
+    调用点元数据
+    每个日志调用点在宏展开时生成一个静态常量记录, 之后每次调用只传递它的地址,
+    不再为__FILE__构造临时字符串, 文件基础名也在编译期截取完成
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace windlog {
+/*
+    只记录文件与行号; 等级由调用的接口决定, 格式化字符串随每次调用传入
+    ({}风格的格式化字符串是编译期类型, 传递它没有运行期开销)
+*/
+struct LogSite
+{
+    std::string_view _file;  // 源文件基础名
+    uint32_t _line;
+
+    static constexpr std::string_view basename(std::string_view pathname)
+    {
+        size_t pos = pathname.find_last_of("/\\");
+        return pos == std::string_view::npos ? pathname : pathname.substr(pos + 1);
+    }
+};
+
+// 生成当前调用点的静态元数据, 返回其地址
+#define WINDLOG_SITE()                                                                          \
+    ([]() -> const windlog::LogSite* {                                                          \
+        static constexpr windlog::LogSite site{windlog::LogSite::basename(__FILE__), __LINE__}; \
+        return &site;                                                                           \
+    }())
+}  // namespace windlog
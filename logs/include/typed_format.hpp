@@ -0,0 +1,253 @@
+/*
+    类型安全的{}风格格式化
+    1. 格式化字符串通过WINDLOG_FMT包装成编译期字符串类型, 占位符个数与参数个数在编译期检查
+    2. 参数类型依据模板推导, 不再经过C的不定参数, 也就不存在类型不匹配的问题
+    3. 直接向调用者提供的输出对象(std::string, 定长字符数组)追加, 不做额外的堆分配
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace windlog {
+
+/*
+    编译期字符串的标记基类
+    WINDLOG_FMT为每个格式化字符串生成一个独立的派生类型, 字符串本身由静态constexpr函数提供,
+    这样就能在模板内部使用static_assert对其进行检查
+*/
+struct CompileString
+{
+};
+
+#define WINDLOG_FMT(str)                                                         \
+    [] {                                                                         \
+        struct FmtString : windlog::CompileString                                \
+        {                                                                        \
+            static constexpr std::string_view value() { return str; }            \
+        };                                                                       \
+        return FmtString{};                                                      \
+    }()
+
+template <typename S>
+using enable_if_compile_string =
+    std::enable_if_t<std::is_base_of<CompileString, std::decay_t<S>>::value, int>;
+
+/*
+    向定长字符数组中输出, 超出部分截断, 但仍然统计完整长度, 与snprintf的语义一致
+*/
+class FixedWriter
+{
+   public:
+    FixedWriter(char* buf, size_t size) : _buf(buf), _size(size), _len(0) {}
+
+    void append(const char* data, size_t len)
+    {
+        if (_len < _size)
+            memcpy(_buf + _len, data, std::min(len, _size - _len));
+        _len += len;
+    }
+
+    size_t length() const { return _len; }
+
+   private:
+    char* _buf;
+    size_t _size;
+    size_t _len;
+};
+
+class TypedFormat
+{
+   public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // 统计占位符个数, 格式非法时返回npos
+    // 目前只支持{}, 以及{{ }}两种转义
+    static constexpr size_t countArgs(std::string_view fmt)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < fmt.size(); ++i)
+        {
+            if (fmt[i] == '{')
+            {
+                if (i + 1 < fmt.size() && fmt[i + 1] == '{')
+                    ++i;
+                else if (i + 1 < fmt.size() && fmt[i + 1] == '}')
+                    ++i, ++n;
+                else
+                    return npos;
+            }
+            else if (fmt[i] == '}')
+            {
+                if (i + 1 < fmt.size() && fmt[i + 1] == '}')
+                    ++i;
+                else
+                    return npos;
+            }
+        }
+        return n;
+    }
+
+    // 判断某个类型能否被格式化
+    template <typename T>
+    static constexpr bool formattable()
+    {
+        using U = std::decay_t<T>;
+        return std::is_arithmetic<U>::value || std::is_pointer<U>::value ||
+               std::is_same<U, std::nullptr_t>::value || std::is_same<U, std::string>::value ||
+               std::is_same<U, std::string_view>::value;
+    }
+
+    template <typename... Args>
+    static constexpr bool check(std::string_view fmt)
+    {
+        return countArgs(fmt) == sizeof...(Args);
+    }
+
+    // 按格式化字符串将参数追加到out, Writer需提供append(const char*, size_t)
+    template <typename Writer, typename... Args>
+    static void format(Writer& out, std::string_view fmt, const Args&... args)
+    {
+        size_t pos = formatImpl(out, fmt, 0, args...);
+        writeLiteral(out, fmt, pos, fmt.size());
+    }
+
+    // 输出到定长数组, 返回完整输出所需的长度(不含'\0')
+    template <typename... Args>
+    static size_t formatTo(char* buf, size_t size, std::string_view fmt, const Args&... args)
+    {
+        FixedWriter out(buf, size);
+        format(out, fmt, args...);
+        return out.length();
+    }
+
+   private:
+    // 输出[from, to)之间的字面量, 处理{{与}}转义
+    template <typename Writer>
+    static void writeLiteral(Writer& out, std::string_view fmt, size_t from, size_t to)
+    {
+        size_t start = from;
+        for (size_t i = from; i < to; ++i)
+        {
+            if ((fmt[i] == '{' || fmt[i] == '}') && i + 1 < to && fmt[i + 1] == fmt[i])
+            {
+                out.append(fmt.data() + start, i + 1 - start);
+                start = ++i + 1;
+            }
+        }
+        out.append(fmt.data() + start, to - start);
+    }
+
+    // 找到下一个{}占位符的位置
+    static size_t nextArg(std::string_view fmt, size_t pos)
+    {
+        for (size_t i = pos; i + 1 < fmt.size(); ++i)
+        {
+            if (fmt[i] == '{')
+            {
+                if (fmt[i + 1] == '}')
+                    return i;
+                ++i;
+            }
+            else if (fmt[i] == '}')
+            {
+                ++i;
+            }
+        }
+        return fmt.size();
+    }
+
+    template <typename Writer>
+    static size_t formatImpl(Writer&, std::string_view, size_t pos)
+    {
+        return pos;
+    }
+
+    template <typename Writer, typename T, typename... Rest>
+    static size_t formatImpl(Writer& out, std::string_view fmt, size_t pos, const T& first,
+                             const Rest&... rest)
+    {
+        size_t arg = nextArg(fmt, pos);
+        writeLiteral(out, fmt, pos, arg);
+        writeValue(out, first);
+        return formatImpl(out, fmt, arg + 2, rest...);
+    }
+
+    // bool与char单独处理, 不作为整数输出
+    template <typename Writer, typename T>
+    static std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value &&
+                            !std::is_same<T, char>::value>
+    writeValue(Writer& out, T value)
+    {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, res.ptr - buf);
+    }
+
+    template <typename Writer, typename T>
+    static std::enable_if_t<std::is_floating_point<T>::value> writeValue(Writer& out, T value)
+    {
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, res.ptr - buf);
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, bool value)
+    {
+        if (value)
+            out.append("true", 4);
+        else
+            out.append("false", 5);
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, char value)
+    {
+        out.append(&value, 1);
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, const char* value)
+    {
+        if (value == nullptr)
+            out.append("(null)", 6);
+        else
+            out.append(value, strlen(value));
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, std::string_view value)
+    {
+        out.append(value.data(), value.size());
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, const std::string& value)
+    {
+        out.append(value.data(), value.size());
+    }
+
+    template <typename Writer>
+    static void writeValue(Writer& out, std::nullptr_t)
+    {
+        out.append("0x0", 3);
+    }
+
+    // 其它指针输出为十六进制地址
+    template <typename Writer, typename T>
+    static void writeValue(Writer& out, const T* value)
+    {
+        char buf[24] = {'0', 'x'};
+        auto res =
+            std::to_chars(buf + 2, buf + sizeof(buf), reinterpret_cast<uintptr_t>(value), 16);
+        out.append(buf, res.ptr - buf);
+    }
+};
+}  // namespace windlog
@@ -0,0 +1,190 @@
+/*
+    io_uring的最小封装
+    直接使用系统调用, 不依赖liburing; 只提供日志落地需要的写请求提交与完成事件收取
+    内核不支持或被禁用时valid()返回false, 由使用者退化为其它方式
+*/
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace windlog {
+class IoUring
+{
+    static int setup(unsigned entries, struct io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        int ret;
+        do
+        {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, _ring_fd, to_submit,
+                                           min_complete, flags, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+        return ret;
+    }
+
+    static unsigned* at(void* base, uint32_t offset)
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(base) + offset);
+    }
+
+    // 创建环并映射共享内存, 任何一步失败都返回false
+    bool init(unsigned entries)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        _ring_fd = setup(entries, &params);
+        if (_ring_fd < 0)
+            return false;
+
+        _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        // 新内核上两个环共用一次映射
+        _single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (_single_mmap)
+            _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+        _sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       _ring_fd, IORING_OFF_SQ_RING);
+        if (_sq_ptr == MAP_FAILED)
+            return false;
+        _cq_ptr = _single_mmap ? _sq_ptr
+                               : mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_ptr == MAP_FAILED)
+            return false;
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, _sqes_size,
+                                                       PROT_READ | PROT_WRITE,
+                                                       MAP_SHARED | MAP_POPULATE, _ring_fd,
+                                                       IORING_OFF_SQES));
+        if (_sqes == MAP_FAILED)
+            return false;
+
+        _sq_head = at(_sq_ptr, params.sq_off.head);
+        _sq_tail = at(_sq_ptr, params.sq_off.tail);
+        _sq_mask = *at(_sq_ptr, params.sq_off.ring_mask);
+        _sq_array = at(_sq_ptr, params.sq_off.array);
+        _cq_head = at(_cq_ptr, params.cq_off.head);
+        _cq_tail = at(_cq_ptr, params.cq_off.tail);
+        _cq_mask = *at(_cq_ptr, params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<struct io_uring_cqe*>(static_cast<char*>(_cq_ptr) +
+                                                       params.cq_off.cqes);
+        return true;
+    }
+
+   public:
+    explicit IoUring(unsigned entries)
+        : _ring_fd(-1),
+          _sq_ptr(MAP_FAILED),
+          _cq_ptr(MAP_FAILED),
+          _sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED))
+    {
+        if (!init(entries))
+            release();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    ~IoUring() { release(); }
+
+    bool valid() const { return _ring_fd >= 0; }
+
+    /*
+        提交一个写请求, 在offset处写入len字节, 完成事件带回user_data
+        调用者需保证未完成的请求数不超过创建时的entries, 提交队列不会溢出
+        返回负的errno表示提交失败, 此时请求已经从提交队列撤回, 内核不会再执行它
+    */
+    int write(int fd, const void* data, unsigned len, uint64_t offset, uint64_t user_data)
+    {
+        unsigned tail = *_sq_tail;
+        unsigned idx = tail & _sq_mask;
+        struct io_uring_sqe* sqe = &_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        _sq_array[idx] = idx;
+        __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        int ret = enter(1, 0, 0);
+        if (ret >= 1)
+            return 0;
+        int err = ret < 0 ? errno : EAGAIN;
+        // 内核已经取走请求时它一定会产生完成事件, 按提交成功处理
+        if (__atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) != tail)
+            return 0;
+        // 没有线程轮询提交队列, 只在io_uring_enter中才会取走请求, 撤回是安全的
+        __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+        return -err;
+    }
+
+    // 收取一个完成事件, res为请求的返回值(负数为-errno); wait为true时没有事件则阻塞等待
+    bool reap(uint64_t& user_data, int& res, bool wait)
+    {
+        while (true)
+        {
+            unsigned head = *_cq_head;
+            if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+            {
+                struct io_uring_cqe* cqe = &_cqes[head & _cq_mask];
+                user_data = cqe->user_data;
+                res = cqe->res;
+                __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (!wait || enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+                return false;
+        }
+    }
+
+   private:
+    void release()
+    {
+        if (_sqes != MAP_FAILED)
+            munmap(_sqes, _sqes_size);
+        if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr)
+            munmap(_cq_ptr, _cq_size);
+        if (_sq_ptr != MAP_FAILED)
+            munmap(_sq_ptr, _sq_size);
+        if (_ring_fd >= 0)
+            close(_ring_fd);
+        _sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+        _cq_ptr = _sq_ptr = MAP_FAILED;
+        _ring_fd = -1;
+    }
+
+    int _ring_fd;
+    bool _single_mmap;
+    void* _sq_ptr;
+    void* _cq_ptr;
+    struct io_uring_sqe* _sqes;
+    size_t _sq_size;
+    size_t _cq_size;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned _cq_mask;
+    struct io_uring_cqe* _cqes;
+};
+}  // namespace windlog
@@ -8,7 +8,9 @@
 
 #include <sys/stat.h>
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace windlog {
 namespace util {
@@ -60,6 +62,40 @@ class file
             return pathname.substr(pos + 1);  // 跳过分隔符
     }
 
+    // 与basename相同, 但只返回指向原字符串的视图, 不拷贝
+    static std::string_view basenameView(std::string_view pathname)
+    {
+        size_t pos = pathname.find_last_of("/\\");
+        if (pos == std::string_view::npos)
+            return pathname;
+        else
+            return pathname.substr(pos + 1);
+    }
+
+    /*
+        获取静态文件名(例如__FILE__)的基础名, 结果直接指向原字符串
+        以指针为键缓存在线程本地的直接映射表中, 同一调用点只需计算一次, 也不需要加锁
+        只按地址判断是否命中, 传入的必须是内容不变的字符串字面量;
+        调用者传入的任意const char*可能已经释放或者被改写, 应当使用basenameView
+    */
+    static std::string_view internBasename(const char* pathname)
+    {
+        struct Entry
+        {
+            const char* _key;
+            std::string_view _base;
+        };
+        thread_local Entry cache[256] = {};
+
+        Entry& entry = cache[(reinterpret_cast<uintptr_t>(pathname) >> 3) % 256];
+        if (entry._key != pathname)
+        {
+            entry._key = pathname;
+            entry._base = basenameView(pathname);
+        }
+        return entry._base;
+    }
+
     static std::string stem(const std::string& basename)
     {
         size_t pos = basename.find_last_of('.');
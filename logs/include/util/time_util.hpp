@@ -5,12 +5,200 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+    日志时间戳的时钟源, 用户可通过定义 CONFIG_CLOCK_SOURCE 来选择
+    WINDLOG_CLOCK_COARSE    CLOCK_REALTIME_COARSE, 开销最小, 精度为内核时钟节拍(通常1~4ms)
+    WINDLOG_CLOCK_PRECISE   CLOCK_REALTIME, 纳秒精度, 开销是前者的数倍
+    WINDLOG_CLOCK_TSC       按墙上时钟校准的TSC计数器, 纳秒精度, 定期重新同步
+*/
+#define WINDLOG_CLOCK_COARSE 0
+#define WINDLOG_CLOCK_PRECISE 1
+#define WINDLOG_CLOCK_TSC 2
+
+#ifdef CONFIG_CLOCK_SOURCE
+#define CLOCK_SOURCE CONFIG_CLOCK_SOURCE
+#else
+#define CLOCK_SOURCE WINDLOG_CLOCK_COARSE
+#endif
+
 namespace windlog {
 namespace util {
+
+/*
+    TSC时钟
+    读取时间戳计数器, 再按校准参数换算成墙上时间, 避免每次都进入vDSO
+    校准参数以顺序锁保护, 超过同步周期后由恰好读到的线程重新与CLOCK_REALTIME对齐
+    每个计数的纳秒数以首次校准点为起点计算, 运行越久越精确;
+    同步周期从50ms开始逐次翻倍, 最长一秒, 尽快消除首次校准的误差
+    不支持TSC的平台退化为CLOCK_REALTIME
+*/
+class TscClock
+{
+   public:
+    static void now(time_t& sec, uint32_t& nsec)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        TscClock& clock = instance();
+        uint64_t tsc = __rdtsc();
+
+        uint64_t seq, base_tsc;
+        int64_t base_ns;
+        double ns_per_tick;
+        do
+        {
+            seq = clock._seq.load(std::memory_order_acquire);
+            base_tsc = clock._base_tsc.load(std::memory_order_relaxed);
+            base_ns = clock._base_ns.load(std::memory_order_relaxed);
+            ns_per_tick = clock._ns_per_tick.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != clock._seq.load(std::memory_order_relaxed));
+
+        // 计数器在不同核心间可能略有偏差, 不允许早于同步点
+        uint64_t ticks = tsc > base_tsc ? tsc - base_tsc : 0;
+        if (ticks > clock._resync_ticks.load(std::memory_order_relaxed))
+            clock.resync();
+
+        int64_t ns = base_ns + static_cast<int64_t>(ticks * ns_per_tick);
+        sec = ns / 1000000000;
+        nsec = ns % 1000000000;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        sec = ts.tv_sec;
+        nsec = ts.tv_nsec;
+#endif
+    }
+
+   private:
+#if defined(__x86_64__) || defined(__i386__)
+    static TscClock& instance()
+    {
+        static TscClock clock;
+        return clock;
+    }
+
+    static int64_t realtime()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    // 首次使用时以10ms的间隔粗略校准, 先空转几次让vDSO与缓存预热
+    TscClock() : _seq(0), _resyncing(false)
+    {
+        for (int i = 0; i < 8; ++i) realtime(), __rdtsc();
+
+        _anchor_tsc = __rdtsc();
+        _anchor_ns = realtime();
+        int64_t ns = _anchor_ns;
+        while (ns - _anchor_ns < 10000000) ns = realtime();
+        uint64_t tsc = __rdtsc();
+
+        double ns_per_tick = static_cast<double>(ns - _anchor_ns) / (tsc - _anchor_tsc);
+        _base_tsc.store(tsc, std::memory_order_relaxed);
+        _base_ns.store(ns, std::memory_order_relaxed);
+        _ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+        _resync_ticks.store(static_cast<uint64_t>(50000000 / ns_per_tick),
+                            std::memory_order_relaxed);
+        _max_resync_ticks = static_cast<uint64_t>(1000000000 / ns_per_tick);
+    }
+
+    void resync()
+    {
+        // 只需一个线程完成同步, 其它线程继续使用旧参数
+        if (_resyncing.exchange(true, std::memory_order_acquire))
+            return;
+
+        uint64_t tsc = __rdtsc();
+        int64_t ns = realtime();
+
+        double ns_per_tick = _ns_per_tick.load(std::memory_order_relaxed);
+        if (tsc > _anchor_tsc && ns > _anchor_ns)
+            ns_per_tick = static_cast<double>(ns - _anchor_ns) / (tsc - _anchor_tsc);
+
+        _seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _base_tsc.store(tsc, std::memory_order_relaxed);
+        _base_ns.store(ns, std::memory_order_relaxed);
+        _ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+        _seq.fetch_add(1, std::memory_order_release);
+
+        uint64_t period = _resync_ticks.load(std::memory_order_relaxed);
+        if (period < _max_resync_ticks)
+            _resync_ticks.store(std::min(period * 2, _max_resync_ticks),
+                                std::memory_order_relaxed);
+
+        _resyncing.store(false, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> _seq;  // 顺序锁, 奇数表示正在更新
+    std::atomic<uint64_t> _base_tsc;
+    std::atomic<int64_t> _base_ns;
+    std::atomic<double> _ns_per_tick;
+
+    uint64_t _anchor_tsc;  // 首次校准点, 构造后不再修改
+    int64_t _anchor_ns;
+    std::atomic<uint64_t> _resync_ticks;  // 当前的同步周期
+    uint64_t _max_resync_ticks;
+    std::atomic<bool> _resyncing;
+#endif
+};
+
 class Date
 {
    public:
     static time_t now() { return time(nullptr);}
+
+    // 获取带纳秒部分的当前时间, 时钟源由 CLOCK_SOURCE 决定
+    static void now(time_t& sec, uint32_t& nsec)
+    {
+#if CLOCK_SOURCE == WINDLOG_CLOCK_TSC
+        TscClock::now(sec, nsec);
+#elif CLOCK_SOURCE == WINDLOG_CLOCK_PRECISE
+        clockNow(CLOCK_REALTIME, sec, nsec);
+#else
+        clockNow(CLOCK_REALTIME_COARSE, sec, nsec);
+#endif
+    }
+
+    static void clockNow(clockid_t clock, time_t& sec, uint32_t& nsec)
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        sec = ts.tv_sec;
+        nsec = ts.tv_nsec;
+    }
+
+    /*
+        带线程本地缓存的localtime_r
+        localtime_r每次调用都要获取glibc内部的时区锁, 多线程下争用明显
+        时区与夏令时的切换都发生在整分钟上, 所以同一分钟之内只需推算秒数,
+        每个线程每分钟最多调用一次localtime_r
+    */
+    static void localtime(time_t t, struct tm& result)
+    {
+        thread_local bool valid = false;
+        thread_local time_t minute = 0;  // 缓存所在分钟的起始时间
+        thread_local struct tm cached;
+
+        if (!valid || t < minute || t >= minute + 60)
+        {
+            localtime_r(&t, &cached);
+            minute = t - cached.tm_sec;
+            valid = true;
+        }
+        result = cached;
+        result.tm_sec = static_cast<int>(t - minute);
+    }
 };
 }  // namespace util
 }  // namespace windlog
@@ -18,20 +18,79 @@ inline Logger::ptr rootLogger()
     return LoggerManager::getInstance().rootLogger();
 }
 
-#define DEBUG(fmt, ...) debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define INFO(fmt, ...) info(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define WARN(fmt, ...) warn(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define ERROR(fmt, ...) error(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define FATAL(fmt, ...) fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+/*
+    编译期日志等级下限, 在包含本头文件之前定义, 例如
+        #define WINDLOG_ACTIVE_LEVEL WINDLOG_LEVEL_INFO
+    低于它的宏调用在编译期直接消除, 参数不会求值, 也不会生成任何代码
+    默认保留全部等级
+*/
+#define WINDLOG_LEVEL_DEBUG 1
+#define WINDLOG_LEVEL_INFO 2
+#define WINDLOG_LEVEL_WARN 3
+#define WINDLOG_LEVEL_ERROR 4
+#define WINDLOG_LEVEL_FATAL 5
+#define WINDLOG_LEVEL_OFF 6
+
+#ifndef WINDLOG_ACTIVE_LEVEL
+#define WINDLOG_ACTIVE_LEVEL WINDLOG_LEVEL_DEBUG
+#endif
 
-// WI__LOG 负责依据日志等级, 使用指定日志器进行日志输出
+static_assert(WINDLOG_LEVEL_DEBUG == static_cast<int>(LogLevel::value::DEBUG) &&
+                  WINDLOG_LEVEL_OFF == static_cast<int>(LogLevel::value::OFF),
+              "WINDLOG_LEVEL_* must match LogLevel::value");
+
+/*
+    宏接口为每个调用点生成静态元数据, 每次调用只传递其地址
+    在包含本头文件之前定义 WINDLOG_TYPED_FORMAT, 宏接口就改用编译期检查的{}风格格式化
+*/
+#ifdef WINDLOG_TYPED_FORMAT
+#define WINDLOG_CALL(fmt) WINDLOG_SITE(), WINDLOG_FMT(fmt)
+#else
+#define WINDLOG_CALL(fmt) WINDLOG_SITE(), fmt
+#endif
+
+#if WINDLOG_ACTIVE_LEVEL <= WINDLOG_LEVEL_DEBUG
+#define DEBUG(fmt, ...) debug(WINDLOG_CALL(fmt), ##__VA_ARGS__)
 #define WI__DEBUG(logger, fmt, ...) logger->DEBUG(fmt, ##__VA_ARGS__)
+#else
+#define DEBUG(fmt, ...) disabled()
+#define WI__DEBUG(logger, fmt, ...) (void)0
+#endif
+
+#if WINDLOG_ACTIVE_LEVEL <= WINDLOG_LEVEL_INFO
+#define INFO(fmt, ...) info(WINDLOG_CALL(fmt), ##__VA_ARGS__)
 #define WI__INFO(logger, fmt, ...) logger->INFO(fmt, ##__VA_ARGS__)
+#else
+#define INFO(fmt, ...) disabled()
+#define WI__INFO(logger, fmt, ...) (void)0
+#endif
+
+#if WINDLOG_ACTIVE_LEVEL <= WINDLOG_LEVEL_WARN
+#define WARN(fmt, ...) warn(WINDLOG_CALL(fmt), ##__VA_ARGS__)
 #define WI__WARN(logger, fmt, ...) logger->WARN(fmt, ##__VA_ARGS__)
+#else
+#define WARN(fmt, ...) disabled()
+#define WI__WARN(logger, fmt, ...) (void)0
+#endif
+
+#if WINDLOG_ACTIVE_LEVEL <= WINDLOG_LEVEL_ERROR
+#define ERROR(fmt, ...) error(WINDLOG_CALL(fmt), ##__VA_ARGS__)
 #define WI__ERROR(logger, fmt, ...) logger->ERROR(fmt, ##__VA_ARGS__)
+#else
+#define ERROR(fmt, ...) disabled()
+#define WI__ERROR(logger, fmt, ...) (void)0
+#endif
+
+#if WINDLOG_ACTIVE_LEVEL <= WINDLOG_LEVEL_FATAL
+#define FATAL(fmt, ...) fatal(WINDLOG_CALL(fmt), ##__VA_ARGS__)
 #define WI__FATAL(logger, fmt, ...) logger->FATAL(fmt, ##__VA_ARGS__)
+#else
+#define FATAL(fmt, ...) disabled()
+#define WI__FATAL(logger, fmt, ...) (void)0
+#endif
 
-// LOG使用默认日志器进行输出
+// WI__LOG 负责依据日志等级, 使用指定日志器进行日志输出(见上)
+// LOG使用默认日志器进行输出, 被消除的等级不会去获取默认日志器
 #define LOG__DEBUG(fmt, ...) WI__DEBUG(windlog::rootLogger(), fmt, ##__VA_ARGS__)
 #define LOG__INFO(fmt, ...) WI__INFO(windlog::rootLogger(), fmt, ##__VA_ARGS__)
 #define LOG__WARN(fmt, ...) WI__WARN(windlog::rootLogger(), fmt, ##__VA_ARGS__)
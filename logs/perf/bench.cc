@@ -1,5 +1,9 @@
 #include "windlog.hpp"
 #include<chrono>
+#include<cstdlib>
+#include<filesystem>
+#include<fstream>
+#include<sys/uio.h>
 
 void bench(const std::string& logger_name, size_t thr_count, size_t msg_count, size_t msg_len,
            bool flag)
@@ -96,10 +100,207 @@ void async_bench() {
     builder->build();
 
     bench("async_logger", 3, 1000000, 100, false);
+
+    // 扩容模式下放不下的日志从进程内共用的片段池中取内存
+    auto& pool = windlog::SegmentPool::global();
+    LOG__INFO("片段池: 当前%zuKB, 峰值%zuKB", pool->usage() / 1024, pool->peak() / 1024);
 }
 
-int main()
+// 异步 + 透明大页, 缓冲区放在异步线程所在的NUMA节点上
+void async_hugepage_bench() {
+    std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::GlobalLoggerBuilder());
+    builder->buildLoggerName("async_hugepage_logger");
+    builder->buildLoggerFormatter("%m%n");
+    builder->buildLoggerType(windlog::LoggerBuilder::LoggerType::LOGGER_ASYNC);
+    builder->buildLoggerMode(windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK);
+    builder->buildLoggerMemory(
+        windlog::MemoryPolicy::transparentHuge(windlog::MemoryPolicy::CONSUMER_NODE));
+    builder->buildLoggerSink<windlog::FileSink>("./logfile/sync.log");
+
+    builder->build();
+
+    bench("async_hugepage_logger", 3, 1000000, 100, false);
+}
+
+// 异步 + 线程本地暂存测试
+void async_staging_bench() {
+    std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::GlobalLoggerBuilder());
+    builder->buildLoggerName("async_staging_logger");
+    builder->buildLoggerFormatter("%m%n");
+    builder->buildLoggerType(windlog::LoggerBuilder::LoggerType::LOGGER_ASYNC);
+    builder->buildLoggerMode(windlog::AsyncLooper::mode::ON_BUFFER_FULL_EXPAND);
+    builder->buildLoggerStaging(64 * 1024);
+    builder->buildLoggerSink<windlog::FileSink>("./logfile/sync.log");
+
+    builder->build();
+
+    bench("async_staging_logger", 3, 1000000, 100, false);
+}
+
+// path处数据的字节数, 目录按其中所有文件累加
+size_t disk_size(const std::string& path)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec))
+    {
+        size_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+    size_t size = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path, ec))
+    {
+        if (entry.is_regular_file(ec))
+            size += entry.file_size(ec);
+    }
+    return size;
+}
+
+// 落地方向吞吐测试: 模拟异步线程, 以batch_size大小的批次直接写入total字节
+// segments大于1时把每个批次拆成多段, 通过logv一次交给落地方向
+// path为落地方向写入的文件或目录, 测完核对写入的数据量后删除, 不在磁盘上留下测试数据
+// args用于构造SinkType类型的落地方向
+template <typename SinkType, typename... Args>
+void sink_bench(const std::string& name, const std::string& path, size_t batch_size,
+                size_t total, int segments, Args&&... args)
 {
+    // 清掉上次运行中断时留下的文件, 落地方向总是从空文件开始写
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+    windlog::LogSink::ptr sink = std::make_shared<SinkType>(std::forward<Args>(args)...);
+
+    std::string batch(batch_size, 'a');
+    for (size_t i = 99; i < batch_size; i += 100) batch[i] = '\n';
+
+    std::vector<struct iovec> iov(segments);
+    size_t seg_len = batch_size / segments;
+    for (int i = 0; i < segments; ++i)
+        iov[i] = {&batch[i * seg_len], i + 1 == segments ? batch_size - i * seg_len : seg_len};
+
+    size_t written = 0;
+    std::string error;
+    auto start = std::chrono::high_resolution_clock::now();
+    try
+    {
+        for (; written < total; written += batch_size)
+        {
+            if (segments == 1)
+                sink->log(batch.data(), batch.size());
+            else
+                sink->logv(iov.data(), iov.size());
+        }
+        sink->flush();
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // 先销毁落地方向, 内存映射类的落地方向在关闭时才截掉预分配的尾部
+    sink.reset();
+    size_t size = disk_size(path);
+    std::filesystem::remove_all(path, ec);
+    if (!error.empty() || size != written)
+    {
+        LOG__ERROR("%-28s 批次%zuKB x %d段: 写入失败, 应写%zu字节, 实际%zu字节 %s", name.c_str(),
+                   batch_size / 1024, segments, written, size, error.c_str());
+        return;
+    }
+
+    std::chrono::duration<double> cost = end - start;
+    LOG__INFO("%-28s 批次%zuKB x %d段: %.2fMB/s", name.c_str(), batch_size / 1024, segments,
+              written / cost.count() / 1024 / 1024);
+}
+
+// ofstream与文件描述符两类落地方向的对比, 每一项写入total字节
+void sinks_bench(size_t total)
+{
+    const size_t roll_size = 16 * 1024 * 1024;
+    for (size_t batch_size : {4 * 1024, 64 * 1024, 1024 * 1024})
+    {
+        sink_bench<windlog::FileSink>("FileSink", "./logfile/sink_ofs.log", batch_size, total, 1,
+                                      "./logfile/sink_ofs.log");
+        sink_bench<windlog::FdFileSink>("FdFileSink", "./logfile/sink_fd.log", batch_size, total,
+                                        1, "./logfile/sink_fd.log");
+        sink_bench<windlog::FdFileSink>("FdFileSink(writev)", "./logfile/sink_fdv.log",
+                                        batch_size, total, 4, "./logfile/sink_fdv.log");
+        sink_bench<windlog::UringFileSink>("UringFileSink", "./logfile/sink_uring.log",
+                                           batch_size, total, 1, "./logfile/sink_uring.log");
+        sink_bench<windlog::MmapFileSink>("MmapFileSink", "./logfile/sink_mmap.log", batch_size,
+                                          total, 1, "./logfile/sink_mmap.log");
+        sink_bench<windlog::RollBySizeSink>("RollBySizeSink", "./logfile/roll_ofs", batch_size,
+                                            total, 1, roll_size, "./logfile/roll_ofs/roll");
+        sink_bench<windlog::FdRollBySizeSink>("FdRollBySizeSink", "./logfile/roll_fd",
+                                              batch_size, total, 1, roll_size,
+                                              "./logfile/roll_fd/roll");
+        sink_bench<windlog::MmapRollBySizeSink>("MmapRollBySizeSink", "./logfile/roll_mmap",
+                                                batch_size, total, 1, roll_size,
+                                                "./logfile/roll_mmap/roll");
+    }
+}
+
+// 从/proc/self/status中读取一项, 例如VmRSS(KB)与Threads
+size_t proc_status(const std::string& key)
+{
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        if (line.compare(0, key.size() + 1, key + ":") == 0)
+            return std::stoul(line.substr(key.size() + 1));
+    }
+    return 0;
+}
+
+// 大量异步日志器: 各自的线程与缓冲区 对比 共享后端
+void many_loggers_bench(bool shared, size_t logger_count = 60)
+{
+    auto backend = shared ? std::make_shared<windlog::SharedBackend>(2) : nullptr;
+    std::vector<windlog::Logger::ptr> loggers;
+    for (size_t i = 0; i < logger_count; ++i)
+    {
+        std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::LocalLoggerBuilder());
+        builder->buildLoggerName("many_logger" + std::to_string(i));
+        builder->buildLoggerFormatter("%m%n");
+        builder->buildLoggerType(windlog::LoggerBuilder::LoggerType::LOGGER_ASYNC);
+        builder->buildLoggerBackend(backend);
+        builder->buildLoggerSink<windlog::FdFileSink>("./logfile/many/" + std::to_string(i) +
+                                                      ".log");
+        loggers.push_back(builder->build());
+    }
+
+    const size_t thr_count = 3, msg_count = 1000000;
+    std::string mes(99, 'a');
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thr_count; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (size_t j = t; j < msg_count; j += thr_count)
+                loggers[j % logger_count]->fatal(__FILE__, __LINE__, "%s", mes.c_str());
+        });
+    }
+    for (auto& th : threads) th.join();
+    for (auto& logger : loggers) logger->flush();
+    std::chrono::duration<double> cost = std::chrono::high_resolution_clock::now() - start;
+
+    LOG__INFO("%zu个异步日志器(%s): %.0f条/s, 线程数%zu, 常驻内存%zuMB", logger_count,
+              shared ? "共享后端" : "各自线程", msg_count / cost.count(),
+              proc_status("Threads"), proc_status("VmRSS") / 1024);
+}
+
+// 用法: bench [sink_mb]
+// sink_mb为落地方向测试中每一项写入的MB数, 默认64, 为0时跳过落地方向测试
+int main(int argc, char* argv[])
+{
+    size_t sink_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+
     async_bench();
+    async_hugepage_bench();
+    async_staging_bench();
+    if (sink_mb > 0)
+        sinks_bench(sink_mb * 1024 * 1024);
+    many_loggers_bench(false);
+    many_loggers_bench(true);
     return 0;
 }
\ No newline at end of file
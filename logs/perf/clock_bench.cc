@@ -0,0 +1,73 @@
+/*
+    时间戳来源的开销对比
+    1. time(nullptr), 原先LogMsg使用的秒级时间
+    2. CLOCK_REALTIME_COARSE, 默认时钟源
+    3. CLOCK_REALTIME
+    4. 校准后的TSC
+*/
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "util/time_util.hpp"
+
+template <typename F>
+double measure(size_t count, F func)
+{
+    uint64_t sum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        time_t sec;
+        uint32_t nsec;
+        func(sec, nsec);
+        sum += sec + nsec;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    // 防止循环被优化掉
+    if (sum == 1)
+        std::cout << sum << std::endl;
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main()
+{
+    using windlog::util::Date;
+    using windlog::util::TscClock;
+
+    const size_t count = 10000000;
+
+    // 先完成TSC的首次校准
+    time_t sec;
+    uint32_t nsec;
+    TscClock::now(sec, nsec);
+
+    std::cout << "time(nullptr):         "
+              << measure(count, [](time_t& sec, uint32_t& nsec) {
+                     sec = Date::now();
+                     nsec = 0;
+                 })
+              << " ns/call" << std::endl;
+    std::cout << "CLOCK_REALTIME_COARSE: "
+              << measure(count, [](time_t& sec, uint32_t& nsec) {
+                     Date::clockNow(CLOCK_REALTIME_COARSE, sec, nsec);
+                 })
+              << " ns/call" << std::endl;
+    std::cout << "CLOCK_REALTIME:        "
+              << measure(count, [](time_t& sec, uint32_t& nsec) {
+                     Date::clockNow(CLOCK_REALTIME, sec, nsec);
+                 })
+              << " ns/call" << std::endl;
+    std::cout << "TSC:                   " << measure(count, TscClock::now) << " ns/call"
+              << std::endl;
+
+    // TSC与墙上时钟的偏差
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    TscClock::now(sec, nsec);
+    double drift = (sec - ts.tv_sec) * 1e9 + (static_cast<double>(nsec) - ts.tv_nsec);
+    std::cout << "TSC - CLOCK_REALTIME:  " << drift << " ns" << std::endl;
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+    日期格式化性能对比
+    1. 每条日志都调用localtime_r与strftime
+    2. DateFormatItem::formatTime, 线程本地缓存, 秒数变化时才重新渲染
+    多线程下前者还要争用glibc内部的时区锁
+*/
+
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "format.hpp"
+
+// 模拟日志时间戳, 每秒perSecond条日志
+const size_t perSecond = 100000;
+
+void formatDirect(windlog::Buffer& out, const char* time_fmt, time_t ctime)
+{
+    struct tm t;
+    localtime_r(&ctime, &t);
+    char buff[64] = {0};
+    size_t n = strftime(buff, sizeof(buff) - 1, time_fmt, &t);
+    out.push(buff, n);
+}
+
+template <typename F>
+double measure(size_t thr_count, size_t count, F func)
+{
+    std::vector<std::thread> threads;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < thr_count; ++i)
+    {
+        threads.emplace_back([&]() {
+            windlog::Buffer out(4096);
+            time_t base = time(nullptr);
+            for (size_t j = 0; j < count; ++j)
+            {
+                out.reset();
+                func(out, "%Y-%m-%d %H:%M:%S", base + j / perSecond);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (count * thr_count);
+}
+
+int main()
+{
+    const size_t count = 2000000;
+    for (size_t thr_count : {1, 4})
+    {
+        double direct_ns = measure(thr_count, count, formatDirect);
+        double cached_ns = measure(thr_count, count, [](windlog::Buffer& out, const char* fmt,
+                                                        time_t ctime) {
+            windlog::DateFormatItem::formatTime(out, fmt, ctime);
+        });
+
+        std::cout << "threads: " << thr_count << std::endl;
+        std::cout << "  localtime_r + strftime: " << direct_ns << " ns/msg" << std::endl;
+        std::cout << "  cached formatTime:      " << cached_ns << " ns/msg" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+    格式化器性能对比
+    1. 原有的类簇: vector<shared_ptr<FormatItem>>, 每项一次虚函数调用与一次智能指针拷贝
+    2. 运行期模式串: 扁平化指令数组 + switch分派
+    3. 编译期模式串: 指令序列在编译期展开, 完全内联
+*/
+
+#include <chrono>
+#include <iostream>
+
+#include "format.hpp"
+
+template <typename F>
+double measure(size_t count, F&& func)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) func();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+// 按照重构前Formatter::format的方式逐项调用
+void formatByItems(windlog::Buffer& out, const std::vector<windlog::FormatItem::ptr>& items,
+                   const windlog::LogMsg& msg)
+{
+    for (auto item : items)
+    {
+        item->format(out, msg);
+    }
+}
+
+// 每次格式化前复位缓冲区, 只衡量格式化本身的开销
+void report(size_t count, windlog::Buffer& out, const std::vector<windlog::FormatItem::ptr>& items,
+            windlog::Formatter& runtime, windlog::Formatter& compiled, const windlog::LogMsg& msg)
+{
+    double items_ns = measure(count, [&]() {
+        out.reset();
+        formatByItems(out, items, msg);
+    });
+    double runtime_ns = measure(count, [&]() {
+        out.reset();
+        runtime.format(out, msg);
+    });
+    double compiled_ns = measure(count, [&]() {
+        out.reset();
+        compiled.format(out, msg);
+    });
+
+    std::cout << "  class cluster:    " << items_ns << " ns/msg" << std::endl;
+    std::cout << "  runtime opcodes:  " << runtime_ns << " ns/msg" << std::endl;
+    std::cout << "  compiled pattern: " << compiled_ns << " ns/msg" << std::endl;
+}
+
+int main()
+{
+    using namespace windlog;
+
+    const size_t count = 2000000;
+    Buffer out(4096);
+    // LogMsg只引用字符串, 主体信息需要在整个测试期间存活
+    std::string payload(64, 'a');
+    LogMsg msg(LogLevel::value::INFO, "/src/bench.cc", 42, "bench", payload);
+
+    // 不含日期, 突出分派本身的开销
+    {
+        std::vector<FormatItem::ptr> items = {
+            std::make_shared<OtherFormatItem>("["),  std::make_shared<LevelFormatItem>(),
+            std::make_shared<OtherFormatItem>("]["), std::make_shared<LoggerFormatItem>(),
+            std::make_shared<OtherFormatItem>("]["), std::make_shared<FileFormatItem>(),
+            std::make_shared<OtherFormatItem>(":"),  std::make_shared<LineFormatItem>(),
+            std::make_shared<OtherFormatItem>("]"),  std::make_shared<TabFormatItem>(),
+            std::make_shared<MsgFormatItem>(),       std::make_shared<NLineFormatItem>()};
+        Formatter runtime("[%p][%c][%f:%l]%T%m%n");
+        auto compiled = Formatter::compile(WINDLOG_PATTERN("[%p][%c][%f:%l]%T%m%n"));
+
+        std::cout << "pattern: [%p][%c][%f:%l]%T%m%n" << std::endl;
+        report(count, out, items, runtime, *compiled, msg);
+    }
+
+    // 默认模式串, 包含日期与线程ID
+    {
+        std::vector<FormatItem::ptr> items = {
+            std::make_shared<OtherFormatItem>("["),  std::make_shared<LevelFormatItem>(),
+            std::make_shared<OtherFormatItem>("]"),  std::make_shared<TabFormatItem>(),
+            std::make_shared<OtherFormatItem>("["),  std::make_shared<DateFormatItem>("%H:%M:%S"),
+            std::make_shared<OtherFormatItem>("]["), std::make_shared<LoggerFormatItem>(),
+            std::make_shared<OtherFormatItem>("]["), std::make_shared<ThreadFormatItem>(),
+            std::make_shared<OtherFormatItem>("]"),  std::make_shared<TabFormatItem>(),
+            std::make_shared<OtherFormatItem>("["),  std::make_shared<FileFormatItem>(),
+            std::make_shared<OtherFormatItem>(":"),  std::make_shared<LineFormatItem>(),
+            std::make_shared<OtherFormatItem>("]"),  std::make_shared<TabFormatItem>(),
+            std::make_shared<MsgFormatItem>(),       std::make_shared<NLineFormatItem>()};
+        Formatter runtime;
+        auto compiled = Formatter::compile(
+            WINDLOG_PATTERN("[%p]%T[%d{%H:%M:%S}][%c][%t]%T[%f:%l]%T%m%n"));
+
+        std::cout << "pattern: [%p]%T[%d{%H:%M:%S}][%c][%t]%T[%f:%l]%T%m%n" << std::endl;
+        report(count, out, items, runtime, *compiled, msg);
+    }
+
+    return 0;
+}
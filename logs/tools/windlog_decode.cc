@@ -0,0 +1,80 @@
+/*
+    二进制日志解码工具, 把BinarySink写出的文件还原为文本
+    用法: windlog_decode [-p pattern] [-j threads] input [output]
+    未指定输出文件时写到标准输出, 线程数默认取CPU核数
+    文件末尾不完整的条目(写入时进程崩溃)被跳过, 在标准错误上给出警告
+*/
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "binary.hpp"
+
+static void usage(const char* prog)
+{
+    std::cerr << "usage: " << prog << " [-p pattern] [-j threads] input [output]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string pattern = "[%p]%T[%d{%H:%M:%S}][%c][%t]%T[%f:%l]%T%m%n";
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:j:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                pattern = optarg;
+                break;
+            case 'j':
+                threads = std::max(1L, strtol(optarg, nullptr, 10));
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || argc - optind > 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t truncated;
+    try
+    {
+        windlog::BinaryDecoder decoder(pattern);
+        if (argc - optind == 2)
+        {
+            std::ofstream ofs(argv[optind + 1], std::ios::binary | std::ios::trunc);
+            if (!ofs.is_open())
+            {
+                std::cerr << "failed to open " << argv[optind + 1] << std::endl;
+                return 1;
+            }
+            truncated = decoder.decodeFile(argv[optind], ofs, threads);
+        }
+        else
+        {
+            std::ios::sync_with_stdio(false);
+            truncated = decoder.decodeFile(argv[optind], std::cout, threads);
+            std::cout.flush();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (truncated > 0)
+        std::cerr << argv[0] << ": warning: " << argv[optind] << " ends with an incomplete entry, "
+                  << truncated << " trailing bytes ignored" << std::endl;
+    return 0;
+}
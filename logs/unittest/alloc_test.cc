@@ -0,0 +1,193 @@
+//alloc_test.cc
+
+/*
+    单元测试, 日志主路径稳定之后不应再有堆分配
+    通过替换malloc族函数统计当前线程上的分配次数, operator new最终也会走到malloc,
+    所以C++与C(例如vasprintf)的分配都能被统计到
+    预热若干次让线程本地缓冲区扩容到位, 之后的调用分配次数必须为零
+*/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.hpp"
+
+#if defined(__GLIBC__)
+
+static thread_local bool g_counting = false;
+static thread_local size_t g_allocs = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size)
+{
+    if (g_counting)
+        ++g_allocs;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    if (g_counting)
+        ++g_allocs;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (g_counting)
+        ++g_allocs;
+    return __libc_realloc(ptr, size);
+}
+}
+
+// 统计func执行期间当前线程的分配次数
+template <typename F>
+size_t countAllocs(F&& func)
+{
+    g_allocs = 0;
+    g_counting = true;
+    func();
+    g_counting = false;
+    return g_allocs;
+}
+
+// 只保留最后一次落地内容的末尾部分, 不分配内存
+class LastLineSink : public windlog::LogSink
+{
+   public:
+    void log(const char* data, size_t len) override
+    {
+        _len = std::min(len, sizeof(_last) - 1);
+        memcpy(_last, data + len - _len, _len);
+        _last[_len] = '\0';
+        ++_count;
+    }
+    void flush() override {}
+
+    std::string last() const { return std::string(_last, _len); }
+    size_t count() const { return _count; }
+
+   private:
+    char _last[1024] = {0};
+    size_t _len = 0;
+    size_t _count = 0;
+};
+
+static windlog::Logger::ptr buildLogger(const std::string& name,
+                                        const std::shared_ptr<LastLineSink>& sink,
+                                        windlog::Formatter::ptr formatter)
+{
+    return std::make_shared<windlog::SyncLogger>(
+        name, windlog::LogLevel::value::DEBUG, formatter,
+        std::vector<windlog::LogSink::ptr>{sink});
+}
+
+// 日志调用时文件名参数使用预先构造的字符串, 排除临时std::string的影响
+static const std::string kFile = "/src/windlog/alloc_test.cc";
+
+TEST(AllocTest, PrintfPathIsAllocationFree)
+{
+    auto sink = std::make_shared<LastLineSink>();
+    auto logger = buildLogger("alloc_printf", sink, std::make_shared<windlog::Formatter>());
+
+    auto body = [&]() {
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger->info(kFile, __LINE__, "value %d, ratio %.3f, name %s, a fairly long tail",
+                         i, i / 7.0, "windlog");
+        }
+    };
+    body();  // 预热
+
+    EXPECT_EQ(countAllocs(body), 0u);
+    EXPECT_EQ(sink->count(), 2000u);
+    EXPECT_NE(sink->last().find("[alloc_test.cc:"), std::string::npos);
+    EXPECT_NE(sink->last().find("value 999, ratio 142.714, name windlog"), std::string::npos);
+}
+
+TEST(AllocTest, TypedPathIsAllocationFree)
+{
+    auto sink = std::make_shared<LastLineSink>();
+    auto logger = buildLogger("alloc_typed", sink,
+                              windlog::Formatter::compile(WINDLOG_PATTERN("[%p][%c][%t]%m%n")));
+
+    auto body = [&]() {
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger->warn(kFile, __LINE__, WINDLOG_FMT("value {}, ok {}"), i, true);
+        }
+    };
+    body();
+
+    EXPECT_EQ(countAllocs(body), 0u);
+    EXPECT_EQ(sink->last().substr(0, 20), "[WARN][alloc_typed][");
+    EXPECT_NE(sink->last().find("]value 999, ok true\n"), std::string::npos);
+}
+
+TEST(AllocTest, AsyncProducerIsAllocationFree)
+{
+    auto sink = std::make_shared<LastLineSink>();
+    size_t allocs = 0;
+    {
+        auto logger = std::make_shared<windlog::AsyncLogger>(
+            "alloc_async", windlog::LogLevel::value::DEBUG,
+            std::make_shared<windlog::Formatter>("%m%n"),
+            std::vector<windlog::LogSink::ptr>{sink},
+            windlog::AsyncLooper::mode::ON_BUFFER_FULL_EXPAND);
+
+        auto body = [&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                logger->error(kFile, __LINE__, "async %d", i);
+            }
+        };
+        body();
+        allocs = countAllocs(body);
+    }
+
+    EXPECT_EQ(allocs, 0u);
+    EXPECT_EQ(sink->last().substr(sink->last().size() - 10), "async 999\n");
+}
+
+TEST(AllocTest, StaticFileNameIsAllocationFree)
+{
+    auto sink = std::make_shared<LastLineSink>();
+    auto logger =
+        buildLogger("alloc_static", sink, std::make_shared<windlog::Formatter>("[%f:%l]%m%n"));
+
+    // __FILE__走const char*重载, 不构造临时std::string, 基础名按调用点缓存
+    auto body = [&]() {
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger->debug(__FILE__, 7, "static %d", i);
+            logger->debug(__FILE__, 8, WINDLOG_FMT("typed {}"), i);
+        }
+    };
+    body();
+
+    EXPECT_EQ(countAllocs(body), 0u);
+    EXPECT_EQ(sink->last(), "[alloc_test.cc:8]typed 999\n");
+}
+
+TEST(AllocTest, ThreadIdMatchesStreamOutput)
+{
+    windlog::LogMsg msg(windlog::LogLevel::value::INFO, kFile, 1, "tid", "payload");
+    std::ostringstream oss;
+    oss << msg._tid;
+
+    windlog::Formatter fmt("%t");
+    EXPECT_EQ(fmt.format(msg), oss.str());
+
+    msg._tid = std::thread::id();
+    std::ostringstream none;
+    none << msg._tid;
+    EXPECT_EQ(fmt.format(msg), none.str());
+}
+
+#endif
@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 #include "logger.hpp"  // 你实际的 logger 接口头文件路径
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
 TEST(AsyncLoggerTest, HighVolumeLogging)
 {
     std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::LocalLoggerBuilder());
@@ -24,4 +31,760 @@ TEST(AsyncLoggerTest, HighVolumeLogging)
 
     // 理论上可以加日志文件检查，例如检查文件是否存在、大小等
     SUCCEED();  // 如果没有崩溃，就算通过
-}
\ No newline at end of file
+}
+
+TEST(AsyncLoggerTest, LockFreeRingLogging)
+{
+    const std::string filename = "./logfile/test/ring.log";
+    std::remove(filename.c_str());
+
+    {
+        std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::LocalLoggerBuilder());
+        builder->buildLoggerName("ring_logger");
+        builder->buildLoggerFormatter("%m%n");
+        builder->buildLoggerType(windlog::LoggerBuilder::LoggerType::LOGGER_ASYNC);
+        builder->buildLoggerMode(windlog::AsyncLooper::mode::LOCK_FREE_RING);
+        builder->buildLoggerSink<windlog::FileSink>(filename);
+        auto logger = builder->build();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < 100000; ++i)
+                {
+                    logger->fatal(__FILE__, __LINE__, "%d", i);
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+        // 日志器析构时异步线程会取尽环中的数据
+    }
+
+    std::ifstream ifs(filename);
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(ifs, line)) ++lines;
+    EXPECT_EQ(lines, 4u * 100000u);
+}
+
+// 把日志收集到内存中, 便于检查顺序与内容
+class CaptureSink : public windlog::LogSink
+{
+   public:
+    void log(const char* data, size_t len) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _content.append(data, len);
+    }
+    void flush() override {}
+
+    std::string content()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _content;
+    }
+
+   private:
+    std::mutex _mutex;
+    std::string _content;
+};
+
+TEST(AsyncLoggerTest, StagingKeepsPerThreadOrder)
+{
+    auto sink = std::make_shared<CaptureSink>();
+    const int thr_count = 4;
+    const int msg_count = 50000;
+
+    {
+        auto logger = std::make_shared<windlog::AsyncLogger>(
+            "staging_logger", windlog::LogLevel::value::DEBUG,
+            std::make_shared<windlog::Formatter>("%m%n"), std::vector<windlog::LogSink::ptr>{sink},
+            windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 4096);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thr_count; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < msg_count; ++i)
+                {
+                    logger->info(__FILE__, __LINE__, "%d %d", t, i);
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+        // 线程退出后暂存区里的剩余日志由析构时发布
+    }
+
+    std::stringstream ss(sink->content());
+    std::vector<int> next(thr_count, 0);
+    int t, i, total = 0;
+    while (ss >> t >> i)
+    {
+        ASSERT_EQ(i, next[t]);
+        ++next[t];
+        ++total;
+    }
+    EXPECT_EQ(total, thr_count * msg_count);
+}
+
+TEST(AsyncLoggerTest, StagingPublishesOnTimeoutAndFlush)
+{
+    auto sink = std::make_shared<CaptureSink>();
+    auto logger = std::make_shared<windlog::AsyncLogger>(
+        "staging_timeout_logger", windlog::LogLevel::value::DEBUG,
+        std::make_shared<windlog::Formatter>("%m%n"), std::vector<windlog::LogSink::ptr>{sink},
+        windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 1024 * 1024,
+        std::chrono::milliseconds(50));
+
+    // 远未达到大小阈值, 只能依靠时间阈值发布
+    logger->info(__FILE__, __LINE__, "%s", "timeout");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(sink->content(), "timeout\n");
+
+    // 主动刷新立即发布
+    logger->info(__FILE__, __LINE__, "%s", "flush");
+    logger->flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(sink->content(), "timeout\nflush\n");
+}
+
+TEST(AsyncLoggerTest, DeferredFormattingMatchesEager)
+{
+    auto eager_sink = std::make_shared<CaptureSink>();
+    auto deferred_sink = std::make_shared<CaptureSink>();
+    auto formatter = std::make_shared<windlog::Formatter>("[%p][%c][%f:%l] %m%n");
+
+    {
+        windlog::AsyncLogger eager("deferred_logger", windlog::LogLevel::value::INFO, formatter,
+                                   {eager_sink}, windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK);
+        windlog::AsyncLogger deferred("deferred_logger", windlog::LogLevel::value::INFO, formatter,
+                                      {deferred_sink},
+                                      windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                                      std::chrono::milliseconds(100), true);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            eager.debug("/src/app.cc", 10, "filtered %d", i);
+            deferred.debug("/src/app.cc", 10, "filtered %d", i);
+            eager.warn("/src/app.cc", 20, "%05d %s %.2f", i, "text", i / 3.0);
+            deferred.warn("/src/app.cc", 20, "%05d %s %.2f", i, "text", i / 3.0);
+        }
+    }
+
+    EXPECT_FALSE(deferred_sink->content().empty());
+    EXPECT_EQ(eager_sink->content(), deferred_sink->content());
+}
+
+TEST(AsyncLoggerTest, LastSinkMaySwapBuffer)
+{
+    const std::string filename = "./logfile/uring_async.log";
+    std::remove(filename.c_str());
+    auto capture = std::make_shared<CaptureSink>();
+
+    for (bool deferred : {false, true})
+    {
+        {
+            // 最后一个落地方向换走缓冲区, 前面的落地方向看到的内容不受影响
+            auto uring = std::make_shared<windlog::UringFileSink>(filename);
+            windlog::AsyncLogger logger("uring_logger", windlog::LogLevel::value::DEBUG,
+                                        std::make_shared<windlog::Formatter>("%m%n"),
+                                        {capture, uring},
+                                        windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                                        std::chrono::milliseconds(100), deferred);
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    for (int i = 0; i < 20000; ++i)
+                        logger.info(__FILE__, __LINE__, "%d %d %s", t, i, "uring");
+                });
+            }
+            for (auto& th : threads) th.join();
+        }
+
+        std::ifstream ifs(filename);
+        std::string content((std::istreambuf_iterator<char>(ifs)),
+                            std::istreambuf_iterator<char>());
+        EXPECT_EQ(content, capture->content());
+    }
+    std::string content = capture->content();
+    EXPECT_EQ(std::count(content.begin(), content.end(), '\n'), 2 * 4 * 20000);
+}
+
+// 第一次写入时阻塞, 直到测试放行, 用来让后续日志攒成同一批
+class GateSink : public windlog::LogSink
+{
+   public:
+    void log(const char*, size_t) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _entered = true;
+        _cond.notify_all();
+        _cond.wait(lock, [&]() { return _open; });
+    }
+    void flush() override {}
+
+    void waitEntered()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [&]() { return _entered; });
+    }
+    void open()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _open = true;
+        _cond.notify_all();
+    }
+
+   private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _entered = false;
+    bool _open = false;
+};
+
+TEST(AsyncLoggerTest, ErrorBatchesAreCommittedOnce)
+{
+    const std::string filename = "./logfile/durable_async.log";
+    std::remove(filename.c_str());
+
+    for (auto mode : {windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK,
+                      windlog::AsyncLooper::mode::LOCK_FREE_RING})
+    {
+        auto gate = std::make_shared<GateSink>();
+        auto fd = std::make_shared<windlog::FdFileSink>(filename);
+        fd->setDurability(windlog::Durability::onError());
+        windlog::AsyncLogger logger("durable_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {gate, fd},
+                                    mode);
+
+        // 第一批在落地时被挡住, 其间的日志攒成第二批
+        logger.info(__FILE__, __LINE__, "%s", "first");
+        gate->waitEntered();
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.info(__FILE__, __LINE__, "info %d", i);
+            logger.error(__FILE__, __LINE__, "error %d", i);
+        }
+        gate->open();
+
+        // 第一批没有ERROR, 第二批的100条ERROR只同步一次, 刷新时已经没有未同步的数据
+        logger.flush();
+        EXPECT_EQ(fd->syncStats().count(), 1u);
+
+        // 没有ERROR的批次只在刷新时同步
+        for (int i = 0; i < 100; ++i) logger.info(__FILE__, __LINE__, "info %d", i);
+        logger.flush();
+        EXPECT_EQ(fd->syncStats().count(), 2u);
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(AsyncLoggerTest, IntervalDurabilitySyncsWhenIdle)
+{
+    const std::string filename = "./logfile/durable_idle.log";
+    std::remove(filename.c_str());
+
+    // 自己的异步线程, 环形缓冲区与共享后端各测一次
+    for (int variant = 0; variant < 3; ++variant)
+    {
+        auto mode = variant == 1 ? windlog::AsyncLooper::mode::LOCK_FREE_RING
+                                 : windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK;
+        auto backend = variant == 2 ? std::make_shared<windlog::SharedBackend>(
+                                          1, 64 * 1024, std::chrono::milliseconds(10))
+                                    : nullptr;
+        auto fd = std::make_shared<windlog::FdFileSink>(filename);
+        fd->setDurability(windlog::Durability::interval(std::chrono::hours(1)));
+        windlog::AsyncLogger logger("idle_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {fd}, mode, 0,
+                                    std::chrono::milliseconds(100), false, backend);
+
+        // 间隔远未到达, 之后再没有日志, 空闲之后仍然要同步一次
+        logger.info(__FILE__, __LINE__, "%s", "last");
+        for (int i = 0; i < 100 && fd->syncStats().count() == 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        EXPECT_EQ(fd->syncStats().count(), 1u);
+
+        // 已经同步过, 继续空闲不会重复同步
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        EXPECT_EQ(fd->syncStats().count(), 1u);
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(AsyncLoggerTest, FlushWaitsForConsumer)
+{
+    auto sink = std::make_shared<CaptureSink>();
+    for (auto mode : {windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK,
+                      windlog::AsyncLooper::mode::LOCK_FREE_RING})
+    {
+        windlog::AsyncLogger logger("flush_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {sink}, mode);
+        std::string expected = sink->content();
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger.info(__FILE__, __LINE__, "%d", i);
+            expected += std::to_string(i) + "\n";
+        }
+        // 返回时此前的日志都已经落地, 无需等待
+        logger.flush();
+        EXPECT_EQ(sink->content(), expected);
+    }
+}
+
+TEST(AsyncLoggerTest, SharedBackendServesManyLoggers)
+{
+    auto backend = std::make_shared<windlog::SharedBackend>(2, 64 * 1024);
+    const int logger_count = 30;
+    const int thr_count = 4;
+    const int msg_count = 2000;
+
+    std::vector<std::shared_ptr<CaptureSink>> sinks;
+    std::vector<std::shared_ptr<windlog::AsyncLogger>> loggers;
+    for (int l = 0; l < logger_count; ++l)
+    {
+        sinks.push_back(std::make_shared<CaptureSink>());
+        loggers.push_back(std::make_shared<windlog::AsyncLogger>(
+            "shared_logger" + std::to_string(l), windlog::LogLevel::value::DEBUG,
+            std::make_shared<windlog::Formatter>("%m%n"),
+            std::vector<windlog::LogSink::ptr>{sinks.back()},
+            windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0, std::chrono::milliseconds(100),
+            false, backend));
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thr_count; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < msg_count; ++i)
+                loggers[(i + t) % logger_count]->info(__FILE__, __LINE__, "%d %d", t, i);
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    // 刷新返回时全部落地; 每个日志器中每个线程的日志保持顺序
+    for (auto& logger : loggers) logger->flush();
+    size_t total = 0;
+    for (auto& sink : sinks)
+    {
+        std::istringstream ss(sink->content());
+        std::vector<int> last(thr_count, -1);
+        int t, i;
+        while (ss >> t >> i)
+        {
+            ASSERT_GT(i, last[t]);
+            last[t] = i;
+            ++total;
+        }
+    }
+    EXPECT_EQ(total, static_cast<size_t>(thr_count * msg_count));
+    loggers.clear();
+    EXPECT_EQ(backend.use_count(), 1);
+}
+
+// 每次写入都很慢的落地方向
+class SlowSink : public windlog::LogSink
+{
+   public:
+    void log(const char*, size_t) override
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    void flush() override {}
+};
+
+TEST(AsyncLoggerTest, SharedBackendDoesNotStarveQuietLoggers)
+{
+    auto backend = std::make_shared<windlog::SharedBackend>(1);
+    auto formatter = std::make_shared<windlog::Formatter>("%m%n");
+    windlog::AsyncLogger busy("busy_logger", windlog::LogLevel::value::DEBUG, formatter,
+                              {std::make_shared<SlowSink>()},
+                              windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                              std::chrono::milliseconds(100), false, backend);
+    auto sink = std::make_shared<CaptureSink>();
+    windlog::AsyncLogger quiet("quiet_logger", windlog::LogLevel::value::DEBUG, formatter, {sink},
+                               windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 1024,
+                               std::chrono::milliseconds(20), false, backend);
+
+    std::atomic<bool> running(true);
+    std::thread flood([&]() {
+        while (running) busy.info(__FILE__, __LINE__, "%s", "flood");
+    });
+
+    // 唯一的后端线程一直有活干, 暂存的日志仍然按时发布, 刷新也不会等很久
+    quiet.info(__FILE__, __LINE__, "%s", "staged");
+    for (int i = 0; i < 100 && sink->content().empty(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(sink->content(), "staged\n");
+
+    auto start = std::chrono::steady_clock::now();
+    quiet.info(__FILE__, __LINE__, "%s", "flushed");
+    quiet.flush();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+    EXPECT_EQ(sink->content(), "staged\nflushed\n");
+
+    running = false;
+    flood.join();
+}
+
+TEST(AsyncLoggerTest, AsyncSinkKeepsSlowSinkFromStallingOthers)
+{
+    auto gate = std::make_shared<GateSink>();
+    auto slow = std::make_shared<windlog::AsyncSink>(gate, windlog::SinkQueue::drop(4));
+    auto fast = std::make_shared<CaptureSink>();
+    windlog::AsyncLogger logger("async_sink_logger", windlog::LogLevel::value::DEBUG,
+                                std::make_shared<windlog::Formatter>("%m%n"), {slow, fast},
+                                windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK);
+
+    // 逐条等待快的落地方向收到, 每条日志各成一批
+    std::string expected;
+    for (int i = 0; i < 20; ++i)
+    {
+        char line[8];
+        snprintf(line, sizeof(line), "m%02d", i);
+        logger.info(__FILE__, __LINE__, "%s", line);
+        expected += std::string(line) + "\n";
+        for (int j = 0; j < 500 && fast->content() != expected; ++j)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ASSERT_EQ(fast->content(), expected);
+        if (i == 0)
+            gate->waitEntered();
+    }
+
+    // 第一批卡在慢的落地方向里, 第二批在队列中, 其余的都被丢弃
+    EXPECT_EQ(slow->queuedBytes(), 4u);
+    EXPECT_EQ(slow->droppedBatches(), 18u);
+    EXPECT_EQ(slow->droppedBytes(), 18u * 4);
+    EXPECT_GT(slow->lag().count(), 0);
+
+    gate->open();
+    logger.flush();
+    EXPECT_EQ(slow->writtenBytes(), 8u);
+    EXPECT_EQ(slow->queuedBytes(), 0u);
+    EXPECT_EQ(slow->lag().count(), 0);
+    EXPECT_EQ(slow->lagStats().count(), 2u);
+}
+
+TEST(AsyncLoggerTest, AsyncSinkDropsChainedBatchAsAWhole)
+{
+    auto gate = std::make_shared<GateSink>();
+    windlog::AsyncSink sink(gate, windlog::SinkQueue::drop(8));
+
+    // 第一批卡在工作线程里, 第二批占去队列的一半
+    sink.log("abcd", 4);
+    gate->waitEntered();
+    sink.log("1234", 4);
+
+    // 分段的一批放不下时整批丢弃, 只计一次
+    char part[] = "xxyyzz";
+    struct iovec big[3] = {{part, 2}, {part + 2, 2}, {part + 4, 2}};
+    sink.logv(big, 3);
+    EXPECT_EQ(sink.queuedBytes(), 4u);
+    EXPECT_EQ(sink.droppedBatches(), 1u);
+    EXPECT_EQ(sink.droppedBytes(), 6u);
+
+    // 放得下的一批整体入队
+    struct iovec small[2] = {{part, 2}, {part + 2, 2}};
+    sink.logv(small, 2);
+    EXPECT_EQ(sink.queuedBytes(), 8u);
+
+    gate->open();
+    sink.flush();
+    EXPECT_EQ(sink.writtenBytes(), 12u);
+    EXPECT_EQ(sink.droppedBatches(), 1u);
+}
+
+TEST(AsyncLoggerTest, DropModeCountsAndReportsLoss)
+{
+    for (bool deferred : {false, true})
+    {
+        // 小队列的共享后端, 256字节恰好放下32条8字节的日志
+        auto backend = std::make_shared<windlog::SharedBackend>(1, 256);
+        auto gate = std::make_shared<GateSink>();
+        auto sink = std::make_shared<CaptureSink>();
+        windlog::AsyncLogger logger("drop_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {gate, sink},
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_DROP, 0,
+                                    std::chrono::milliseconds(100), deferred, backend,
+                                    windlog::LogLevel::value::ERROR);
+
+        logger.info(__FILE__, __LINE__, "%s", "first");
+        gate->waitEntered();
+
+        // 异步线程卡住, 缓冲区放满之后的日志直接丢弃, 业务线程不等待
+        for (int i = 0; i < 100; ++i)
+        {
+            char line[8];
+            snprintf(line, sizeof(line), "info%03d", i);
+            logger.info(__FILE__, __LINE__, "%s", line);
+        }
+        for (int i = 0; i < 5; ++i) logger.debug(__FILE__, __LINE__, "%s", "dbg");
+
+        // 不低于drop_below的日志不丢弃, 等待缓冲区腾出空间
+        std::atomic<bool> done(false);
+        std::thread error([&]() {
+            logger.error(__FILE__, __LINE__, "%s", "error");
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_FALSE(done);
+
+        gate->open();
+        error.join();
+        logger.flush();
+
+        // 保留下来的是放满缓冲区之前的日志, 丢弃提示紧随其后
+        uint64_t info_dropped = logger.dropped(windlog::LogLevel::value::INFO);
+        uint64_t debug_dropped = logger.dropped(windlog::LogLevel::value::DEBUG);
+        if (!deferred)
+        {
+            EXPECT_EQ(info_dropped, 68u);
+            EXPECT_EQ(debug_dropped, 5u);
+        }
+        EXPECT_EQ(logger.dropped(windlog::LogLevel::value::ERROR), 0u);
+        EXPECT_EQ(logger.dropped(), info_dropped + debug_dropped);
+
+        std::string expected = "first\n";
+        for (uint64_t i = 0; i < 100 - info_dropped; ++i)
+        {
+            char line[8];
+            snprintf(line, sizeof(line), "info%03d", static_cast<int>(i));
+            expected += std::string(line) + "\n";
+        }
+        for (uint64_t i = 0; i < 5 - debug_dropped; ++i) expected += "dbg\n";
+        std::string detail;
+        if (debug_dropped > 0)
+            detail += "DEBUG: " + std::to_string(debug_dropped);
+        if (info_dropped > 0)
+            detail += (detail.empty() ? "" : ", ") + std::string("INFO: ") +
+                      std::to_string(info_dropped);
+        expected += std::to_string(info_dropped + debug_dropped) + " messages dropped (" +
+                    detail + ")\n";
+        expected += "error\n";
+        EXPECT_EQ(sink->content(), expected);
+    }
+}
+
+TEST(AsyncLoggerTest, OversizedMessageKeepsOrder)
+{
+    // 共享后端的小队列与默认大小的缓冲区各测一次
+    for (size_t queue_size : {size_t(256), size_t(0)})
+    {
+        auto backend = queue_size ? std::make_shared<windlog::SharedBackend>(1, queue_size)
+                                  : nullptr;
+        auto gate = std::make_shared<GateSink>();
+        auto sink = std::make_shared<CaptureSink>();
+        windlog::AsyncLogger logger("oversized_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {gate, sink},
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                                    std::chrono::milliseconds(100), false, backend);
+        size_t capacity = queue_size ? queue_size : BUFFER_SIZE;
+        std::string big(capacity + 1, 'x');
+
+        // 异步线程卡住时, 超大消息排在已有数据之后, 之后的日志排在它之后
+        logger.info(__FILE__, __LINE__, "%s", "first");
+        gate->waitEntered();
+        logger.info(__FILE__, __LINE__, "%s", "before");
+        std::thread later([&]() {
+            logger.info(__FILE__, __LINE__, "%s", big.c_str());
+            logger.info(__FILE__, __LINE__, "%s", "after");
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate->open();
+        later.join();
+        logger.info(__FILE__, __LINE__, "%s", big.c_str());
+        logger.flush();
+
+        EXPECT_TRUE(sink->content() == "first\nbefore\n" + big + "\nafter\n" + big + "\n");
+    }
+}
+
+TEST(AsyncLoggerTest, RingSpillsRecordsLargerThanRing)
+{
+    auto sink = std::make_shared<CaptureSink>();
+    windlog::AsyncLogger logger("ring_oversized_logger", windlog::LogLevel::value::DEBUG,
+                                std::make_shared<windlog::Formatter>("%m%n"), {sink},
+                                windlog::AsyncLooper::mode::LOCK_FREE_RING);
+    std::string big(BUFFER_SIZE + 1, 'x');
+
+    // 放不进环的记录不抛异常, 并且排在前后两条日志之间
+    logger.info(__FILE__, __LINE__, "%s", "before");
+    EXPECT_NO_THROW(logger.info(__FILE__, __LINE__, "%s", big.c_str()));
+    logger.info(__FILE__, __LINE__, "%s", "after");
+    logger.flush();
+
+    EXPECT_TRUE(sink->content() == "before\n" + big + "\nafter\n");
+}
+
+TEST(AsyncLoggerTest, StagingDrainDoesNotWaitForFullBuffer)
+{
+    // 自己的异步线程与共享后端(小队列, 由tick收取暂存区)各测一次
+    for (size_t queue_size : {size_t(0), size_t(64 * 1024)})
+    {
+        auto backend = queue_size ? std::make_shared<windlog::SharedBackend>(
+                                        1, queue_size, std::chrono::milliseconds(5))
+                                  : nullptr;
+        auto gate = std::make_shared<GateSink>();
+        auto sink = std::make_shared<CaptureSink>();
+        std::vector<windlog::LogSink::ptr> sinks{gate, sink};
+        // 共享后端先落地一批再检查暂存区, 落地得慢一些, 写者才来得及再次写满缓冲区
+        if (backend)
+            sinks.push_back(std::make_shared<SlowSink>());
+        windlog::AsyncLogger logger("staging_full_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), sinks,
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 4096,
+                                    std::chrono::milliseconds(5), false, backend);
+        // 每条日志连同换行正好是一次发布的大小, 缓冲区会被填得一点不剩
+        std::string line(4095, 'x');
+        const long count = queue_size ? 1024 : BUFFER_SIZE / 4096 * 2;
+
+        // 异步线程卡在落地方向时, 写满缓冲区
+        std::thread writer([&]() {
+            for (long i = 0; i < count; ++i)
+                logger.info(__FILE__, __LINE__, "%s", line.c_str());
+        });
+        gate->waitEntered();
+
+        // 另一个线程的暂存区只攒了一部分, 超时后由异步线程收取, 此时缓冲区仍是满的
+        std::thread idle([&]() { logger.info(__FILE__, __LINE__, "%s", "idle"); });
+        idle.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        gate->open();
+        writer.join();
+        logger.flush();
+
+        std::string content = sink->content();
+        EXPECT_NE(content.find("idle\n"), std::string::npos);
+        EXPECT_EQ(std::count(content.begin(), content.end(), '\n'), count + 1);
+    }
+}
+
+TEST(AsyncLoggerTest, ExpandModeChainsSegmentsInOrder)
+{
+    for (bool deferred : {false, true})
+    {
+        // 256字节的小队列, 异步线程卡住期间的日志大部分接在片段链上
+        auto backend = std::make_shared<windlog::SharedBackend>(1, 256);
+        auto gate = std::make_shared<GateSink>();
+        auto sink = std::make_shared<CaptureSink>();
+        windlog::AsyncLogger logger("expand_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {gate, sink},
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_EXPAND, 0,
+                                    std::chrono::milliseconds(100), deferred, backend);
+
+        logger.info(__FILE__, __LINE__, "%s", "first");
+        gate->waitEntered();
+
+        std::string expected = "first\n";
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::string line = "line " + std::to_string(i) + std::string(i % 300, '.');
+            logger.info(__FILE__, __LINE__, "%s", line.c_str());
+            expected += line + "\n";
+        }
+        gate->open();
+        logger.flush();
+
+        EXPECT_TRUE(sink->content() == expected);
+    }
+}
+
+TEST(AsyncLoggerTest, ExpandModeStaysWithinPoolBudget)
+{
+    auto pool = std::make_shared<windlog::SegmentPool>(1024, 0, 4096,
+                                                       std::chrono::milliseconds(0));
+    auto backend = std::make_shared<windlog::SharedBackend>(1, 256);
+    auto gate = std::make_shared<GateSink>();
+    auto sink = std::make_shared<CaptureSink>();
+    windlog::AsyncLogger logger("budget_logger", windlog::LogLevel::value::DEBUG,
+                                std::make_shared<windlog::Formatter>("%m%n"), {gate, sink},
+                                windlog::AsyncLooper::mode::ON_BUFFER_FULL_EXPAND, 0,
+                                std::chrono::milliseconds(100), false, backend,
+                                windlog::LogLevel::value::OFF, pool);
+
+    logger.info(__FILE__, __LINE__, "%s", "first");
+    gate->waitEntered();
+
+    // 片段池用完预算之后, 扩容模式也要等待异步线程
+    std::string expected = "first\n";
+    for (int i = 0; i < 1000; ++i) expected += "line " + std::to_string(i) + "\n";
+    std::atomic<bool> done(false);
+    std::thread producer([&]() {
+        for (int i = 0; i < 1000; ++i) logger.info(__FILE__, __LINE__, "line %d", i);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(done);
+    EXPECT_EQ(pool->usage(), 4096u);
+
+    gate->open();
+    producer.join();
+    logger.flush();
+
+    EXPECT_TRUE(sink->content() == expected);
+    EXPECT_GT(pool->refused(), 0u);
+    EXPECT_EQ(pool->peak(), 4096u);
+    EXPECT_EQ(pool->inUse(), 0u);
+    EXPECT_EQ(pool->usage(), 0u);
+}
+
+TEST(AsyncLoggerTest, ExpandModePoolShrinksWhenIdle)
+{
+    // 自己的异步线程与共享后端各测一次
+    for (bool shared : {false, true})
+    {
+        auto pool = std::make_shared<windlog::SegmentPool>(1024, 0, 0,
+                                                           std::chrono::milliseconds(50));
+        auto backend = shared ? std::make_shared<windlog::SharedBackend>(
+                                    1, 256, std::chrono::milliseconds(10))
+                              : nullptr;
+        auto gate = std::make_shared<GateSink>();
+        windlog::AsyncLogger logger("shrink_logger", windlog::LogLevel::value::DEBUG,
+                                    std::make_shared<windlog::Formatter>("%m%n"), {gate},
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_EXPAND, 0,
+                                    std::chrono::milliseconds(100), false, backend,
+                                    windlog::LogLevel::value::OFF, pool);
+
+        // 异步线程卡住时写满缓冲区, 之后的日志接到片段链上
+        logger.info(__FILE__, __LINE__, "%s", "first");
+        gate->waitEntered();
+        std::string line(200, 'x');
+        for (int i = 0; i < (shared ? 50 : BUFFER_SIZE / 200 + 50); ++i)
+            logger.info(__FILE__, __LINE__, "%s", line.c_str());
+        gate->open();
+        logger.flush();
+        EXPECT_EQ(pool->inUse(), 0u);
+        EXPECT_GT(pool->usage(), 0u);
+
+        // 之后不再有日志, 也就不再有片段归还, 缓存的片段仍然要在平静之后释放
+        for (int i = 0; i < 100 && pool->usage() > 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        EXPECT_EQ(pool->usage(), 0u);
+    }
+}
+
+TEST(AsyncLoggerTest, HugePageBuffersOnConsumerNode)
+{
+    for (auto mode : {windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK,
+                      windlog::AsyncLooper::mode::LOCK_FREE_RING})
+    {
+        auto sink = std::make_shared<CaptureSink>();
+        windlog::AsyncLogger logger(
+            "hugepage_logger", windlog::LogLevel::value::DEBUG,
+            std::make_shared<windlog::Formatter>("%m%n"), {sink}, mode, 0,
+            std::chrono::milliseconds(100), false, nullptr, windlog::LogLevel::value::OFF,
+            nullptr,
+            windlog::MemoryPolicy::transparentHuge(windlog::MemoryPolicy::CONSUMER_NODE));
+
+        std::string expected;
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger.info(__FILE__, __LINE__, "line %d", i);
+            expected += "line " + std::to_string(i) + "\n";
+        }
+        logger.flush();
+        EXPECT_TRUE(sink->content() == expected);
+    }
+}
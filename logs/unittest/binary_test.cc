@@ -0,0 +1,198 @@
+#include "binary.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.hpp"
+#include "sink.hpp"
+
+namespace fs = std::filesystem;
+
+// 把日志收集到内存中, 作为解码结果的对照
+class CaptureSink : public windlog::LogSink
+{
+   public:
+    void log(const char* data, size_t len) override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _content.append(data, len);
+    }
+    void flush() override {}
+
+    std::string content()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _content;
+    }
+
+   private:
+    std::mutex _mutex;
+    std::string _content;
+};
+
+static const char* PATTERN = "[%p][%d{%H:%M:%S.%3N}][%c][%t][%f:%l] %m%n";
+
+static std::string decodeFile(const std::string& filename, size_t threads)
+{
+    windlog::BinaryDecoder decoder(PATTERN);
+    std::stringstream ss;
+    decoder.decodeFile(filename, ss, threads);
+    return ss.str();
+}
+
+TEST(BinaryLogTest, VarintAndZigzagRoundTrip)
+{
+    std::string out;
+    const uint64_t values[] = {0, 1, 127, 128, 300, 1ull << 32, ~0ull};
+    for (uint64_t v : values) windlog::BinaryLog::putVarint(out, v);
+
+    windlog::BinaryReader reader(out.data(), out.size());
+    for (uint64_t v : values) EXPECT_EQ(reader.varint(), v);
+    EXPECT_TRUE(reader.eof());
+    EXPECT_THROW(reader.byte(), std::runtime_error);
+
+    for (int64_t v : {0L, 1L, -1L, 63L, -64L, 1L << 40, -(1L << 40)})
+        EXPECT_EQ(windlog::BinaryLog::unzigzag(windlog::BinaryLog::zigzag(v)), v);
+}
+
+TEST(BinaryLogTest, DecodedOutputMatchesTextSink)
+{
+    const std::string filename = "./logfile/binary/deferred.wlog";
+    fs::remove(filename);
+
+    auto text_sink = std::make_shared<CaptureSink>();
+    auto binary_sink = std::make_shared<windlog::BinarySink>(filename);
+    const int thr_count = 4;
+    const int msg_count = 20000;
+
+    {
+        windlog::AsyncLogger logger("binary_logger", windlog::LogLevel::value::INFO,
+                                    std::make_shared<windlog::Formatter>(PATTERN),
+                                    {text_sink, binary_sink},
+                                    windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                                    std::chrono::milliseconds(100), true);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thr_count; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < msg_count; ++i)
+                {
+                    logger.warn("/src/app.cc", 20, "%d %05d %s %.2f", t, i, "text", i / 3.0);
+                    if (i % 100 == 0)
+                        logger.error(__FILE__, __LINE__, "%s:%zu", "checkpoint", (size_t)i);
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+    }
+    binary_sink->flush();
+
+    std::string expected = text_sink->content();
+    ASSERT_FALSE(expected.empty());
+    // 编号化之后, 二进制文件应明显小于文本
+    EXPECT_LT(fs::file_size(filename), expected.size() / 2);
+
+    EXPECT_EQ(decodeFile(filename, 1), expected);
+    EXPECT_EQ(decodeFile(filename, 4), expected);
+}
+
+TEST(BinaryLogTest, TextChunksAndSessionsAreKept)
+{
+    const std::string filename = "./logfile/binary/sessions.wlog";
+    fs::remove(filename);
+    std::string expected;
+
+    // 同步日志器交给它的是格式化好的文本
+    {
+        auto text_sink = std::make_shared<CaptureSink>();
+        auto binary_sink = std::make_shared<windlog::BinarySink>(filename);
+        windlog::SyncLogger logger("sync_logger", windlog::LogLevel::value::DEBUG,
+                                   std::make_shared<windlog::Formatter>(PATTERN),
+                                   {text_sink, binary_sink});
+        for (int i = 0; i < 100; ++i) logger.info("/src/sync.cc", 5, "sync %d", i);
+        binary_sink->flush();
+        expected += text_sink->content();
+    }
+
+    // 重新打开后是新的会话, 编号重新分配, 不能与上一个会话混淆
+    for (int session = 0; session < 2; ++session)
+    {
+        auto text_sink = std::make_shared<CaptureSink>();
+        auto binary_sink = std::make_shared<windlog::BinarySink>(filename);
+        {
+            windlog::AsyncLogger logger("session_" + std::to_string(session),
+                                        windlog::LogLevel::value::DEBUG,
+                                        std::make_shared<windlog::Formatter>(PATTERN),
+                                        {text_sink, binary_sink},
+                                        windlog::AsyncLooper::mode::ON_BUFFER_FULL_BLOCK, 0,
+                                        std::chrono::milliseconds(100), true);
+            for (int i = 0; i < 100; ++i)
+            {
+                if (session == 0)
+                    logger.debug("/src/a.cc", 1, "first %d", i);
+                else
+                    logger.fatal("/src/b.cc", 2, "second %s", "x");
+            }
+        }
+        binary_sink->flush();
+        expected += text_sink->content();
+    }
+
+    EXPECT_EQ(decodeFile(filename, 1), expected);
+    EXPECT_EQ(decodeFile(filename, 3), expected);
+}
+
+TEST(BinaryLogTest, CorruptInputThrows)
+{
+    windlog::BinaryDecoder decoder;
+    std::stringstream ss;
+    std::string data = "not a binary log";
+    EXPECT_THROW(decoder.decode(data.data(), data.size(), ss), std::runtime_error);
+
+    // 未知的条目类型
+    data = std::string(windlog::BinaryLog::MAGIC) + "X";
+    EXPECT_THROW(decoder.decode(data.data(), data.size(), ss), std::runtime_error);
+
+    // 末尾截断的数据块只是被忽略
+    data = std::string(windlog::BinaryLog::MAGIC) + "B";
+    windlog::BinaryLog::putVarint(data, 100);
+    data += "short";
+    EXPECT_EQ(decoder.decode(data.data(), data.size(), ss), data.size() - 8);
+    EXPECT_TRUE(ss.str().empty());
+}
+
+TEST(BinaryLogTest, TruncatedTailKeepsCompleteBlocks)
+{
+    const std::string filename = "./logfile/binary/truncated.wlog";
+    fs::remove(filename);
+
+    auto text_sink = std::make_shared<CaptureSink>();
+    {
+        // 同步日志器每条日志单独落地一个数据块
+        auto binary_sink = std::make_shared<windlog::BinarySink>(filename);
+        windlog::SyncLogger logger("sync_logger", windlog::LogLevel::value::DEBUG,
+                                   std::make_shared<windlog::Formatter>(PATTERN),
+                                   {text_sink, binary_sink});
+        for (int i = 0; i < 100; ++i) logger.info("/src/crash.cc", 9, "line %d", i);
+        binary_sink->flush();
+    }
+    std::string expected = text_sink->content();
+    ASSERT_EQ(decodeFile(filename, 2), expected);
+
+    // 模拟写入最后一块时崩溃
+    fs::resize_file(filename, fs::file_size(filename) - 3);
+    expected.erase(expected.rfind('\n', expected.size() - 2) + 1);
+
+    windlog::BinaryDecoder decoder(PATTERN);
+    std::stringstream ss;
+    EXPECT_GT(decoder.decodeFile(filename, ss, 2), 0u);
+    EXPECT_EQ(ss.str(), expected);
+    fs::remove(filename);
+}
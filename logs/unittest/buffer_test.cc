@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 
 #include <fstream>
+#include <thread>
 
 TEST(BufferTest, ReadWriteCorrectness)
 {
@@ -55,4 +56,135 @@ TEST(BufferTest, ReadWriteCorrectness)
 
     ifs1.close();
     ifs2.close();
-}
\ No newline at end of file
+}
+TEST(BufferChainTest, GrowsBySegmentsWithoutSplittingWrites)
+{
+    auto pool = std::make_shared<windlog::SegmentPool>(16, 32, 0, std::chrono::milliseconds(0));
+    windlog::BufferChain chain(pool);
+    EXPECT_TRUE(chain.empty());
+
+    // 放不下的数据整条写入下一个片段, 比片段还大的数据独占一个片段
+    chain.push("0123456789", 10);
+    chain.push("abcdefgh", 8);
+    chain.push("ij", 2);
+    std::string big(40, 'x');
+    chain.push(big.data(), big.size());
+    chain.push("tail", 4);
+
+    EXPECT_EQ(chain.readAbleSize(), 64u);
+    ASSERT_EQ(chain.segmentCount(), 4u);
+    EXPECT_EQ(std::string(chain.segment(0).readAbleBegin(), chain.segment(0).readAbleSize()),
+              "0123456789");
+    EXPECT_EQ(std::string(chain.segment(1).readAbleBegin(), chain.segment(1).readAbleSize()),
+              "abcdefghij");
+    EXPECT_EQ(chain.segment(2).readAbleSize(), 40u);
+    EXPECT_EQ(std::string(chain.segment(3).readAbleBegin(), chain.segment(3).readAbleSize()),
+              "tail");
+
+    std::vector<struct iovec> iov;
+    chain.appendIov(iov);
+    std::string joined;
+    for (auto& v : iov) joined.append(static_cast<char*>(v.iov_base), v.iov_len);
+    EXPECT_EQ(joined, "0123456789abcdefghij" + big + "tail");
+
+    // 常规片段回到池中, 超出常驻内存与超大的片段直接释放
+    chain.reset();
+    EXPECT_TRUE(chain.empty());
+    EXPECT_EQ(chain.segmentCount(), 0u);
+    EXPECT_EQ(pool->cached(), 2u);
+
+    chain.push("again", 5);
+    EXPECT_EQ(pool->cached(), 1u);
+    EXPECT_EQ(std::string(chain.segment(0).readAbleBegin(), chain.segment(0).readAbleSize()),
+              "again");
+}
+
+TEST(SegmentPoolTest, EnforcesBudgetAndShrinksWithHysteresis)
+{
+    windlog::SegmentPool pool(16, 32, 64, std::chrono::milliseconds(50));
+
+    std::vector<std::unique_ptr<windlog::Buffer>> segments;
+    for (int i = 0; i < 4; ++i) segments.push_back(pool.acquire(16, false));
+    EXPECT_EQ(pool.usage(), 64u);
+
+    // 超出预算的分配被拒绝, 强制分配不受限制
+    EXPECT_EQ(pool.acquire(16, false), nullptr);
+    EXPECT_EQ(pool.refused(), 1u);
+    segments.push_back(pool.acquire(16));
+    EXPECT_EQ(pool.usage(), 80u);
+    EXPECT_EQ(pool.peak(), 80u);
+
+    // 刚回落时先缓存起来, 平静一段时间之后才回到常驻内存
+    for (auto& segment : segments) pool.release(std::move(segment));
+    EXPECT_EQ(pool.inUse(), 0u);
+    EXPECT_EQ(pool.usage(), 80u);
+
+    // 缓存的片段直接复用, 不需要新分配, 也就不受预算限制
+    auto reused = pool.acquire(16, false);
+    ASSERT_NE(reused, nullptr);
+    EXPECT_EQ(pool.usage(), 80u);
+    pool.release(std::move(reused));
+
+    // 之后不再有片段归还, 由trim完成收缩
+    EXPECT_TRUE(pool.trim());
+    EXPECT_EQ(pool.usage(), 80u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_FALSE(pool.trim());
+    EXPECT_EQ(pool.usage(), 32u);
+    EXPECT_EQ(pool.cached(), 2u);
+    EXPECT_EQ(pool.peak(), 80u);
+}
+
+TEST(SegmentPoolTest, SegmentsFollowPoolMemoryPolicy)
+{
+    using windlog::MemoryPolicy;
+    // 池不属于某个线程, CONSUMER_NODE等同于不指定节点
+    windlog::SegmentPool pool(2 * 1024 * 1024, 0, 0, std::chrono::milliseconds(0),
+                              MemoryPolicy::transparentHuge(MemoryPolicy::CONSUMER_NODE));
+    EXPECT_TRUE(pool.memory() == MemoryPolicy::transparentHuge());
+
+    // 普通片段与单独分配的超大片段都按池的策略分配
+    for (size_t len : {size_t(16), size_t(3 * 1024 * 1024)})
+    {
+        auto segment = pool.acquire(len);
+        EXPECT_TRUE(segment->memory() == MemoryPolicy::transparentHuge());
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(segment->readAbleBegin()) % (2 * 1024 * 1024), 0u);
+        std::string data(len, 'x');
+        segment->push(data.data(), data.size());
+        EXPECT_TRUE(std::string(segment->readAbleBegin(), segment->readAbleSize()) == data);
+        pool.release(std::move(segment));
+    }
+}
+
+TEST(PageAllocatorTest, EveryPolicyKeepsDataAndFallsBack)
+{
+    using windlog::MemoryPolicy;
+    // 显式大页通常没有预留, 节点1000一般不存在, 都应该退回到可用的分配方式
+    for (const MemoryPolicy& policy :
+         {MemoryPolicy(), MemoryPolicy::normal(MemoryPolicy::currentNode()),
+          MemoryPolicy::transparentHuge(), MemoryPolicy::explicitHuge(),
+          MemoryPolicy::transparentHuge(1000), MemoryPolicy::explicitHuge(100000)})
+    {
+        windlog::Buffer buffer(3 * 1024 * 1024, policy);
+        EXPECT_TRUE(buffer.memory() == policy);
+        if (policy._pages != MemoryPolicy::pages::NORMAL)
+        {
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.readAbleBegin()) % (2 * 1024 * 1024),
+                      0u);
+        }
+
+        // 写满之后继续扩容, 新的内存仍按同样的策略分配
+        std::string data;
+        for (int i = 0; data.size() < 5 * 1024 * 1024; ++i) data += std::to_string(i) + ",";
+        buffer.push(data.data(), data.size());
+        EXPECT_GE(buffer.capacity(), data.size());
+        EXPECT_TRUE(std::string(buffer.readAbleBegin(), buffer.readAbleSize()) == data);
+
+        // 与默认策略的缓冲区交换时, 内存连同策略一起交换
+        windlog::Buffer plain(16);
+        plain.swap(buffer);
+        EXPECT_TRUE(plain.memory() == policy);
+        EXPECT_TRUE(buffer.memory() == MemoryPolicy());
+        EXPECT_TRUE(std::string(plain.readAbleBegin(), plain.readAbleSize()) == data);
+    }
+}
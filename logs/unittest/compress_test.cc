@@ -0,0 +1,241 @@
+#include "compress.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sink.hpp"
+
+namespace fs = std::filesystem;
+using namespace windlog;
+
+static std::string roundTrip(const std::string& data)
+{
+    std::vector<uint32_t> table(Lz4::TABLE_SIZE);
+    std::string compressed(Lz4::compressBound(data.size()), '\0');
+    compressed.resize(Lz4::compress(data.data(), data.size(), &compressed[0], table.data()));
+
+    std::string out(data.size(), '\0');
+    out.resize(Lz4::decompress(compressed.data(), compressed.size(), &out[0], out.size()));
+    return out;
+}
+
+static std::string readFile(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static std::string decodeFile(const std::string& filename)
+{
+    std::string data = readFile(filename);
+    std::string out;
+    Lz4Frame::decode(data.data(), data.size(), out);
+    return out;
+}
+
+// 模拟日志内容: 大量重复的前缀与变化的数字
+static std::string logLines(int count, int seed = 0)
+{
+    std::string text;
+    char line[128];
+    for (int i = 0; i < count; ++i)
+    {
+        int n = snprintf(line, sizeof(line),
+                         "[INFO][12:34:%02d][compress_logger][1402][app.cc:%d] request %d done\n",
+                         (i + seed) % 60, 20 + i % 7, i * 31 + seed);
+        text.append(line, n);
+    }
+    return text;
+}
+
+TEST(Lz4Test, BlockRoundTrip)
+{
+    std::mt19937 rng(42);
+    std::string random(100000, '\0');
+    for (auto& c : random) c = static_cast<char>(rng());
+
+    const std::string cases[] = {"",
+                                 "a",
+                                 "short text",
+                                 std::string(13, 'x'),
+                                 std::string(100000, 'x'),
+                                 "abcabcabcabcabcabcabcabcabcabc",
+                                 logLines(3000),
+                                 random};
+    for (const auto& data : cases) EXPECT_EQ(roundTrip(data), data);
+
+    // 日志文本应当有可观的压缩率
+    std::string text = logLines(3000);
+    std::vector<uint32_t> table(Lz4::TABLE_SIZE);
+    std::string compressed(Lz4::compressBound(text.size()), '\0');
+    EXPECT_LT(Lz4::compress(text.data(), text.size(), &compressed[0], table.data()),
+              text.size() / 4);
+}
+
+TEST(Lz4Test, CorruptBlockThrows)
+{
+    char out[64];
+    // 引用了输出之前的位置
+    const char bad_offset[] = {0x10, 'a', 0x10, 0x00};
+    EXPECT_THROW(Lz4::decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)),
+                 std::runtime_error);
+    // 字面量超出输入
+    const char truncated[] = {static_cast<char>(0x50), 'a', 'b'};
+    EXPECT_THROW(Lz4::decompress(truncated, sizeof(truncated), out, sizeof(out)),
+                 std::runtime_error);
+    // 输出空间不足
+    std::string data(1000, 'x');
+    std::vector<uint32_t> table(Lz4::TABLE_SIZE);
+    std::string compressed(Lz4::compressBound(data.size()), '\0');
+    compressed.resize(Lz4::compress(data.data(), data.size(), &compressed[0], table.data()));
+    EXPECT_THROW(Lz4::decompress(compressed.data(), compressed.size(), out, sizeof(out)),
+                 std::runtime_error);
+}
+
+TEST(Lz4Test, Xxh32KnownValues)
+{
+    EXPECT_EQ(Lz4::xxh32("", 0), 0x02CC5D05u);
+    EXPECT_EQ(Lz4::xxh32("abc", 3), 0x32D153FFu);
+    const char* text = "Nobody inspects the spammish repetition";
+    EXPECT_EQ(Lz4::xxh32(text, strlen(text)), 0xE2293B2Fu);
+}
+
+TEST(CompressedFileSinkTest, DecodesToWrittenData)
+{
+    const std::string filename = "./logfile/compress/basic.log.lz4";
+    fs::remove(filename);
+
+    std::string expected = logLines(20000);
+    {
+        auto sink = SinkFactory::create<CompressedFileSink>(filename, 64 * 1024);
+        // 批次大小各不相同, 有的跨越多个块
+        size_t pos = 0, step = 1;
+        while (pos < expected.size())
+        {
+            size_t n = std::min(step, expected.size() - pos);
+            sink->log(expected.data() + pos, n);
+            pos += n;
+            step = step * 7 % 200003 + 1;
+        }
+    }
+
+    EXPECT_LT(fs::file_size(filename), expected.size() / 4);
+    EXPECT_EQ(decodeFile(filename), expected);
+}
+
+TEST(CompressedFileSinkTest, ReopenAppendsFrame)
+{
+    const std::string filename = "./logfile/compress/reopen.log.lz4";
+    fs::remove(filename);
+
+    std::string first = logLines(1000, 1), second = logLines(1000, 2);
+    {
+        CompressedFileSink sink(filename);
+        sink.log(first.data(), first.size());
+    }
+    {
+        CompressedFileSink sink(filename);
+        sink.log(second.data(), second.size());
+        // 刷新后已写出的块立即可以解压
+        sink.flush();
+        std::string partial = readFile(filename);
+        std::string out;
+        Lz4Frame::decode(partial.data(), partial.size(), out);
+        EXPECT_EQ(out, first + second);
+    }
+    EXPECT_EQ(decodeFile(filename), first + second);
+}
+
+TEST(CompressedFileSinkTest, RecoversFromTornTail)
+{
+    const std::string filename = "./logfile/compress/torn.log.lz4";
+    fs::remove(filename);
+
+    std::string first = logLines(5000, 3), second = logLines(100, 4);
+    {
+        CompressedFileSink sink(filename, 64 * 1024);
+        sink.log(first.data(), first.size());
+    }
+
+    // 去掉结束标记和最后一个块的一部分, 模拟写到一半时崩溃
+    std::string data = readFile(filename);
+    size_t torn = data.size() - 4 - 10;
+    fs::resize_file(filename, torn);
+
+    {
+        CompressedFileSink sink(filename, 64 * 1024);
+        sink.log(second.data(), second.size());
+    }
+
+    // 除最后一块之外的数据都能找回
+    std::string out = decodeFile(filename);
+    ASSERT_GE(out.size(), second.size());
+    EXPECT_EQ(out.substr(out.size() - second.size()), second);
+    std::string recovered = out.substr(0, out.size() - second.size());
+    EXPECT_EQ(recovered, first.substr(0, recovered.size()));
+    EXPECT_GE(recovered.size() + 64 * 1024, first.size());
+}
+
+// 按lz4命令行的默认设置(没有块校验, 带内容校验)构造一帧, 末尾留下半个块
+static std::string foreignFrame(const std::vector<std::string>& blocks, uint8_t flg)
+{
+    auto put32 = [](std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(value >> (i * 8)));
+    };
+    std::string frame;
+    put32(frame, Lz4Frame::MAGIC);
+    char desc[2] = {static_cast<char>(flg), 0x40};
+    frame.append(desc, 2);
+    frame.push_back(static_cast<char>((Lz4::xxh32(desc, 2) >> 8) & 0xff));
+
+    std::vector<uint32_t> table(Lz4::TABLE_SIZE);
+    for (const auto& block : blocks)
+    {
+        std::string compressed(Lz4::compressBound(block.size()), '\0');
+        compressed.resize(
+            Lz4::compress(block.data(), block.size(), &compressed[0], table.data()));
+        put32(frame, compressed.size());
+        frame += compressed;
+    }
+    put32(frame, 1000);
+    frame += "torn";
+    return frame;
+}
+
+TEST(CompressedFileSinkTest, RecoversFrameWithoutBlockChecksums)
+{
+    const std::string filename = "./logfile/compress/foreign.log.lz4";
+    std::vector<std::string> blocks = {logLines(500, 5), logLines(500, 6), logLines(500, 7)};
+    std::string first = blocks[0] + blocks[1] + blocks[2], second = logLines(100, 8);
+
+    for (uint8_t flg : {0x60, 0x64})
+    {
+        fs::remove(filename);
+        util::file::createDirectory(util::file::path(filename));
+        std::ofstream(filename, std::ios::binary) << foreignFrame(blocks, flg);
+
+        {
+            CompressedFileSink sink(filename, 64 * 1024);
+            sink.log(second.data(), second.size());
+        }
+        // 完整的块全部保留, 补上的结束标记(与内容校验)让旧帧可以正常解压
+        EXPECT_EQ(decodeFile(filename), first + second) << "FLG " << int(flg);
+    }
+}
+
+TEST(CompressedFileSinkTest, RejectsForeignFile)
+{
+    const std::string filename = "./logfile/compress/plain.log";
+    util::file::createDirectory(util::file::path(filename));
+    std::ofstream(filename) << "plain text log\n";
+    EXPECT_THROW(CompressedFileSink sink(filename), std::runtime_error);
+    EXPECT_EQ(readFile(filename), "plain text log\n");
+}
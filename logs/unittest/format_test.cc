@@ -6,8 +6,8 @@
     struct LogMsg
     {
         .......
-        LogMsg(LogLevel::value level, const std::string& file, size_t line, const std::string& logger,
-            const std::string& payload)
+        LogMsg(LogLevel::value level, std::string_view file, size_t line, std::string_view logger,
+            std::string_view payload)
           .....
         {
         }
@@ -47,3 +47,74 @@ TEST(FormatterTest, FormatGeneratesExpectedOutput) {
     EXPECT_NE(output.find("core"), std::string::npos);
     EXPECT_NE(output.find("hello log"), std::string::npos);
 }
+
+TEST(FormatterTest, CompiledPatternMatchesRuntimePattern) {
+    LogMsg msg(LogLevel::value::ERROR, "/src/main.cpp", 42, "core", "hello log");
+
+    Formatter runtime("[%p]%T[%d{%Y-%m-%d %H:%M:%S}][%c][%t]%T[%f:%l]%T%m %% done%n");
+    auto compiled = Formatter::compile(
+        WINDLOG_PATTERN("[%p]%T[%d{%Y-%m-%d %H:%M:%S}][%c][%t]%T[%f:%l]%T%m %% done%n"));
+
+    EXPECT_EQ(compiled->format(msg), runtime.format(msg));
+    EXPECT_NE(runtime.format(msg).find("[main.cpp:42]"), std::string::npos);
+    EXPECT_NE(runtime.format(msg).find("hello log % done\n"), std::string::npos);
+}
+
+TEST(FormatterTest, InvalidRuntimePatternThrows) {
+    LogMsg msg(LogLevel::value::INFO, "main.cpp", 42, "core", "hello log");
+
+    Formatter fmt("%q");
+    EXPECT_THROW(fmt.format(msg), std::runtime_error);
+}
+
+TEST(FormatterTest, CachedDateMatchesStrftime) {
+    auto expect = [](const char* fmt, time_t t) {
+        struct tm tm;
+        localtime_r(&t, &tm);
+        char buff[128] = {0};
+        strftime(buff, sizeof(buff) - 1, fmt, &tm);
+        return std::string(buff);
+    };
+    auto actual = [](const char* fmt, time_t t) {
+        Buffer out(64);
+        DateFormatItem::formatTime(out, fmt, t);
+        return std::string(out.readAbleBegin(), out.readAbleSize());
+    };
+
+    // 多个子格式交替使用, 跨越秒, 分钟与小时边界, 超出槽位数量, 以及不缓存的长格式
+    const char* fmts[] = {"%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%S", "%M", "%s", "[%T]",
+                          "%Y-%m-%d %H:%M:%S | %A %B %d | week %U day %j"};
+    time_t base = 1700000000 - 5;
+    for (time_t t = base; t < base + 3700; t += 7)
+    {
+        for (const char* fmt : fmts)
+        {
+            EXPECT_EQ(actual(fmt, t), expect(fmt, t));
+            EXPECT_EQ(actual(fmt, t), expect(fmt, t));
+        }
+    }
+
+    // 时间倒退也要重新计算
+    EXPECT_EQ(actual("%H:%M:%S", base - 3600), expect("%H:%M:%S", base - 3600));
+}
+
+TEST(FormatterTest, SubSecondDateSpecifiers) {
+    LogMsg msg(LogLevel::value::INFO, "main.cpp", 42, "core", "hello log");
+    msg._ctime = 1700000000;
+    msg._nsec = 12345678;
+
+    struct tm tm;
+    localtime_r(&msg._ctime, &tm);
+    char hms[16];
+    strftime(hms, sizeof(hms), "%H:%M:%S", &tm);
+
+    Formatter runtime("%d{%H:%M:%S.%3N|%6N|%N|%1N|%%N}");
+    auto compiled = Formatter::compile(WINDLOG_PATTERN("%d{%H:%M:%S.%3N|%6N|%N|%1N|%%N}"));
+    std::string expect = std::string(hms) + ".012|012345|012345678|0|%N";
+    EXPECT_EQ(runtime.format(msg), expect);
+    EXPECT_EQ(compiled->format(msg), expect);
+
+    // 同一秒内只改写秒以下的数字
+    msg._nsec = 999999999;
+    EXPECT_EQ(runtime.format(msg), std::string(hms) + ".999|999999|999999999|9|%N");
+}
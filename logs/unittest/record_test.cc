@@ -0,0 +1,88 @@
+#include "record.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <string>
+
+using namespace windlog;
+
+// 将一次调用编码成记录, 再解码渲染出主体信息
+static std::string roundTrip(LogRecord::View& view, std::string& record, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    LogRecord::encode(record, LogLevel::value::WARN, "/path/to/record_test.cc", 77, fmt, ap);
+    va_end(ap);
+
+    size_t n = LogRecord::decode(record.data(), record.size(), view);
+    EXPECT_EQ(n, record.size());
+
+    std::string payload;
+    LogRecord::render(payload, view);
+    return payload;
+}
+
+TEST(LogRecordTest, HeaderRoundTrip)
+{
+    LogRecord::View view;
+    std::string record;
+    roundTrip(view, record, "%d", 1);
+
+    EXPECT_EQ(view._header._level, LogLevel::value::WARN);
+    EXPECT_EQ(view._header._line, 77u);
+    EXPECT_EQ(LogMsg::intToThread(view._header._tid), std::this_thread::get_id());
+    EXPECT_GT(view._header._ctime, 0);
+    EXPECT_STREQ(view._file, "record_test.cc");
+}
+
+TEST(LogRecordTest, RenderMatchesPrintf)
+{
+    LogRecord::View view;
+    std::string record;
+    int width = 8;
+
+    EXPECT_EQ(roundTrip(view, record, "plain text"), "plain text");
+    EXPECT_EQ(roundTrip(view, record, "100%% %d%%", 42), "100% 42%");
+    EXPECT_EQ(roundTrip(view, record, "%hhd %hd %ld %lld", 300, 70000, -5L, 1LL << 40),
+              "44 4464 -5 1099511627776");
+    EXPECT_EQ(roundTrip(view, record, "%zu %x %08X %o", (size_t)123, 255u, 0xabcu, 8u),
+              "123 ff 00000ABC 10");
+    EXPECT_EQ(roundTrip(view, record, "[%-*d] [%.*s]", width, 7, 3, "abcdef"), "[7       ] [abc]");
+    EXPECT_EQ(roundTrip(view, record, "%.3f %Lg %c", 3.14159, 2.5L, 'x'), "3.142 2.5 x");
+    EXPECT_EQ(roundTrip(view, record, "%s|%10s", "hello", "right"), "hello|     right");
+    EXPECT_EQ(roundTrip(view, record, "%s", (const char*)nullptr), "(null)");
+}
+
+TEST(LogRecordTest, UnsupportedSpecFallsBackToEagerRendering)
+{
+    LogRecord::View view;
+    std::string record;
+    // %m依赖调用时的errno, 不能延迟
+    errno = EINVAL;
+    EXPECT_EQ(roundTrip(view, record, "%d: %m", 5), std::string("5: ") + strerror(EINVAL));
+    EXPECT_STREQ(view._fmt, "%s");
+}
+
+TEST(LogRecordTest, PrecisionBoundsUnterminatedString)
+{
+    // 字符串紧贴在不可访问的页之前, 越过精度读取就会触发段错误
+    long page = sysconf(_SC_PAGESIZE);
+    char* mem = static_cast<char*>(
+        mmap(nullptr, page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    ASSERT_NE(mem, MAP_FAILED);
+    ASSERT_EQ(mprotect(mem + page, page, PROT_NONE), 0);
+    char* str = mem + page - 4;
+    memcpy(str, "abcd", 4);
+
+    LogRecord::View view;
+    std::string record;
+    EXPECT_EQ(roundTrip(view, record, "[%.*s]", 4, str), "[abcd]");
+    EXPECT_EQ(roundTrip(view, record, "[%.3s]", str), "[abc]");
+    EXPECT_EQ(roundTrip(view, record, "[%6.4s]", str), "[  abcd]");
+    EXPECT_EQ(roundTrip(view, record, "[%.*s]", -1, "abc"), "[abc]");
+
+    munmap(mem, page * 2);
+}
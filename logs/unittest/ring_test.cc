@@ -0,0 +1,87 @@
+#include "ring.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using windlog::Buffer;
+using windlog::RingBuffer;
+
+TEST(RingBufferTest, WrapAroundKeepsRecordsIntact)
+{
+    // 容量很小, 迫使记录跨越环尾
+    RingBuffer ring(64);
+    Buffer out;
+
+    std::string expect;
+    for (int i = 0; i < 100; ++i)
+    {
+        std::string msg = "msg-" + std::to_string(i) + "\n";
+        ASSERT_TRUE(ring.tryPush(msg.c_str(), msg.size()));
+        expect += msg;
+        ring.popTo(out);
+    }
+
+    EXPECT_FALSE(ring.readable());
+    EXPECT_EQ(std::string(out.readAbleBegin(), out.readAbleSize()), expect);
+}
+
+TEST(RingBufferTest, FullRingRejectsPush)
+{
+    RingBuffer ring(64);
+    char data[24] = {0};
+
+    // 每条记录占 8 + 24 = 32 字节
+    EXPECT_TRUE(ring.tryPush(data, sizeof(data)));
+    EXPECT_TRUE(ring.tryPush(data, sizeof(data)));
+    EXPECT_FALSE(ring.tryPush(data, sizeof(data)));
+
+    Buffer out;
+    EXPECT_EQ(ring.popTo(out), 2 * sizeof(data));
+    EXPECT_TRUE(ring.tryPush(data, sizeof(data)));
+    EXPECT_THROW(ring.tryPush(data, 128), std::runtime_error);
+}
+
+TEST(RingBufferTest, MultiProducerPreservesPerThreadOrder)
+{
+    const int thr_count = 4;
+    const int msg_count = 20000;
+    RingBuffer ring(4096);
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < thr_count; ++t)
+    {
+        producers.emplace_back([&, t]() {
+            for (int i = 0; i < msg_count; ++i)
+            {
+                int rec[2] = {t, i};
+                while (!ring.tryPush(reinterpret_cast<const char*>(rec), sizeof(rec)))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    // 单消费者检查每个生产者的序号都是连续递增的
+    std::vector<int> next(thr_count, 0);
+    int total = 0;
+    Buffer out;
+    while (total < thr_count * msg_count)
+    {
+        ring.popTo(out);
+        while (out.readAbleSize() >= 2 * sizeof(int))
+        {
+            int rec[2];
+            memcpy(rec, out.readAbleBegin(), sizeof(rec));
+            out.moveReader(sizeof(rec));
+            ASSERT_EQ(rec[1], next[rec[0]]);
+            ++next[rec[0]];
+            ++total;
+        }
+        out.reset();
+    }
+
+    for (auto& th : producers) th.join();
+    EXPECT_FALSE(ring.readable());
+}
@@ -1,12 +1,15 @@
 #include "sink.hpp"
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include "format.hpp"
 #include "level.hpp"
@@ -318,4 +321,615 @@ TEST_F(SinkTest, RollByTimeSinkRollsFiles)
     }
 
     printCurrentDirFiles();  // 清理后
-}
\ No newline at end of file
+}
+TEST_F(SinkTest, FdFileSinkWritesAllSegments)
+{
+    const std::string filename = "./logfile/fd/fd_sink.log";
+    fs::remove(filename);
+
+    auto sink = SinkFactory::create<FdFileSink>(filename);
+    std::string output = fmt.format(createLogMsg());
+    sink->log(output.c_str(), output.size());
+
+    // 段数超过单次writev的批量, 中间夹杂空段
+    std::vector<std::string> parts;
+    for (int i = 0; i < 200; ++i) parts.push_back(i % 10 == 0 ? "" : std::to_string(i) + "\n");
+    std::vector<struct iovec> iov;
+    std::string expected = output;
+    for (auto& part : parts)
+    {
+        iov.push_back({&part[0], part.size()});
+        expected += part;
+    }
+    sink->logv(iov.data(), iov.size());
+    sink->flush();
+
+    std::ifstream in(filename);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, expected);
+    fs::remove(filename);
+}
+
+TEST_F(SinkTest, FdRollBySizeSinkKeepsVectorInOneFile)
+{
+    const std::string dir = "./logfile/fdroll";
+    fs::remove_all(dir);
+
+    const size_t max_size = 100;
+    auto sink = SinkFactory::create<FdRollBySizeSink>(max_size, dir + "/roll");
+    std::string line(30, 'x');
+    line.back() = '\n';
+    for (int i = 0; i < 20; ++i)
+    {
+        struct iovec iov[2] = {{&line[0], line.size()}, {&line[0], line.size()}};
+        sink->logv(iov, 2);
+    }
+
+    size_t files = 0, total = 0;
+    for (const auto& entry : fs::directory_iterator(dir))
+    {
+        ++files;
+        total += fs::file_size(entry);
+        EXPECT_LE(fs::file_size(entry), max_size);
+        EXPECT_EQ(fs::file_size(entry) % (2 * line.size()), 0u);
+    }
+    EXPECT_GE(files, 2u);
+    EXPECT_EQ(total, 20 * 2 * line.size());
+    fs::remove_all(dir);
+}
+
+// 按文件名排序列出目录中的文件
+static std::vector<fs::path> sortedFiles(const std::string& dir)
+{
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(dir)) files.push_back(entry.path());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static std::string readFile(const fs::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST_F(SinkTest, RollingFileSinkKeepsMaxFiles)
+{
+    const std::string dir = "./logfile/rolling_files";
+    fs::remove_all(dir);
+
+    std::string line(30, 'x');
+    line.back() = '\n';
+    {
+        RollingFileSink sink(dir + "/app", std::chrono::seconds(0), 100, Retention(3));
+        for (int i = 0; i < 40; ++i) sink.log(line.data(), line.size());
+    }
+
+    // 3个已完成的文件加上正在写的文件, 最新的文件都保留了下来
+    auto files = sortedFiles(dir);
+    ASSERT_EQ(files.size(), 4u);
+    for (const auto& file : files)
+    {
+        EXPECT_EQ(file.extension(), ".log");
+        EXPECT_LE(fs::file_size(file), 100u);
+    }
+    // 每个文件放得下3行, 40 = 13 * 3 + 1
+    EXPECT_EQ(fs::file_size(files.back()), line.size());
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, RollingFileSinkCompressesFinishedSegments)
+{
+    const std::string dir = "./logfile/rolling_lz4";
+    fs::remove_all(dir);
+    // 名称相近的其它文件不受影响
+    fs::create_directories(dir);
+    std::ofstream(dir + "/app-server-0.log") << "other\n";
+
+    std::string expected;
+    {
+        RollingFileSink sink(dir + "/app", std::chrono::seconds(0), 4096, Retention(0, 0, true));
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::string line = "line " + std::to_string(i) + " " + std::string(i % 40, 'z') + "\n";
+            sink.log(line.data(), line.size());
+            expected += line;
+        }
+    }
+
+    // 除了最后一个文件之外都已压缩, 按文件名顺序解压拼接即为原始内容
+    std::string content;
+    size_t compressed = 0;
+    for (const auto& file : sortedFiles(dir))
+    {
+        std::string name = file.filename().string();
+        if (name == "app-server-0.log")
+            continue;
+        std::string data = readFile(file);
+        if (file.extension() == ".lz4")
+        {
+            ++compressed;
+            Lz4Frame::decode(data.data(), data.size(), content);
+        }
+        else
+        {
+            content += data;
+        }
+    }
+    EXPECT_GT(compressed, 1u);
+    EXPECT_EQ(content, expected);
+    EXPECT_EQ(readFile(dir + "/app-server-0.log"), "other\n");
+
+    // 再次打开时, 上次运行留下的未压缩文件也会被压缩
+    {
+        RollingFileSink sink(dir + "/app", std::chrono::seconds(0), 4096, Retention(0, 0, true));
+    }
+    size_t plain = 0;
+    for (const auto& file : sortedFiles(dir))
+    {
+        if (file.extension() == ".log" && file.filename() != "app-server-0.log")
+            ++plain;
+    }
+    EXPECT_EQ(plain, 1u);
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, RollingFileSinkRollsByTimeAndLimitsBytes)
+{
+    const std::string dir = "./logfile/rolling_time";
+    fs::remove_all(dir);
+
+    std::string line(50, 't');
+    line.back() = '\n';
+    {
+        RollingFileSink sink(dir + "/app", std::chrono::seconds(1), 0, Retention(0, 120));
+        for (int i = 0; i < 3; ++i)
+        {
+            sink.log(line.data(), line.size());
+            sink.log(line.data(), line.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        }
+    }
+
+    // 每秒一个文件, 已完成文件的总大小不超过上限
+    auto files = sortedFiles(dir);
+    ASSERT_GE(files.size(), 2u);
+    size_t finished = 0;
+    for (size_t i = 0; i + 1 < files.size(); ++i) finished += fs::file_size(files[i]);
+    EXPECT_LE(finished, 120u);
+    EXPECT_GT(finished, 0u);
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, RollingFileSinkSwapsInPreallocatedSpare)
+{
+    const std::string dir = "./logfile/rolling_spare";
+    fs::remove_all(dir);
+    const size_t max_size = 256 * 1024;
+    auto allocated = [](const std::string& path) {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 ? st.st_blocks * 512 : 0;
+    };
+    auto waitFor = [](const std::string& path) {
+        for (int i = 0; i < 200 && !fs::exists(path); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return fs::exists(path);
+    };
+
+    std::string line(1000, 's');
+    line.back() = '\n';
+    {
+        RollingFileSink sink(dir + "/app", std::chrono::seconds(0), max_size);
+        ASSERT_TRUE(waitFor(dir + "/app.spare"));
+        // 备用文件已经预留好空间, 大小仍然为零
+        EXPECT_EQ(fs::file_size(dir + "/app.spare"), 0u);
+        EXPECT_GE(allocated(dir + "/app.spare"), max_size);
+
+        std::string first = sink.filename();
+        for (size_t i = 0; i < max_size / line.size() + 1; ++i)
+            sink.log(line.data(), line.size());
+        EXPECT_NE(sink.filename(), first);
+        // 换上的备用文件随后被改名为正式文件名
+        ASSERT_TRUE(waitFor(sink.filename()));
+        EXPECT_EQ(fs::file_size(sink.filename()), line.size());
+        EXPECT_TRUE(waitFor(dir + "/app.spare"));
+    }
+
+    // 没有用上的备用文件被删除, 所有文件都截掉了预留的部分
+    EXPECT_FALSE(fs::exists(dir + "/app.spare"));
+    auto files = sortedFiles(dir);
+    ASSERT_EQ(files.size(), 2u);
+    EXPECT_EQ(fs::file_size(files[0]) + fs::file_size(files[1]),
+              (max_size / line.size() + 1) * line.size());
+    for (const auto& file : files) EXPECT_LT(allocated(file), fs::file_size(file) + 64 * 1024);
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, FdRollBySizeSinkResumesExistingFile)
+{
+    const std::string dir = "./logfile/fdresume";
+    const std::string base = dir + "/roll";
+    std::string line(60, 'r');
+    line.back() = '\n';
+
+    // 文件名精确到秒, 跨秒时重试
+    for (int attempt = 0; attempt < 3; ++attempt)
+    {
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        std::string existing = RollBySizeSink::makeFilename(base, 0);
+        std::ofstream(existing) << line;
+
+        FdRollBySizeSink sink(100, base);
+        if (sink.filename() != existing)
+            continue;
+        // 接着已有的60字节计数, 再写60字节就要滚动
+        sink.log(line.data(), line.size());
+        EXPECT_NE(sink.filename(), existing);
+        EXPECT_EQ(fs::file_size(existing), line.size());
+        break;
+    }
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, FdSinkReportsErrors)
+{
+    // /dev/full的写入总是以ENOSPC失败
+    if (!fs::exists("/dev/full"))
+        GTEST_SKIP();
+
+    FdFileSink sink("/dev/full");
+    try
+    {
+        sink.log("data", 4);
+        FAIL() << "expected SinkError";
+    }
+    catch (const SinkError& e)
+    {
+        EXPECT_EQ(e.code(), ENOSPC);
+        EXPECT_EQ(e.filename(), "/dev/full");
+    }
+
+    // 设置处理函数后由它接管, 不再抛出
+    std::vector<int> codes;
+    sink.setErrorHandler([&](const SinkError& e) { codes.push_back(e.code()); });
+    EXPECT_NO_THROW(sink.log("data", 4));
+    ASSERT_EQ(codes.size(), 1u);
+    EXPECT_EQ(codes[0], ENOSPC);
+
+    // 目录不能以写方式打开
+    fs::create_directories("./logfile/fd/dir");
+    EXPECT_THROW(FdFileSink("./logfile/fd/dir"), SinkError);
+}
+
+TEST_F(SinkTest, FdSinkDurabilityPolicies)
+{
+    const std::string filename = "./logfile/fd/durable.log";
+    fs::remove(filename);
+    std::string line(60, 'x');
+
+    // 不设置策略时从不同步
+    FdFileSink sink(filename);
+    sink.log(line.data(), line.size());
+    sink.commit(true);
+    sink.flush();
+    EXPECT_EQ(sink.syncStats().count(), 0u);
+
+    // 未同步的数据达到阈值才同步, 同步后重新计数
+    sink.setDurability(Durability::bytes(100));
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 0u);
+    sink.log(line.data(), line.size());
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 1u);
+    sink.log(line.data(), line.size());
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 1u);
+
+    // 只有带ERROR的批次才同步, 没有新数据时不重复同步
+    sink.setDurability(Durability::onError());
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 1u);
+    sink.commit(true);
+    EXPECT_EQ(sink.syncStats().count(), 2u);
+    sink.commit(true);
+    EXPECT_EQ(sink.syncStats().count(), 2u);
+
+    // 距上次同步超过间隔才同步
+    sink.setDurability(Durability::interval(std::chrono::milliseconds(50)));
+    sink.log(line.data(), line.size());
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 2u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 3u);
+
+    // 间隔未到时, 空闲通知同步剩余的数据, 没有剩余时不同步
+    sink.log(line.data(), line.size());
+    sink.commit(false);
+    EXPECT_EQ(sink.syncStats().count(), 3u);
+    sink.idle();
+    EXPECT_EQ(sink.syncStats().count(), 4u);
+    sink.idle();
+    EXPECT_EQ(sink.syncStats().count(), 4u);
+
+    // flush同步所有剩余的数据
+    sink.log(line.data(), line.size());
+    sink.flush();
+    EXPECT_EQ(sink.syncStats().count(), 5u);
+    EXPECT_GE(sink.syncStats().maxNs(), sink.syncStats().lastNs());
+    fs::remove(filename);
+}
+
+TEST_F(SinkTest, DurabilityCoversBufferedSinks)
+{
+    const std::string filename = "./logfile/fd/durable_buffered.log";
+    fs::remove(filename);
+    std::string line = "durable line\n";
+
+    for (bool uring : {true, false})
+    {
+        // 写请求完成之后才同步
+        UringFileSink sink(filename, 4, uring);
+        sink.setDurability(Durability::onError());
+        sink.log(line.data(), line.size());
+        sink.commit(true);
+        EXPECT_EQ(sink.syncStats().count(), 1u);
+        EXPECT_EQ(fs::file_size(filename), line.size());
+        fs::remove(filename);
+    }
+
+    {
+        MmapFileSink sink(filename, 8192, 4096);
+        sink.setDurability(Durability::bytes(1));
+        sink.log(line.data(), line.size());
+        sink.commit(false);
+        EXPECT_EQ(sink.syncStats().count(), 1u);
+    }
+    fs::remove(filename);
+}
+
+TEST(SyncStatsTest, BucketsByMicroseconds)
+{
+    SyncStats stats;
+    EXPECT_EQ(stats.percentileUs(99), 0u);
+
+    stats.record(500);      // 不足1微秒
+    stats.record(3000);     // [2, 4)微秒
+    stats.record(1000000);  // [512, 1024)微秒
+    EXPECT_EQ(stats.count(), 3u);
+    EXPECT_EQ(stats.totalNs(), 1003500u);
+    EXPECT_EQ(stats.maxNs(), 1000000u);
+    EXPECT_EQ(stats.lastNs(), 1000000u);
+    EXPECT_EQ(stats.bucket(0), 1u);
+    EXPECT_EQ(stats.bucket(2), 1u);
+    EXPECT_EQ(stats.bucket(10), 1u);
+    EXPECT_EQ(stats.percentileUs(0), 1u);
+    EXPECT_EQ(stats.percentileUs(50), 4u);
+    EXPECT_EQ(stats.percentileUs(99), 1024u);
+}
+
+// 两种写入方式都要验证: io_uring与后台线程
+class UringFileSinkTest : public ::testing::TestWithParam<bool>
+{
+};
+
+TEST_P(UringFileSinkTest, WritesInSubmissionOrder)
+{
+    // 两个参数实例可能被ctest并行执行, 各用各的文件
+    const std::string filename =
+        std::string("./logfile/uring/uring_sink_") + (GetParam() ? "uring" : "thread") + ".log";
+    fs::remove(filename);
+
+    std::string expected;
+    {
+        UringFileSink sink(filename, 3, GetParam());
+        if (GetParam() && !sink.usingUring())
+            GTEST_SKIP() << "io_uring unavailable";
+
+        // 整块交换, 换回的缓冲区已经重置且容量不变
+        for (int i = 0; i < 50; ++i)
+        {
+            Buffer buffer(64 * 1024);
+            std::string chunk(1000 + i * 37, static_cast<char>('a' + i % 26));
+            buffer.push(chunk.data(), chunk.size());
+            expected += chunk;
+            sink.logBuffer(buffer);
+            EXPECT_EQ(buffer.readAbleSize(), 0u);
+            EXPECT_GE(buffer.capacity(), 64u * 1024);
+        }
+
+        // 普通写入与多段写入
+        std::string line = "plain line\n";
+        sink.log(line.data(), line.size());
+        expected += line;
+        struct iovec iov[2] = {{&line[0], 6}, {&line[6], line.size() - 6}};
+        sink.logv(iov, 2);
+        expected += line;
+        sink.flush();
+
+        std::ifstream in(filename);
+        std::string content((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+        EXPECT_EQ(content, expected);
+    }
+
+    // 重新打开后接着文件末尾写
+    {
+        UringFileSink sink(filename, 2, GetParam());
+        sink.log("tail\n", 5);
+        expected += "tail\n";
+    }
+    std::ifstream in(filename);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, expected);
+    fs::remove(filename);
+}
+
+TEST_P(UringFileSinkTest, ReportsWriteErrors)
+{
+    if (!fs::exists("/dev/full"))
+        GTEST_SKIP();
+
+    UringFileSink sink("/dev/full", 2, GetParam());
+    std::vector<int> codes;
+    sink.setErrorHandler([&](const SinkError& e) { codes.push_back(e.code()); });
+    sink.log("data", 4);
+    sink.flush();
+    ASSERT_EQ(codes.size(), 1u);
+    EXPECT_EQ(codes[0], ENOSPC);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, UringFileSinkTest, ::testing::Values(true, false));
+
+TEST_F(SinkTest, MmapFileSinkCrossesWindowsAndTruncatesTail)
+{
+    const std::string filename = "./logfile/mmap/mmap_sink.log";
+    fs::remove(filename);
+
+    std::string expected;
+    {
+        // 小窗口, 让写入多次跨越窗口边界
+        MmapFileSink sink(filename, 8192, 4096);
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::string line = "line " + std::to_string(i) + std::string(i % 50, '.') + "\n";
+            sink.log(line.data(), line.size());
+            expected += line;
+        }
+        struct iovec iov[2] = {{const_cast<char*>("ab"), 2}, {const_cast<char*>("c\n"), 2}};
+        sink.logv(iov, 2);
+        expected += "abc\n";
+        sink.flush();
+
+        // 映射中的数据立即对读者可见, 文件大小包含预分配部分
+        EXPECT_GE(fs::file_size(filename), expected.size());
+        EXPECT_EQ(fs::file_size(filename) % 8192, 0u);
+    }
+
+    // 关闭后截掉未使用的尾部
+    EXPECT_EQ(fs::file_size(filename), expected.size());
+
+    // 模拟崩溃留下的零字节尾部, 再次打开后接着有效数据写
+    fs::resize_file(filename, expected.size() + 5000);
+    {
+        MmapFileSink sink(filename, 8192, 4096);
+        sink.log("reopen\n", 7);
+        expected += "reopen\n";
+    }
+    std::ifstream in(filename);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, expected);
+    fs::remove(filename);
+}
+
+TEST_F(SinkTest, MmapRollBySizeSinkRollsFiles)
+{
+    const std::string dir = "./logfile/mmaproll";
+    fs::remove_all(dir);
+
+    const size_t max_size = 100;
+    {
+        auto sink = SinkFactory::create<MmapRollBySizeSink>(max_size, dir + "/roll");
+        std::string output = fmt.format(createLogMsg());
+        for (int i = 0; i < 20; ++i) sink->log(output.c_str(), output.size());
+    }
+
+    size_t files = 0;
+    for (const auto& entry : fs::directory_iterator(dir))
+    {
+        ++files;
+        // 关闭后不会残留预分配的部分
+        EXPECT_LE(fs::file_size(entry), max_size);
+        EXPECT_GT(fs::file_size(entry), 0u);
+    }
+    EXPECT_GE(files, 2u);
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, MmapRollBySizeSinkResumesExistingFile)
+{
+    const std::string dir = "./logfile/mmapresume";
+    const std::string base = dir + "/roll";
+    std::string line(60, 'r');
+    line.back() = '\n';
+
+    // 文件名精确到秒, 跨秒时重试
+    for (int attempt = 0; attempt < 3; ++attempt)
+    {
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        std::string existing = RollBySizeSink::makeFilename(base, 0);
+        std::ofstream(existing) << line;
+
+        {
+            MmapRollBySizeSink sink(100, base);
+            if (sink.filename() != existing)
+                continue;
+            // 接着已有的60字节计数, 再写60字节就要滚动
+            sink.log(line.data(), line.size());
+            EXPECT_NE(sink.filename(), existing);
+        }
+        EXPECT_EQ(fs::file_size(existing), line.size());
+        break;
+    }
+    fs::remove_all(dir);
+}
+
+TEST_F(SinkTest, AsyncSinkBlocksWhenQueueIsFull)
+{
+    const std::string filename = "./logfile/async_sink.log";
+    std::remove(filename.c_str());
+    auto file = std::make_shared<FdFileSink>(filename);
+    std::string expected;
+    {
+        AsyncSink sink(file, SinkQueue::block(64));
+        for (int i = 0; i < 2000; ++i)
+        {
+            std::string line = "line " + std::to_string(i) + "\n";
+            sink.log(line.data(), line.size());
+            expected += line;
+        }
+        sink.flush();
+        EXPECT_EQ(readFile(filename), expected);
+        EXPECT_EQ(sink.writtenBytes(), expected.size());
+        EXPECT_EQ(sink.droppedBatches(), 0u);
+        EXPECT_EQ(sink.queuedBytes(), 0u);
+        EXPECT_GT(sink.lagStats().count(), 0u);
+
+        // 析构时写完队列中剩余的数据
+        sink.log("tail\n", 5);
+    }
+    EXPECT_EQ(readFile(filename), expected + "tail\n");
+}
+
+class ThrowingSink : public LogSink
+{
+   public:
+    void log(const char* data, size_t len) override
+    {
+        if (std::string(data, len).find("bad") != std::string::npos)
+            throw std::runtime_error("bad batch");
+        _content.append(data, len);
+    }
+    void flush() override {}
+
+    std::string _content;
+};
+
+TEST_F(SinkTest, AsyncSinkReportsErrorsAndKeepsRunning)
+{
+    auto inner = std::make_shared<ThrowingSink>();
+    AsyncSink sink(inner);
+    std::vector<std::string> errors;
+    sink.setErrorHandler([&](const std::exception& e) { errors.push_back(e.what()); });
+
+    sink.log("bad\n", 4);
+    sink.flush();
+    sink.log("good\n", 5);
+    sink.flush();
+
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_EQ(errors[0], "bad batch");
+    EXPECT_EQ(inner->_content, "good\n");
+}
@@ -0,0 +1,92 @@
+//site_test.cc
+
+/*
+    单元测试, 调用点静态元数据与编译期等级消除
+    本文件将编译期等级下限设为WARN, DEBUG与INFO的宏调用应当被完全消除
+*/
+
+#define WINDLOG_ACTIVE_LEVEL WINDLOG_LEVEL_WARN
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "windlog.hpp"
+
+class StringSink : public windlog::LogSink
+{
+   public:
+    void log(const char* data, size_t len) override { _content.append(data, len); }
+    void flush() override {}
+
+    std::string _content;
+};
+
+static windlog::Logger::ptr buildLogger(const std::shared_ptr<StringSink>& sink)
+{
+    return std::make_shared<windlog::SyncLogger>(
+        "site_logger", windlog::LogLevel::value::DEBUG,
+        std::make_shared<windlog::Formatter>("[%p][%f:%l]%m%n"),
+        std::vector<windlog::LogSink::ptr>{sink});
+}
+
+static const windlog::LogSite* currentSite()
+{
+    return WINDLOG_SITE();
+}
+
+TEST(LogSiteTest, SiteIsStaticPerCallSite)
+{
+    static_assert(windlog::LogSite::basename("/a/b/c.cc") == "c.cc");
+    static_assert(windlog::LogSite::basename("c.cc") == "c.cc");
+
+    const windlog::LogSite* site = currentSite();
+    EXPECT_EQ(site, currentSite());
+    EXPECT_EQ(site->_file, "site_test.cc");
+    EXPECT_NE(site, WINDLOG_SITE());
+}
+
+TEST(LogSiteTest, MacrosPassSiteMetadata)
+{
+    auto sink = std::make_shared<StringSink>();
+    auto logger = buildLogger(sink);
+
+    int line = __LINE__ + 1;
+    WI__WARN(logger, "value %d", 42);
+    EXPECT_EQ(sink->_content, "[WARN][site_test.cc:" + std::to_string(line) + "]value 42\n");
+}
+
+TEST(LogSiteTest, NonStaticFileNameIsNotCached)
+{
+    auto sink = std::make_shared<StringSink>();
+    auto logger = buildLogger(sink);
+
+    // 同一块内存先后存放不同的路径, 不能命中上一次的基础名
+    char path[32] = "src/first.cc";
+    logger->warn(path, 1, "%s", "a");
+    snprintf(path, sizeof(path), "%s", "lib/second.cc");
+    logger->warn(path, 2, "%s", "b");
+    EXPECT_EQ(sink->_content, "[WARN][first.cc:1]a\n[WARN][second.cc:2]b\n");
+}
+
+TEST(LogSiteTest, DisabledLevelsAreCompiledOut)
+{
+    auto sink = std::make_shared<StringSink>();
+    auto logger = buildLogger(sink);
+
+    // 被消除的调用不会对参数求值
+    int evaluated = 0;
+    WI__DEBUG(logger, "%d", ++evaluated);
+    WI__INFO(logger, "%d", ++evaluated);
+    LOG__DEBUG("%d", ++evaluated);
+    logger->DEBUG("%d", ++evaluated);
+    logger->INFO("%d", ++evaluated);
+    EXPECT_EQ(evaluated, 0);
+    EXPECT_TRUE(sink->_content.empty());
+
+    WI__ERROR(logger, "%d", ++evaluated);
+    logger->FATAL("%d", ++evaluated);
+    EXPECT_EQ(evaluated, 2);
+    EXPECT_NE(sink->_content.find("[ERROR][site_test.cc:"), std::string::npos);
+    EXPECT_NE(sink->_content.find("[FATAL][site_test.cc:"), std::string::npos);
+}
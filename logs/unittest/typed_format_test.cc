@@ -0,0 +1,64 @@
+#define WINDLOG_TYPED_FORMAT
+#include "typed_format.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "windlog.hpp"
+
+using windlog::TypedFormat;
+
+TEST(TypedFormatTest, CompileTimeChecks)
+{
+    static_assert(TypedFormat::countArgs("no args") == 0);
+    static_assert(TypedFormat::countArgs("{} and {}") == 2);
+    static_assert(TypedFormat::countArgs("{{escaped}} {}") == 1);
+    static_assert(TypedFormat::countArgs("{0}") == TypedFormat::npos);
+    static_assert(TypedFormat::countArgs("dangling }") == TypedFormat::npos);
+    static_assert(TypedFormat::check<int, double>("{}={}"));
+    static_assert(!TypedFormat::check<int>("{}={}"));
+    static_assert(!TypedFormat::formattable<std::vector<int>>());
+    SUCCEED();
+}
+
+TEST(TypedFormatTest, FormatsSupportedTypes)
+{
+    std::string out;
+    std::string str = "std";
+    int value = 0;
+    TypedFormat::format(out, "{} {} {} {} {} {} {} {}", 42, -7L, 3.5, true, 'c', "lit", str,
+                        std::string_view("view"));
+    EXPECT_EQ(out, "42 -7 3.5 true c lit std view");
+
+    out.clear();
+    TypedFormat::format(out, "{{{}}} {}", 1u, (const char*)nullptr);
+    EXPECT_EQ(out, "{1} (null)");
+
+    out.clear();
+    TypedFormat::format(out, "{}", &value);
+    EXPECT_EQ(out.compare(0, 2, "0x"), 0);
+}
+
+TEST(TypedFormatTest, FormatToTruncatesLikeSnprintf)
+{
+    char buf[8];
+    size_t n = TypedFormat::formatTo(buf, sizeof(buf), "value={}", 123456);
+    EXPECT_EQ(n, 12u);
+    EXPECT_EQ(std::string(buf, sizeof(buf)), "value=12");
+}
+
+TEST(TypedFormatTest, MacrosRouteToTypedApi)
+{
+    std::unique_ptr<windlog::LoggerBuilder> builder(new windlog::LocalLoggerBuilder());
+    builder->buildLoggerName("typed_logger");
+    builder->buildLoggerFormatter("[%p] %m%n");
+    auto logger = builder->build();
+
+    testing::internal::CaptureStdout();
+    WI__INFO(logger, "id={} name={} ratio={}", 7, "windlog", 0.25);
+    logger->flush();
+    std::string captured = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(captured, "[INFO] id=7 name=windlog ratio=0.25\n");
+}
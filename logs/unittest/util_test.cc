@@ -3,6 +3,8 @@
 #include <fstream>
 #include <filesystem>
 #include <cstdio> // for std::remove
+#include <cstdlib>
+#include <cstring>
 
 #include "util/time_util.hpp"
 #include "util/file_util.hpp"
@@ -67,6 +69,20 @@ TEST(FileUtilTest, BasenameExtractsFilename) {
     EXPECT_EQ(util::file::basename("/trailing/slash/"), "");
 }
 
+TEST(FileUtilTest, InternBasenamePointsIntoStaticString) {
+    static const char* paths[] = {"/var/log/syslog.txt", "relative/path/file.txt", "justfile"};
+    for (int round = 0; round < 2; ++round)
+    {
+        for (const char* path : paths)
+        {
+            std::string_view base = util::file::internBasename(path);
+            EXPECT_EQ(base, util::file::basename(path));
+            // 结果直接指向原字符串的末尾
+            EXPECT_EQ(base.data() + base.size(), path + strlen(path));
+        }
+    }
+}
+
 TEST(FileUtilTest, StemExtractsNameWithoutExtension) {
     EXPECT_EQ(util::file::stem("syslog.txt"), "syslog");
     EXPECT_EQ(util::file::stem("archive.tar.gz"), "archive.tar");  // 注意只去掉最后一段
@@ -74,3 +90,28 @@ TEST(FileUtilTest, StemExtractsNameWithoutExtension) {
     EXPECT_EQ(util::file::stem(""), "");
 }
 
+
+TEST(TimeUtilTest, PreciseNowMatchesWallClock) {
+    time_t sec;
+    uint32_t nsec;
+    util::Date::now(sec, nsec);
+    EXPECT_LT(nsec, 1000000000u);
+    EXPECT_LE(std::abs(sec - util::Date::now()), 1);
+}
+
+TEST(TimeUtilTest, TscClockTracksRealtime) {
+    for (int i = 0; i < 1000; ++i)
+    {
+        struct timespec before, after;
+        time_t sec;
+        uint32_t nsec;
+        clock_gettime(CLOCK_REALTIME, &before);
+        util::TscClock::now(sec, nsec);
+        clock_gettime(CLOCK_REALTIME, &after);
+
+        // 校准误差允许在1ms以内
+        int64_t ns = sec * 1000000000LL + nsec;
+        EXPECT_GE(ns, before.tv_sec * 1000000000LL + before.tv_nsec - 1000000);
+        EXPECT_LE(ns, after.tv_sec * 1000000000LL + after.tv_nsec + 1000000);
+    }
+}